@@ -0,0 +1,228 @@
+#include "Arduino.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+
+int hostLogLevel = 0;
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+static bool virtualClock = false;
+static uint64_t virtualMicros = 0;
+
+static uint64_t now()
+{
+    if (virtualClock)
+        return virtualMicros;
+
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void hostUseVirtualClock(bool enable)
+{
+    virtualClock = enable;
+    virtualMicros = 0;
+}
+
+bool hostVirtualClock()
+{
+    return virtualClock;
+}
+
+void hostAdvanceClock(uint64_t us)
+{
+    virtualMicros += us;
+}
+
+uint32_t millis()
+{
+    return now() / 1000;
+}
+
+uint32_t micros()
+{
+    return now();
+}
+
+void delay(uint32_t ms)
+{
+    if (virtualClock)
+        virtualMicros += (uint64_t)ms * 1000;
+    else
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    delay(ticks * portTICK_PERIOD_MS);
+}
+
+// The static buffers of FreeRTOS are too small for the host objects, which are allocated instead.
+// A queue keeps its items in the storage of the caller, as on the ESP32.
+typedef struct
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    uint8_t *storage;
+    size_t length;
+    size_t itemSize;
+    size_t head = 0;
+    size_t count = 0;
+}hostQueue_t;
+
+typedef struct
+{
+    std::mutex mutex;
+    std::condition_variable given;
+    bool available = false;
+}hostSemaphore_t;
+
+static thread_local TaskHandle_t currentTask = NULL;
+
+/**
+ * @brief Waits on the condition until the predicate holds or the ticks expire.
+ *
+ * @return true     If the predicate holds.
+ */
+template <typename Predicate>
+static bool waitTicks(std::condition_variable &condition, std::unique_lock<std::mutex> &lock, TickType_t ticks, Predicate predicate)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        condition.wait(lock, predicate);
+        return true;
+    }
+    return condition.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), predicate);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t *storage, StaticQueue_t *)
+{
+    hostQueue_t *queue = new hostQueue_t;
+    queue->storage = storage;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t ticks)
+{
+    hostQueue_t *queue = (hostQueue_t *)handle;
+    std::unique_lock<std::mutex> lock(queue->mutex);
+
+    if (!waitTicks(queue->changed, lock, ticks, [queue] { return queue->count < queue->length; }))
+        return pdFAIL;
+
+    memcpy(queue->storage + ((queue->head + queue->count) % queue->length) * queue->itemSize, item, queue->itemSize);
+    queue->count++;
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t ticks)
+{
+    hostQueue_t *queue = (hostQueue_t *)handle;
+    std::unique_lock<std::mutex> lock(queue->mutex);
+
+    if (!waitTicks(queue->changed, lock, ticks, [queue] { return queue->count > 0; }))
+        return pdFALSE;
+
+    memcpy(item, queue->storage + queue->head * queue->itemSize, queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken)
+{
+    if (woken)
+        *woken = pdFALSE;
+    return xQueueSend(queue, item, 0);
+}
+
+/**
+ * @brief Runs the task function on a detached thread. The handle is the address of the task buffer.
+ *
+ */
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char *, uint32_t, void *parameter,
+                                           UBaseType_t, StackType_t *, StaticTask_t *buffer, BaseType_t)
+{
+    TaskHandle_t handle = buffer;
+    std::thread([function, parameter, handle]
+    {
+        currentTask = handle;
+        function(parameter);
+    }).detach();
+    return handle;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return currentTask;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *)
+{
+    return new hostSemaphore_t;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks)
+{
+    hostSemaphore_t *semaphore = (hostSemaphore_t *)handle;
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+
+    if (!waitTicks(semaphore->given, lock, ticks, [semaphore] { return semaphore->available; }))
+        return pdFALSE;
+
+    semaphore->available = false;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle)
+{
+    hostSemaphore_t *semaphore = (hostSemaphore_t *)handle;
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+
+    if (semaphore->available)
+        return pdFALSE;
+
+    semaphore->available = true;
+    semaphore->given.notify_all();
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    delete (hostSemaphore_t *)semaphore;
+}
+
+void esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    static const uint8_t hostMac[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 };
+    memcpy(mac, hostMac, sizeof(hostMac));
+}
+
+uint32_t esp_random()
+{
+    static std::mt19937 generator(1);
+    return generator();
+}
+
+size_t Stream::printf(const char *format, ...)
+{
+    char buffer[512];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (length < 0)
+        return 0;
+    if ((size_t)length >= sizeof(buffer))
+        length = sizeof(buffer) - 1;
+
+    return write((const uint8_t *)buffer, length);
+}
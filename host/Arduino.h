@@ -0,0 +1,136 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/**
+ * Minimal Arduino / ESP-IDF shim used to build the SIM7600 driver on the host (env:native).
+ * Only the functions used by the driver are provided.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+typedef enum
+{
+    GPIO_NUM_4 = 4,
+    GPIO_NUM_13 = 13,
+    GPIO_NUM_25 = 25,
+    GPIO_NUM_26 = 26,
+    GPIO_NUM_27 = 27
+}gpio_num_t;
+
+typedef enum
+{
+    GPIO_MODE_INPUT = 1,
+    GPIO_MODE_OUTPUT = 2
+}gpio_mode_t;
+
+typedef enum
+{
+    GPIO_INTR_DISABLE = 0,
+    GPIO_INTR_LOW_LEVEL = 4
+}gpio_int_type_t;
+
+typedef enum
+{
+    ESP_MAC_WIFI_STA = 0
+}esp_mac_type_t;
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define IRAM_ATTR
+
+inline void gpio_reset_pin(gpio_num_t) {}
+inline void gpio_set_direction(gpio_num_t, gpio_mode_t) {}
+inline void gpio_set_level(gpio_num_t, uint32_t) {}
+inline esp_err_t gpio_install_isr_service(int) { return ESP_OK; }
+inline esp_err_t gpio_isr_handler_add(gpio_num_t, void (*)(void *), void *) { return ESP_OK; }
+inline esp_err_t gpio_wakeup_enable(gpio_num_t, gpio_int_type_t) { return ESP_OK; }
+inline esp_err_t gpio_intr_enable(gpio_num_t) { return ESP_OK; }
+inline esp_err_t gpio_intr_disable(gpio_num_t) { return ESP_OK; }
+void esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+uint32_t esp_random();
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+
+// Virtual clock for the modem simulator. When enabled, time only advances through
+// delay(), vTaskDelay() and hostAdvanceClock(), so runs are fast and reproducible.
+void hostUseVirtualClock(bool enable);
+bool hostVirtualClock();
+void hostAdvanceClock(uint64_t us);
+
+#define portTICK_PERIOD_MS 1
+typedef uint32_t TickType_t;
+void vTaskDelay(TickType_t ticks);
+
+// FreeRTOS on threads: a task is a detached std::thread (which may return), the queues and
+// semaphores block on a condition variable. The waits are on the real clock, so the tasks are
+// not used with the virtual clock. Without the I/O task (e.g. the simulator runs), the driver
+// processes every request directly on the calling thread.
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void *QueueHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef uint8_t StackType_t;        // The stack depth is in bytes on the ESP32.
+typedef struct { uint8_t data[344]; } StaticTask_t;
+typedef struct { uint8_t data[84]; } StaticQueue_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFF
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t *storage, StaticQueue_t *buffer);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken);
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameter,
+                                           UBaseType_t priority, StackType_t *stack, StaticTask_t *buffer, BaseType_t core);
+TaskHandle_t xTaskGetCurrentTaskHandle();      // NULL on the main thread, which is not a task.
+
+typedef void *SemaphoreHandle_t;
+typedef struct { uint8_t data[80]; } StaticSemaphore_t;
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+
+extern int hostLogLevel;
+
+#define HOST_LOG(level, letter, tag, format, ...) \
+    do { if (hostLogLevel >= level) printf(letter " (%u) %s: " format "\n", millis(), tag, ##__VA_ARGS__); } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(1, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(2, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(3, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG(4, "D", tag, format, ##__VA_ARGS__)
+
+class Stream
+{
+    public:
+        virtual ~Stream() {}
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+        virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+
+        size_t write(uint8_t c) { return write(&c, 1); }
+        size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+        size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+        void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+
+    protected:
+        unsigned long timeout = 1000;
+};
+
+#endif
@@ -0,0 +1,432 @@
+#include "ModemSimulator.h"
+
+#include <algorithm>
+
+/**
+ * @brief Construct a new ModemSimulator object with the default profile.
+ * 
+ */
+ModemSimulator::ModemSimulator() : ModemSimulator(profile_t())
+{
+}
+
+/**
+ * @brief Construct a new ModemSimulator object.
+ * 
+ * @param profile   Latency, jitter, baud rate and byte loss of the simulated link.
+ */
+ModemSimulator::ModemSimulator(const profile_t &profile) : profile(profile), random(profile.seed), modemBaud(profile.baud),
+    hostBaud(profile.baud)
+{
+}
+
+/**
+ * @brief Adds a rule for commands starting with the prefix. Later rules take precedence.
+ * 
+ * @param prefix    Prefix of the command (e.g. "AT+CGPS?").
+ * @param reply     Lines sent in reply.
+ * @param times     Number of commands the rule is used for (e.g. to inject failures), or 0 for always.
+ */
+void ModemSimulator::respond(const char *prefix, const std::vector<reply_t> &reply, unsigned int times)
+{
+    rules.push_back({ prefix, reply, false, times, times > 0 });
+}
+
+/**
+ * @brief Adds a rule for commands which send the "> " prompt and then read data. The length of
+ * the data is the last number in the command (e.g. AT+CMQTTPAYLOAD=0,<length>).
+ * 
+ * @param prefix    Prefix of the command.
+ * @param reply     Lines sent after the data is received.
+ */
+void ModemSimulator::prompt(const char *prefix, const std::vector<reply_t> &reply)
+{
+    rules.push_back({ prefix, reply, true, 0, false });
+}
+
+/**
+ * @brief Schedules an unsolicited result code.
+ * 
+ * @param at    Time (millis()) at which the URC is sent.
+ * @param text  Line without "\r\n".
+ */
+void ModemSimulator::urc(uint32_t at, const char *text)
+{
+    queueText(std::string("\r\n") + text + "\r\n", (uint64_t)at * 1000);
+}
+
+/**
+ * @brief Simulates the power-on of the modem at the current time. Commands sent before it is
+ * ready get no reply. The URCs are sent as by a SIM7600: "RDY", "+CPIN: READY", then "SMS DONE"
+ * and "PB DONE" once the phonebook is loaded. "+CGREG: 1" is sent on registration if enabled
+ * with AT+CGREG=1.
+ * 
+ * @param ready         Time (millis()) of "RDY".
+ * @param registered    Time (millis()) of the registration to the packet domain.
+ */
+void ModemSimulator::boot(uint32_t ready, uint32_t registered)
+{
+    readyAt = (uint64_t)ready * 1000;
+    registeredAt = (uint64_t)registered * 1000;
+
+    urc(ready, "RDY");
+    urc(ready + 300, "+CPIN: READY");
+    urc(ready + 4500, "SMS DONE");
+    urc(ready + 5000, "PB DONE");
+}
+
+/**
+ * @brief Sets the time to first fix after AT+CGPSHOT (or AT+CGPS=1), AT+CGPSWARM and AT+CGPSCOLD.
+ * 0 for all, the default, gives a fix at once.
+ * 
+ */
+void ModemSimulator::gnssTTFF(uint32_t hot, uint32_t warm, uint32_t cold)
+{
+    ttff[0] = hot;
+    ttff[1] = warm;
+    ttff[2] = cold;
+}
+
+/**
+ * @brief Sets the modem clock (AT+CCLK?), as done by the network time.
+ * 
+ * @param now   Unix time at the current virtual time.
+ */
+void ModemSimulator::setClock(time_t now)
+{
+    clockSet = true;
+    clockOffset = (int64_t)now - (int64_t)(micros() / 1000000);
+}
+
+/**
+ * @brief Rules for a SIM7600 with GNSS fix, certificates present and a reachable broker.
+ * 
+ */
+void ModemSimulator::loadDefaultScript()
+{
+    respond("AT", { { 0, "OK" } });
+    respond("ATE0", { { 0, "OK" } });
+    respond("AT+CPOF", { { 0, "OK" } });
+    respond("AT+CRESET", { { 0, "OK" } });
+    respond("AT+CSCLK", { { 0, "OK" } });
+    respond("AT+CGATT?", { { 0, "+CGATT: 1" }, { 0, "OK" } });
+    respond("AT+CPIN?", { { 0, "+CPIN: READY" }, { 0, "OK" } });
+    respond("AT+CGREG=", { { 0, "OK" } });
+    respond("AT+CGPS=1", { { 0, "OK" } });
+    respond("AT+CGPS=0", { { 0, "OK" }, { 500, "+CGPS: 0" } });
+    respond("AT+CGPSCOLD", { { 0, "OK" } });
+    respond("AT+CGPSWARM", { { 0, "OK" } });
+    respond("AT+CGPSHOT", { { 0, "OK" } });
+    respond("AT+CGNSSINFO", { { 0, "+CGNSSINFO: 2,09,05,00,3113.343286,N,12121.234064,E,250311,072809.3,44.1,0.0,0,1.1,0.8,0.7" }, { 0, "OK" } });
+    respond("AT+CGPSINFO", { { 0, "+CGPSINFO: 3113.343286,N,12121.234064,E,250311,072809.0,44.1,0.0,0" }, { 0, "OK" } });
+    prompt("AT+CCERTDOWN", { { 0, "OK" } });
+    files["Amazon-Root-Certificate-Filename"] = "";
+    files["Thing-Certificate-Filename"] = "";
+    files["Private-Key-Filename"] = "";
+    respond("AT+CSSLCFG", { { 0, "OK" } });
+    respond("AT+CMQTTSTART", { { 0, "OK" }, { 50, "+CMQTTSTART: 0" } });
+    respond("AT+CMQTTSTOP", { { 0, "OK" }, { 50, "+CMQTTSTOP: 0" } });
+    respond("AT+CMQTTACCQ", { { 0, "OK" } });
+    respond("AT+CMQTTREL", { { 0, "OK" } });
+    respond("AT+CMQTTSSLCFG", { { 0, "OK" } });
+    respond("AT+CMQTTCONNECT", { { 0, "OK" }, { 900, "+CMQTTCONNECT: 0,0" } });
+    respond("AT+CMQTTDISC", { { 0, "OK" }, { 100, "+CMQTTDISC: 0,0" } });
+    prompt("AT+CMQTTTOPIC", { { 0, "OK" } });
+    prompt("AT+CMQTTPAYLOAD", { { 0, "OK" } });
+    respond("AT+CMQTTPUB", { { 0, "OK" }, { 150, "+CMQTTPUB: 0,0" } });
+}
+
+int ModemSimulator::available()
+{
+    uint64_t now = micros();
+    uint64_t at = 0;
+    int count = 0;
+
+    for (const block_t &block : output)
+    {
+        at = std::max(at, block.at);
+        for (size_t i = 0; i < block.text.size(); i++)
+        {
+            at += byteTime(block.baud);
+            if (at > now)
+                return count;
+            count++;
+        }
+    }
+    return count;
+}
+
+int ModemSimulator::read()
+{
+    if (!available())
+        return -1;
+
+    block_t &block = output.front();
+    char c = block.text[0];
+    bool garbled = (block.baud != hostBaud);
+
+    block.text.erase(0, 1);
+    block.at += byteTime(block.baud);
+    if (block.text.empty())
+        output.pop_front();
+
+    return garbled ? (uint8_t)c | 0x80 : (uint8_t)c;
+}
+
+int ModemSimulator::peek()
+{
+    if (!available())
+        return -1;
+
+    const block_t &block = output.front();
+    return (block.baud != hostBaud) ? (uint8_t)block.text[0] | 0x80 : (uint8_t)block.text[0];
+}
+
+size_t ModemSimulator::write(const uint8_t *buffer, size_t size)
+{
+    counters.bytesToModem += size;
+    hostAdvanceClock(size * byteTime(hostBaud));
+
+    // At another rate than the modem's, the bytes are not understood.
+    if (hostBaud != modemBaud)
+        return size;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        char c = buffer[i];
+
+        if (dataRemaining > 0)
+        {
+            if (!dataFile.empty())
+                files[dataFile] += c;
+            if (--dataRemaining == 0)
+            {
+                dataFile.clear();
+                queueReply(dataRule->reply, micros());
+            }
+            continue;
+        }
+
+        if (c == '\r')
+        {
+            if (!line.empty())
+                handleCommand(line);
+            line.clear();
+        }
+        else if (c != '\n')
+            line += c;
+    }
+    return size;
+}
+
+/**
+ * @brief Blocks until the next byte is delivered or the timeout expires. On the real clock,
+ * wake() ends the wait too.
+ * 
+ * @param timeout   Timeout in ms, or MODEM_WAIT_FOREVER.
+ * @return true     If bytes are available.
+ */
+bool ModemSimulator::waitData(uint32_t timeout)
+{
+    uint64_t now = micros();
+    uint64_t until = (timeout == MODEM_WAIT_FOREVER) ? UINT64_MAX : now + (uint64_t)timeout * 1000;
+
+    if (!output.empty())
+        until = std::min(until, output.front().at + byteTime(output.front().baud));
+
+    if (hostVirtualClock())
+    {
+        // Only the calling task runs: without a queued byte, nothing would end the wait.
+        if (until > now && until != UINT64_MAX)
+            delay((until - now + 999) / 1000);
+    }
+    else
+    {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        if (until == UINT64_MAX)
+            wakeCondition.wait(lock, [this] { return woken; });
+        else if (until > now)
+            wakeCondition.wait_for(lock, std::chrono::microseconds(until - now), [this] { return woken; });
+        woken = false;
+    }
+
+    return available() > 0;
+}
+
+/**
+ * @brief Ends the current or the next waitData() on the real clock.
+ * 
+ */
+void ModemSimulator::wake()
+{
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    woken = true;
+    wakeCondition.notify_all();
+}
+
+/**
+ * @brief Changes the rate of the ESP32 side.
+ * 
+ */
+bool ModemSimulator::setBaudRate(uint32_t baud)
+{
+    hostBaud = baud;
+    return true;
+}
+
+/**
+ * @brief Finds the rule with the longest matching prefix and queues its reply. AT+IPR switches the
+ * rate after its "OK", AT+CCERTLIST is answered from the certificate files, AT+CGREG? from the registration time, AT+CCLK? from the
+ * clock, AT+CGPS? from the GNSS power, and AT+CGNSSINFO has no fix while the GNSS engine is off
+ * or acquiring.
+ * 
+ */
+void ModemSimulator::handleCommand(const std::string &command)
+{
+    counters.commands++;
+    log.push_back(command);
+
+    if (micros() < readyAt)
+        return;
+
+    if (command == "AT+CGREG?")
+    {
+        queueReply({ { 0, std::string("+CGREG: ") + registrationURC + (micros() >= registeredAt ? ",1" : ",2") }, { 0, "OK" } }, micros());
+        return;
+    }
+
+    if (command == "AT+CCLK?")
+    {
+        time_t now = clockSet ? (time_t)(clockOffset + (int64_t)(micros() / 1000000)) : 315964800;   // 80/01/06
+        tm t;
+        gmtime_r(&now, &t);
+        char text[40];
+        snprintf(text, sizeof(text), "+CCLK: \"%02d/%02d/%02d,%02d:%02d:%02d+00\"", t.tm_year % 100, t.tm_mon + 1, t.tm_mday,
+                 t.tm_hour, t.tm_min, t.tm_sec);
+        queueReply({ { 0, text }, { 0, "OK" } }, micros());
+        return;
+    }
+
+    if (command == "AT+CGPSHOT" || command == "AT+CGPS=1")
+        fixAt = micros() + (uint64_t)ttff[0] * 1000;
+    else if (command == "AT+CGPSWARM")
+        fixAt = micros() + (uint64_t)ttff[1] * 1000;
+    else if (command == "AT+CGPSCOLD")
+        fixAt = micros() + (uint64_t)ttff[2] * 1000;
+    else if (command == "AT+CGPS=0")
+        fixAt = UINT64_MAX;
+    else if (command == "AT+CGPS?")
+    {
+        queueReply({ { 0, fixAt == UINT64_MAX ? "+CGPS: 0,1" : "+CGPS: 1,1" }, { 0, "OK" } }, micros());
+        return;
+    }
+    else if (command == "AT+CGNSSINFO" && micros() < fixAt)
+    {
+        queueReply({ { 0, "+CGNSSINFO: ,,,,,,,,,,,,,,," }, { 0, "OK" } }, micros());
+        return;
+    }
+
+    if (command.compare(0, 9, "AT+CGREG=") == 0)
+    {
+        registrationURC = command[9];
+        if (registrationURC == '1' && micros() < registeredAt)
+            queueText("\r\n+CGREG: 1\r\n", registeredAt);
+    }
+
+    if (command.compare(0, 7, "AT+IPR=") == 0)
+    {
+        static const uint32_t rates[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 3000000, 3200000, 3686400 };
+        uint32_t baud = strtoul(command.c_str() + 7, NULL, 10);
+        bool supported = std::find(std::begin(rates), std::end(rates), baud) != std::end(rates);
+
+        queueReply({ { 0, supported ? "OK" : "ERROR" } }, micros());
+        if (supported)
+            modemBaud = baud;
+        return;
+    }
+
+    if (command == "AT+CCERTLIST")
+    {
+        std::vector<reply_t> list;
+        for (const auto &file : files)
+            list.push_back({ 0, "+CCERTLIST: \"" + file.first + "\"" });
+        list.push_back({ 0, "OK" });
+        queueReply(list, micros());
+        return;
+    }
+
+    rule_t *match = nullptr;
+    for (rule_t &rule : rules)
+        if ((!rule.expires || rule.remaining > 0) && command.compare(0, rule.prefix.size(), rule.prefix) == 0 &&
+            (!match || rule.prefix.size() >= match->prefix.size()))
+            match = &rule;
+
+    if (match == nullptr)
+    {
+        queueReply({ { 0, "ERROR" } }, micros());
+        return;
+    }
+
+    if (match->expires)
+        match->remaining--;
+
+    if (match->prompt)
+    {
+        size_t comma = command.find_last_of(',');
+        dataRemaining = strtoul(command.c_str() + (comma == std::string::npos ? command.size() : comma + 1), NULL, 10);
+        dataRule = match;
+        if (command.compare(0, 14, "AT+CCERTDOWN=\"") == 0)
+        {
+            dataFile = command.substr(14, command.find('"', 14) - 14);
+            files[dataFile].clear();
+        }
+        queueReply({ { 0, ">" } }, micros());
+        if (dataRemaining == 0)
+            queueReply(match->reply, micros());
+        return;
+    }
+
+    queueReply(match->reply, micros());
+}
+
+void ModemSimulator::queueReply(const std::vector<reply_t> &reply, uint64_t start)
+{
+    std::uniform_int_distribution<uint32_t> jitter(0, profile.jitter);
+    uint64_t at = start + (uint64_t)(profile.latency + jitter(random)) * 1000;
+
+    for (const reply_t &r : reply)
+    {
+        at += (uint64_t)r.delay * 1000;
+        at = queueText((r.text == ">") ? std::string("\r\n> ") : "\r\n" + r.text + "\r\n", at);
+    }
+}
+
+/**
+ * @brief Queues the text as one block, after the blocks which start earlier. Bytes may be dropped.
+ * 
+ * @return uint64_t Time at which the last byte is delivered if the link is idle.
+ */
+uint64_t ModemSimulator::queueText(const std::string &text, uint64_t start)
+{
+    std::uniform_real_distribution<double> drop(0, 1);
+    block_t block = { start, "", modemBaud };
+
+    for (char c : text)
+    {
+        counters.bytesFromModem++;
+
+        if (profile.dropRate > 0 && drop(random) < profile.dropRate)
+            counters.droppedBytes++;
+        else
+            block.text += c;
+    }
+
+    if (!block.text.empty())
+    {
+        auto position = std::upper_bound(output.begin(), output.end(), start,
+                                         [](uint64_t at, const block_t &b) { return at < b.at; });
+        output.insert(position, block);
+    }
+
+    return start + text.size() * byteTime(modemBaud);
+}
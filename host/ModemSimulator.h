@@ -0,0 +1,127 @@
+#ifndef MODEM_SIMULATOR_H
+#define MODEM_SIMULATOR_H
+
+#include "Arduino.h"
+#include "ModemTransport.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Scripted SIM7600 simulator for the host build. It is the transport given to the driver classes.
+ * 
+ * Commands written by the driver are matched against rules (by prefix) and the scripted reply
+ * lines are queued with a delivery time on the virtual clock. Latency, jitter, UART wire time,
+ * dropped bytes and unsolicited result codes (URCs) are configurable. Certificate files written
+ * with AT+CCERTDOWN are kept and listed by AT+CCERTLIST. The power-on sequence can be simulated:
+ * commands are ignored until the modem is ready and AT+CGREG? follows the network registration.
+ * AT+CGNSSINFO has no fix until the time to first fix of the last GNSS start has passed, and
+ * AT+CCLK? follows the virtual clock once it is set. AT+IPR switches the rate of the modem after
+ * its "OK"; while the rates of the two sides differ, the bytes are garbled in both directions.
+ */
+class ModemSimulator: public ModemTransport
+{
+    public:
+        typedef struct
+        {
+            uint32_t delay;         // Delay (in ms) after the previous line of the reply.
+            std::string text;       // Line without "\r\n". ">" is sent as the "> " data prompt.
+        }reply_t;
+
+        typedef struct
+        {
+            uint32_t latency = 20;  // Time (in ms) between the end of a command and the reply.
+            uint32_t jitter = 0;    // Random extra latency (in ms), uniform in [0, jitter].
+            uint32_t baud = MODEM_DEFAULT_BAUD; // UART baud rate at the start, used for the wire time of every byte.
+            double dropRate = 0;    // Probability that a byte sent by the modem is lost.
+            uint32_t seed = 1;
+        }profile_t;
+
+        typedef struct
+        {
+            unsigned long commands;
+            unsigned long bytesToModem;
+            unsigned long bytesFromModem;
+            unsigned long droppedBytes;
+        }stats_t;
+
+        ModemSimulator();
+        ModemSimulator(const profile_t &profile);
+
+        void respond(const char *prefix, const std::vector<reply_t> &reply, unsigned int times = 0);
+        void prompt(const char *prefix, const std::vector<reply_t> &reply);
+        void urc(uint32_t at, const char *text);
+        void boot(uint32_t ready, uint32_t registered);
+        void gnssTTFF(uint32_t hot, uint32_t warm, uint32_t cold);
+        void setClock(time_t now);
+        void loadDefaultScript();
+
+        const std::vector<std::string> &commands() const { return log; }
+        const stats_t &stats() const { return counters; }
+        void clearLog() { log.clear(); }
+        std::map<std::string, std::string> &certificates() { return files; }
+
+        int available() override;
+        int read() override;
+        int peek() override;
+        size_t write(const uint8_t *buffer, size_t size) override;
+        bool waitData(uint32_t timeout) override;
+        void wake() override;
+        bool setBaudRate(uint32_t baud) override;
+        uint32_t baudRate() const override { return hostBaud; }
+
+    private:
+        typedef struct
+        {
+            std::string prefix;
+            std::vector<reply_t> reply;
+            bool prompt;
+            unsigned int remaining;     // Uses left, or 0 for a rule which never expires.
+            bool expires;
+        }rule_t;
+
+        typedef struct
+        {
+            uint64_t at;            // Delivery time (in us) of the first byte.
+            std::string text;       // Bytes not yet read. Blocks are never interleaved.
+            uint32_t baud;          // Rate at which the modem sends the block.
+        }block_t;
+
+        void handleCommand(const std::string &command);
+        void queueReply(const std::vector<reply_t> &reply, uint64_t start);
+        uint64_t queueText(const std::string &text, uint64_t start);
+        static uint64_t byteTime(uint32_t baud) { return 10000000ULL / baud; }
+
+        profile_t profile;
+        std::mt19937 random;
+        std::vector<rule_t> rules;
+        std::deque<block_t> output;
+        std::vector<std::string> log;
+        stats_t counters = {};
+        uint32_t modemBaud;
+        uint32_t hostBaud;
+
+        std::string line;
+        size_t dataRemaining = 0;   // Bytes still expected after a "> " prompt.
+        const rule_t *dataRule = nullptr;
+        std::map<std::string, std::string> files;
+        std::string dataFile;       // Certificate file receiving the data, or empty.
+        uint64_t readyAt = 0;       // Time (in us) before which commands are ignored.
+        uint64_t registeredAt = 0;  // Time (in us) of the network registration.
+        char registrationURC = '0'; // <n> of AT+CGREG.
+        uint32_t ttff[3] = {};      // Time to first fix (in ms) of a hot, warm and cold start.
+        uint64_t fixAt = 0;         // Time (in us) of the first fix after the last start.
+        bool clockSet = false;
+        int64_t clockOffset = 0;    // Unix time minus virtual time (in s).
+
+        std::mutex wakeMutex;       // wake() is called from other tasks than the I/O task.
+        std::condition_variable wakeCondition;
+        bool woken = false;
+};
+
+#endif
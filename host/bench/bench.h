@@ -0,0 +1,104 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "Arduino.h"
+#include "TrackBuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/**
+ * Result of a benchmark, written to the results file and compared with the baseline. Lower
+ * values are better for every unit (ns/op, bytes/fix, ms).
+ */
+typedef struct
+{
+    std::string name;
+    double value;
+    std::string unit;
+    double spread;          // Interquartile range of the rounds, in percent of the value. 0 for exact results.
+}bench_entry_t;
+
+extern std::vector<bench_entry_t> bench_results;
+
+inline void bench_record(const char *name, double value, const char *unit, double spread = 0)
+{
+    bench_results.push_back({ name, value, unit, spread });
+}
+
+/**
+ * @brief Stream which discards everything written to it and never has data to read.
+ * 
+ */
+class NullStream: public Stream
+{
+    public:
+        int available() override { return 0; }
+        int read() override { return -1; }
+        int peek() override { return -1; }
+        size_t write(const uint8_t *buffer, size_t size) override { return size; }
+};
+
+#define BENCH_REPEATS 11
+
+/**
+ * @brief Runs the function the given number of times, in repeats rounds, prints and records the
+ * median time per iteration of the rounds and their spread, the interquartile range, which widens
+ * the threshold of the comparison with the baseline (see compare_results in bench_main.cpp). The
+ * iterations should make a round last at least about 20 ms: shorter rounds are dominated by the
+ * timer and the scheduler of the host.
+ * 
+ * @param name          Name of the benchmark.
+ * @param iterations    Number of iterations per round.
+ * @param function      Function to be measured.
+ * @param repeats       Number of rounds.
+ * @param setup         Function called before every round and not measured, for functions which
+ *                      change the state they measure.
+ */
+template <typename F, typename S>
+void bench_result(const char *name, unsigned int iterations, F function, unsigned int repeats, S setup)
+{
+    std::vector<double> rounds;
+
+    for (unsigned int round = 0; round < repeats; round++)
+    {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < iterations; i++)
+            function();
+        auto stop = std::chrono::steady_clock::now();
+
+        rounds.push_back(std::chrono::duration<double, std::nano>(stop - start).count() / iterations);
+    }
+
+    std::sort(rounds.begin(), rounds.end());
+    double ns = rounds[rounds.size() / 2];
+    double spread = (ns > 0) ? 100.0 * (rounds[rounds.size() * 3 / 4] - rounds[rounds.size() / 4]) / ns : 0;
+
+    printf("%-32s %10u iterations %12.1f ns/op %6.1f%% spread\n", name, iterations, ns, spread);
+    bench_record(name, ns, "ns/op", spread);
+}
+
+template <typename F>
+void bench_result(const char *name, unsigned int iterations, F function, unsigned int repeats = BENCH_REPEATS)
+{
+    bench_result(name, iterations, function, repeats, []() {});
+}
+
+std::vector<TrackBuffer::record_t> load_track(const char *path);
+GPS::data_t record_data(const TrackBuffer::record_t &record);
+double track_distance(const TrackBuffer::record_t &a, const TrackBuffer::record_t &b);
+
+void bench_parser(const char *corpus);
+void bench_track_buffer();
+void bench_payload(const char *track);
+void bench_scheduler(const char *track);
+void bench_deadband(const char *track);
+void bench_geofence(const char *track);
+void bench_conversion();
+void bench_publish_cycle(const char *track);
+void bench_publish_window(const char *track);
+void bench_baud_rate();
+
+#endif
@@ -0,0 +1,79 @@
+#include "bench.h"
+#include "ModemSimulator.h"
+#include "SIM7600.h"
+
+/**
+ * @brief Wire time of the large transfers at the default rate and at the rates negotiated with
+ * AT+IPR: the three certificates of a new device (AT+CCERTDOWN) and a 2 KB batch publish. Then
+ * the recovery of the rate after a restart of the ESP32 alone, with the modem still at the
+ * negotiated rate. Times are on the virtual clock of the simulator.
+ *
+ */
+void bench_baud_rate()
+{
+    const size_t lengths[3] = { 1188, 1224, 1679 };
+    std::string certificates[3];
+    for (uint8_t i = 0; i < 3; i++)
+        certificates[i].assign(lengths[i], 'A' + i);
+    std::string payload(2048, 'x');
+
+    hostUseVirtualClock(true);
+    ModemSimulator::profile_t profile;
+    profile.latency = 5;
+
+    const uint32_t rates[] = { MODEM_DEFAULT_BAUD, 921600, 3000000 };
+    for (uint32_t baud : rates)
+    {
+        ModemSimulator modem(profile);
+        modem.loadDefaultScript();
+        SIM7600::invalidateState();
+        SSL ssl(modem);
+        MQTT mqtt(modem);
+
+        if (!ssl.syncBaudRate(baud))
+        {
+            fprintf(stderr, "bench_baud_rate: %lu baud not negotiated\n", (unsigned long)baud);
+            continue;
+        }
+
+        uint32_t start = millis();
+        bool success = true;
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            char command[64];
+            snprintf(command, sizeof(command), "AT+CCERTDOWN=\"cert%u.pem\",%zu", i, certificates[i].size());
+            success &= ssl.executeData(command, certificates[i].data(), certificates[i].size()).status == SIM7600::AT_MATCH;
+        }
+        uint32_t certificateTime = millis() - start;
+
+        start = millis();
+        success &= mqtt.setPublishTopicPayload("sim7600/batch", payload.data(), payload.size()) && mqtt.publish();
+        uint32_t publishTime = millis() - start;
+
+        if (!success)
+            fprintf(stderr, "bench_baud_rate: transfer failed at %lu baud\n", (unsigned long)baud);
+
+        printf("uart %7lu baud: certificates %4lu ms, 2 KB publish %4lu ms\n", (unsigned long)baud,
+               (unsigned long)certificateTime, (unsigned long)publishTime);
+        char name[48];
+        snprintf(name, sizeof(name), "uart_certificates_%lu", (unsigned long)baud);
+        bench_record(name, certificateTime, "ms");
+        snprintf(name, sizeof(name), "uart_publish_2k_%lu", (unsigned long)baud);
+        bench_record(name, publishTime, "ms");
+    }
+
+    // The ESP32 restarts at the default rate while the modem stays at 921600.
+    ModemSimulator modem(profile);
+    modem.loadDefaultScript();
+    SIM7600 sim7600(modem);
+    bool negotiated = sim7600.syncBaudRate(921600);
+    modem.setBaudRate(MODEM_DEFAULT_BAUD);
+    uint32_t start = millis();
+    bool recovered = sim7600.syncBaudRate(921600) && modem.baudRate() == 921600;
+    printf("uart rate after a restart of the ESP32 alone: %s in %lu ms\n", (negotiated && recovered) ? "recovered" : "NOT recovered",
+           (unsigned long)(millis() - start));
+    if (!negotiated || !recovered)
+        fprintf(stderr, "bench_baud_rate: rate not recovered\n");
+
+    hostUseVirtualClock(false);
+}
@@ -0,0 +1,31 @@
+#include "bench.h"
+#include "SIM7600.h"
+
+/**
+ * @brief Benchmarks the conversions of GPS::parse on their own: ddmm.mmmmmm coordinates to degrees
+ * x 1e7 (GPS::calcLatLong) and ddmmyy/hhmmss to a timestamp (GPS::formatDateTime).
+ * 
+ */
+void bench_conversion()
+{
+    NullStream stream;
+    GPS gps(stream);
+    const unsigned int iterations = 4000000;
+    unsigned int i = 0;
+
+    bench_result("gps_calc_lat_long", iterations, [&]()
+    {
+        gps.calcLatLong(3113343286LL + (i & 63) * 100, 'N', 12121234064LL + (i & 63) * 100, (i & 1) ? 'E' : 'W');
+        i++;
+    });
+
+    i = 0;
+    bench_result("gps_format_date_time", iterations, [&]()
+    {
+        gps.formatDateTime(151123 + (i % 28) * 10000, 61500 + i % 45);
+        i++;
+    });
+
+    if (gps.data.dateTime().tm_year != 123)
+        fprintf(stderr, "bench_conversion: unexpected year %d\n", gps.data.dateTime().tm_year + 1900);
+}
@@ -0,0 +1,74 @@
+#include "bench.h"
+#include "ModemSimulator.h"
+#include "MQTTConnection.h"
+#include "Payload.h"
+
+/**
+ * @brief Benchmarks a full report against the modem simulator, with the AT flow of fetchGPS()
+ * and pubMQTT(): AT+CGNSSINFO, parse, encode the fix and publish it. Records the CPU time of the
+ * driver and the simulator per cycle, and the latency on the virtual clock of the simulator
+ * (typical link profile, fixed seed), so both are comparable between commits.
+ * 
+ * @param path      Path of the track file, for the battery and sequence of the payloads.
+ */
+void bench_publish_cycle(const char *path)
+{
+    std::vector<TrackBuffer::record_t> track = load_track(path);
+    if (track.empty())
+    {
+        fprintf(stderr, "bench_publish_cycle: track %s is empty or missing\n", path);
+        return;
+    }
+
+    hostUseVirtualClock(true);
+    SIM7600::invalidateState();
+
+    ModemSimulator::profile_t profile;
+    profile.latency = 30;
+    profile.jitter = 20;
+
+    ModemSimulator modem(profile);
+    modem.loadDefaultScript();
+
+    SIM7600 sim7600(modem);
+    GPS gps(modem);
+    MQTT mqtt(modem);
+    SSL ssl(modem);
+    MQTTConnection link(ssl, mqtt, { "tcp://simulated-endpoint", 8883, "Amazon-Root-Certificate-Filename",
+                                     "Thing-Certificate-Filename", "Private-Key-Filename", 1000, 60000, 2 });
+
+    if (!sim7600.echoOFF() || !link.attempt() || !gps.begin())
+    {
+        fprintf(stderr, "bench_publish_cycle: simulated modem did not connect\n");
+        hostUseVirtualClock(false);
+        return;
+    }
+
+    static char buffer[2048];
+    Payload payload(buffer, sizeof(buffer));
+    const unsigned int cycles = 2000;
+    unsigned int failures = 0;
+    size_t index = 0;
+
+    uint32_t start = millis();
+    bench_result("publish_cycle_cpu", cycles, [&]()
+    {
+        TrackBuffer::record_t record = track[index++ % track.size()];
+        bool success = gps.getData();
+        if (success)
+        {
+            record = TrackBuffer::makeRecord(gps.data, record.battery / 1000.0);
+            payload.clear();
+            payload.add(record);
+            success = mqtt.setPublishTopicPayload(payload.topic(), payload.data(), payload.length()) && mqtt.publish();
+        }
+        failures += !success;
+        modem.clearLog();
+    });
+    double latency = (double)(millis() - start) / index;
+
+    printf("%-32s %10zu cycles %13.1f ms (virtual), %u failed\n", "publish_cycle_latency", index, latency, failures);
+    bench_record("publish_cycle_latency", latency, "ms");
+
+    hostUseVirtualClock(false);
+}
@@ -0,0 +1,56 @@
+#include "bench.h"
+#include "DeadBandFilter.h"
+#include "ReportScheduler.h"
+
+/**
+ * @brief Replays a recorded track through DeadBandFilter for a few tolerances and prints the
+ * suppression ratio, the points per km and the largest error of the rebuilt track. The filter
+ * is run on every fix and after the report scheduler, as on the device.
+ * 
+ * @param path      Path of the track file.
+ */
+void bench_deadband(const char *path)
+{
+    std::vector<TrackBuffer::record_t> track = load_track(path);
+    if (track.size() < 2)
+        return;
+
+    double km = 0;
+    for (size_t i = 1; i < track.size(); i++)
+        km += track_distance(track[i - 1], track[i]) / 1000.0;
+
+    const float tolerances[] = { 10.0, 25.0, 50.0, 100.0 };
+    for (float tolerance : tolerances)
+    {
+        DeadBandFilter::config_t config = { tolerance, 300000 };
+        DeadBandFilter every(config), scheduled(config);
+        ReportScheduler scheduler({ 2000, 300000, 30000, 100.0, 20.0, 3.0 });
+
+        uint32_t nextPoll = 0;
+        for (const TrackBuffer::record_t &record : track)
+        {
+            GPS::data_t data = record_data(record);
+            uint32_t now = (record.timestamp - track[0].timestamp) * 1000;
+
+            every.update(data, now);
+            if (now >= nextPoll)
+            {
+                if (scheduler.update(data, now) && scheduled.update(data, now))
+                    scheduler.commit(data, now);
+                nextPoll = now + scheduler.nextPoll();
+            }
+        }
+
+        printf("deadband %5.0f m every fix:  %4u of %4u suppressed (%3.0f%%), %5.1f points/km, max error %5.1f m\n", tolerance,
+               every.stats().suppressed, every.stats().fixes, every.suppressionRatio() * 100, every.stats().published / km, every.stats().maxError);
+        printf("deadband %5.0f m scheduled:  %4u of %4u suppressed (%3.0f%%), %5.1f points/km, max error %5.1f m\n", tolerance,
+               scheduled.stats().suppressed, scheduled.stats().fixes, scheduled.suppressionRatio() * 100, scheduled.stats().published / km, scheduled.stats().maxError);
+    }
+
+    DeadBandFilter filter({ 25.0, 300000 });
+    size_t i = 0;
+    bench_result("deadband_update", 500000, [&]() {
+        const TrackBuffer::record_t &record = track[i++ % track.size()];
+        filter.update(record_data(record), (record.timestamp - track[0].timestamp) * 1000);
+    });
+}
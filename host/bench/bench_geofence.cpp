@@ -0,0 +1,186 @@
+#include "bench.h"
+#include "Geofence.h"
+#include "esp_partition.h"
+
+#include <memory>
+#include <random>
+
+/**
+ * @brief Writes count fences over the area of the track: circles of 50 to 500 m and polygons of
+ * 6 to 24 vertices, one in four centred on a fix of the track so that the track crosses them.
+ *
+ */
+static void write_fences(Geofence &fences, const std::vector<TrackBuffer::record_t> &track, uint16_t count)
+{
+    int32_t minLatitude = track[0].latitude, maxLatitude = track[0].latitude;
+    int32_t minLongitude = track[0].longitude, maxLongitude = track[0].longitude;
+    for (const TrackBuffer::record_t &record : track)
+    {
+        minLatitude = std::min(minLatitude, record.latitude);
+        maxLatitude = std::max(maxLatitude, record.latitude);
+        minLongitude = std::min(minLongitude, record.longitude);
+        maxLongitude = std::max(maxLongitude, record.longitude);
+    }
+
+    std::mt19937 random(count);
+    std::uniform_int_distribution<int32_t> latitude(minLatitude, maxLatitude), longitude(minLongitude, maxLongitude);
+    std::uniform_int_distribution<size_t> fix(0, track.size() - 1);
+    std::uniform_real_distribution<double> size(50, 500), unit(0, 1);
+
+    fences.format();
+    for (uint16_t i = 0; i < count; i++)
+    {
+        int32_t centreLatitude = latitude(random), centreLongitude = longitude(random);
+        if (i % 4 == 0)
+        {
+            const TrackBuffer::record_t &record = track[fix(random)];
+            centreLatitude = record.latitude;
+            centreLongitude = record.longitude;
+        }
+
+        char name[GEOFENCE_NAME_MAX];
+        snprintf(name, sizeof(name), "fence %u", i);
+        double radius = size(random);
+        if (i % 2 == 0)
+        {
+            fences.addCircle(i, name, centreLatitude, centreLongitude, lround(radius));
+            continue;
+        }
+
+        // Star-shaped polygon around the centre.
+        Geofence::vertex_t vertices[24];
+        uint16_t n = 6 + random() % 19;
+        for (uint16_t k = 0; k < n; k++)
+        {
+            double angle = 2 * M_PI * k / n, r = radius * (0.5 + 0.5 * unit(random));
+            vertices[k].latitudeE7 = centreLatitude + lround(r * cos(angle) / 111194.93 * 1e7);
+            vertices[k].longitudeE7 = centreLongitude + lround(r * sin(angle) / (111194.93 * cos(centreLatitude / 1e7 * M_PI / 180)) * 1e7);
+        }
+        fences.addPolygon(i, name, vertices, n);
+    }
+    fences.begin();
+}
+
+/**
+ * @brief The same enter and exit rules as Geofence, with every fence tested on every fix.
+ *
+ */
+class LinearGeofence
+{
+    public:
+        LinearGeofence(const Geofence &fences, const Geofence::config_t &config) : fences(fences), config(config),
+            inside(fences.count(), false), count(fences.count(), 0) {}
+
+        size_t update(int32_t latitudeE7, int32_t longitudeE7, std::vector<Geofence::event_t> &events)
+        {
+            events.clear();
+            for (uint16_t i = 0; i < fences.count(); i++)
+            {
+                float d = fences.distance(i, latitudeE7, longitudeE7);
+                bool towards = inside[i] ? (d >= config.margin) : (d < 0);
+                count[i] = towards ? count[i] + 1 : 0;
+                if (count[i] >= config.confirm)
+                {
+                    inside[i] = !inside[i];
+                    count[i] = 0;
+                    events.push_back({ fences.id(i), i, (uint8_t)(inside[i] ? Geofence::EVENT_ENTER : Geofence::EVENT_EXIT), 0, latitudeE7, longitudeE7 });
+                }
+            }
+            return events.size();
+        }
+
+    private:
+        const Geofence &fences;
+        Geofence::config_t config;
+        std::vector<bool> inside;
+        std::vector<uint8_t> count;
+};
+
+/**
+ * @brief Replays the recorded track through Geofence with 16 to 256 fences. Prints the fences of
+ * the grid cell and the exact tests per fix, and checks the events against every fence tested on
+ * every fix. Then measures the time per fix against the linear scan, and the events of a fix
+ * jittering along the edge of a fence with and without the hysteresis.
+ *
+ * @param path      Path of the track file.
+ */
+void bench_geofence(const char *path)
+{
+    std::vector<TrackBuffer::record_t> track = load_track(path);
+    if (track.size() < 2)
+        return;
+
+    const Geofence::config_t config = { 20.0, 2 };
+    hostCreatePartition(ESP_PARTITION_TYPE_DATA, GEOFENCE_PARTITION_SUBTYPE, "fences", 0x20000);
+    std::unique_ptr<Geofence> fences(new Geofence(config));
+    fences->begin();
+
+    const uint16_t counts[] = { 16, 64, 256 };
+    for (uint16_t count : counts)
+    {
+        write_fences(*fences, track, count);
+        LinearGeofence linear(*fences, config);
+        Geofence::event_t events[GEOFENCE_TRACKED_MAX];
+        std::vector<Geofence::event_t> expected;
+        unsigned int mismatches = 0;
+
+        for (const TrackBuffer::record_t &record : track)
+        {
+            size_t n = fences->update(record_data(record), events, GEOFENCE_TRACKED_MAX);
+            linear.update(record.latitude, record.longitude, expected);
+
+            // The order of the events of a fix may differ.
+            mismatches += (n != expected.size());
+            for (size_t i = 0; i < n && n == expected.size(); i++)
+            {
+                bool found = false;
+                for (const Geofence::event_t &e : expected)
+                    found |= (e.index == events[i].index && e.type == events[i].type);
+                mismatches += !found;
+            }
+        }
+
+        const Geofence::stats_t &stats = fences->stats();
+        printf("geofence %3u fences, %4u cells: %5.2f candidates/fix (max %2u), %5.2f tests/fix, %3lu events, %u mismatches\n",
+               count, fences->gridCells(), (double)stats.candidates / stats.fixes, stats.maxCandidates,
+               (double)stats.tests / stats.fixes, (unsigned long)stats.events, mismatches);
+        if (mismatches > 0)
+            fprintf(stderr, "bench_geofence: %u events differ from the linear scan with %u fences\n", mismatches, count);
+    }
+    bench_record("geofence_tests_per_fix_256", (double)fences->stats().tests / fences->stats().fixes, "tests/fix");
+
+    Geofence::event_t events[GEOFENCE_TRACKED_MAX];
+    size_t i = 0;
+    bench_result("geofence_update_256", 100000, [&]() {
+        fences->update(record_data(track[i++ % track.size()]), events, GEOFENCE_TRACKED_MAX);
+    });
+
+    float sink = 0;
+    bench_result("geofence_linear_256", 10000, [&]() {
+        const TrackBuffer::record_t &record = track[i++ % track.size()];
+        for (uint16_t k = 0; k < fences->count(); k++)
+            sink += fences->distance(k, record.latitude, record.longitude) < 0;
+    });
+
+    // A parked tracker on the edge of a 100 m circle, with 8 m of jitter.
+    const int32_t latitude = track[0].latitude, longitude = track[0].longitude;
+    const Geofence::config_t configs[] = { { 0, 1 }, config };
+    std::mt19937 random(1);
+    std::normal_distribution<double> jitter(0, 8);
+    for (const Geofence::config_t &c : configs)
+    {
+        Geofence edge(c);
+        edge.begin();
+        edge.format();
+        edge.addCircle(1, "edge", latitude, longitude, 100);
+
+        unsigned int transitions = 0;
+        for (unsigned int k = 0; k < 1000; k++)
+        {
+            double north = 100 + jitter(random), east = jitter(random);
+            transitions += edge.update(latitude + lround(north / 111194.93 * 1e7),
+                                       longitude + lround(east / (111194.93 * cos(latitude / 1e7 * M_PI / 180)) * 1e7), k, events, 1);
+        }
+        printf("geofence edge jitter, margin %2.0f m, confirm %u: %4u events in 1000 fixes\n", c.margin, c.confirm, transitions);
+    }
+}
@@ -0,0 +1,228 @@
+#include "bench.h"
+
+// Noise allowed on top of the threshold, in multiples of the spreads of the two times.
+#define BENCH_SPREAD_FACTOR 2.0
+// Smallest slowdown of a time which is a regression: times of a few ns/op can change by that
+// much between two runs of the same code, e.g. with the alignment of the code and the data.
+#define BENCH_NOISE_NS 10.0
+
+static const char *corpusFiles[] = { "cgnssinfo.txt", "track.csv" };
+
+std::vector<bench_entry_t> bench_results;
+
+/**
+ * @brief Writes the results as a JSON array, one result per line.
+ * 
+ */
+static bool write_results(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "[\n");
+    for (size_t i = 0; i < bench_results.size(); i++)
+        fprintf(file, "{\"name\":\"%s\",\"value\":%.3f,\"unit\":\"%s\",\"spread\":%.1f}%s\n", bench_results[i].name.c_str(),
+                bench_results[i].value, bench_results[i].unit.c_str(), bench_results[i].spread,
+                (i + 1 < bench_results.size()) ? "," : "");
+    fprintf(file, "]\n");
+    return fclose(file) == 0;
+}
+
+/**
+ * @brief Reads a results file written by write_results(). The spread is 0 if the file has none.
+ * 
+ */
+static std::vector<bench_entry_t> read_results(const char *path)
+{
+    std::vector<bench_entry_t> results;
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return results;
+
+    char line[256], name[128], unit[32];
+    double value, spread;
+    while (fgets(line, sizeof(line), file))
+        if (sscanf(line, "{\"name\":\"%127[^\"]\",\"value\":%lf,\"unit\":\"%31[^\"]\"", name, &value, unit) == 3)
+        {
+            const char *field = strstr(line, "\"spread\":");
+            if (!field || sscanf(field, "\"spread\":%lf", &spread) != 1)
+                spread = 0;
+            results.push_back({ name, value, unit, spread });
+        }
+
+    fclose(file);
+    return results;
+}
+
+/**
+ * @brief Prints the change of every result from the baseline.
+ * 
+ * A time is a regression if it is more than threshold percent above the baseline, plus
+ * BENCH_SPREAD_FACTOR times the spreads of both times, and at least BENCH_NOISE_NS slower, so that
+ * two runs of the same code pass. The
+ * other results are exact for the same corpus and seed, and a result of the baseline missing from
+ * the current run is a regression too.
+ * 
+ * @param baseline         Results of the previous run.
+ * @param threshold        Percentage above the baseline from which a time is a regression.
+ * @return unsigned int     Number of regressions.
+ */
+static unsigned int compare_results(const std::vector<bench_entry_t> &baseline, double threshold)
+{
+    unsigned int regressions = 0;
+
+    printf("\n%-32s %12s %12s %8s\n", "benchmark", "baseline", "current", "change");
+    for (const bench_entry_t &current : bench_results)
+    {
+        const bench_entry_t *base = NULL;
+        for (const bench_entry_t &entry : baseline)
+            if (entry.name == current.name && entry.unit == current.unit)
+                base = &entry;
+
+        if (!base)
+        {
+            printf("%-32s %12s %12.1f %8s\n", current.name.c_str(), "-", current.value, "new");
+            continue;
+        }
+
+        double change = (base->value != 0) ? 100.0 * (current.value - base->value) / base->value : 0;
+        bool regression;
+        if (current.unit == "ns/op")
+            regression = change > threshold + BENCH_SPREAD_FACTOR * (base->spread + current.spread) &&
+                         current.value - base->value > BENCH_NOISE_NS;
+        else
+            regression = change > 0.1;
+        regressions += regression;
+        printf("%-32s %12.1f %12.1f %+7.1f%% %s%s\n", current.name.c_str(), base->value, current.value, change,
+               current.unit.c_str(), regression ? "  REGRESSION" : "");
+    }
+
+    for (const bench_entry_t &base : baseline)
+    {
+        bool found = false;
+        for (const bench_entry_t &current : bench_results)
+            found |= (current.name == base.name && current.unit == base.unit);
+
+        if (!found)
+        {
+            printf("%-32s %12.1f %12s %8s %s  MISSING\n", base.name.c_str(), base.value, "-", "", base.unit.c_str());
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+/**
+ * @brief Checks that every file of the corpus can be read from the directory.
+ * 
+ */
+static bool corpus_complete(const std::string &dir)
+{
+    for (const char *name : corpusFiles)
+    {
+        FILE *file = fopen((dir + "/" + name).c_str(), "r");
+        if (!file)
+            return false;
+        fclose(file);
+    }
+    return true;
+}
+
+/**
+ * @brief Finds the corpus when no directory is given: in the source tree of the program, which
+ * PlatformIO builds to .pio/build/bench/program, or else in the working directory.
+ * 
+ * @param program          Path of the program, argv[0].
+ * @return std::string     Corpus directory. Empty if it is found in neither.
+ */
+static std::string find_corpus(const char *program)
+{
+    std::string dir(program);
+    size_t slash = dir.rfind('/');
+    dir = (slash == std::string::npos) ? "." : dir.substr(0, slash);
+
+    const std::string candidates[] = { dir + "/../../../host/bench/corpus", "host/bench/corpus" };
+    for (const std::string &candidate : candidates)
+        if (corpus_complete(candidate))
+            return candidate;
+    return "";
+}
+
+/**
+ * Host benchmarks of the tracker (env:bench).
+ * 
+ * Usage: program [-o results.json] [-b baseline.json] [-t threshold %] [corpus directory]
+ * 
+ * Without a corpus directory, the corpus of the source tree is used (see find_corpus). Exits with
+ * 2 if a file of the corpus is missing. With -b, exits with 1 if a time is more than threshold
+ * percent (default 20) above the baseline, plus its noise, if any other result (bytes, virtual
+ * ms, points/km) is higher, or if a result of the baseline is missing, so a results file of the
+ * previous commit can gate a change. Every time is the median of BENCH_REPEATS rounds.
+ */
+int main(int argc, char **argv)
+{
+    std::string corpusDir;
+    const char *output = NULL, *baselinePath = NULL;
+    double threshold = 20.0;
+    char path[256];
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else
+            corpusDir = argv[i];
+    }
+
+    if (corpusDir.empty())
+        corpusDir = find_corpus(argv[0]);
+    if (corpusDir.empty() || !corpus_complete(corpusDir))
+    {
+        fprintf(stderr, "Corpus %s not found: give the directory of cgnssinfo.txt and track.csv\n",
+                corpusDir.empty() ? "host/bench/corpus" : corpusDir.c_str());
+        return 2;
+    }
+
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    snprintf(path, sizeof(path), "%s/cgnssinfo.txt", corpusDir.c_str());
+    bench_parser(path);
+    bench_conversion();
+
+    bench_track_buffer();
+
+    snprintf(path, sizeof(path), "%s/track.csv", corpusDir.c_str());
+    bench_payload(path);
+    bench_scheduler(path);
+    bench_deadband(path);
+    bench_geofence(path);
+    bench_publish_cycle(path);
+    bench_publish_window(path);
+    bench_baud_rate();
+
+    if (output && !write_results(output))
+    {
+        fprintf(stderr, "Could not write %s\n", output);
+        return 2;
+    }
+
+    if (baselinePath)
+    {
+        std::vector<bench_entry_t> baseline = read_results(baselinePath);
+        if (baseline.empty())
+        {
+            fprintf(stderr, "Baseline %s is empty or missing\n", baselinePath);
+            return 2;
+        }
+        if (compare_results(baseline, threshold) > 0)
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "bench.h"
+#include "SIM7600.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Benchmarks GPS::parse on every response of the corpus, including the malformed ones.
+ * 
+ * @param corpus    Path of the corpus file.
+ */
+void bench_parser(const char *corpus)
+{
+    std::ifstream file(corpus);
+    std::vector<std::string> lines;
+    std::string line;
+
+    while (std::getline(file, line))
+        if (!line.empty() && line[0] != '#')
+            lines.push_back(line);
+
+    if (lines.empty())
+    {
+        fprintf(stderr, "bench_parser: corpus %s is empty or missing\n", corpus);
+        return;
+    }
+
+    NullStream stream;
+    GPS gps(stream);
+    unsigned int valid = 0;
+
+    for (const std::string &response : lines)
+        valid += gps.parse(response.data(), response.size(), response.compare(0, 10, "+CGPSINFO:") != 0);
+
+    printf("parser corpus: %zu responses, %u valid fixes\n", lines.size(), valid);
+
+    const unsigned int iterations = 200000;
+    size_t index = 0;
+
+    bench_result("gps_parse_corpus", iterations, [&]()
+    {
+        const std::string &response = lines[index++ % lines.size()];
+        gps.parse(response.data(), response.size(), response.compare(0, 10, "+CGPSINFO:") != 0);
+    });
+
+    const std::string &fix = lines[0];
+    bench_result("gps_parse_cgnssinfo", iterations, [&]()
+    {
+        gps.parse(fix.data(), fix.size(), true);
+    });
+}
@@ -0,0 +1,137 @@
+#include "bench.h"
+#include "ModemSimulator.h"
+#include "MQTTConnection.h"
+#include "Payload.h"
+#include "PublishWindow.h"
+
+/**
+ * @brief Publishes messages from a queue through the window, as drainTrack() does with the track
+ * buffer: new messages are sent while the window has room, the acknowledged ones are removed
+ * from the queue, and after a failure the messages in flight are sent again.
+ *
+ * @return unsigned int Messages sent more than once.
+ */
+static unsigned int drain_window(PublishWindow &window, const std::vector<std::string> &messages)
+{
+    size_t acked = 0, sent = 0;
+    unsigned int resent = 0;
+
+    while (acked < messages.size())
+    {
+        // Messages in flight are the ones after the acknowledged ones.
+        size_t next = acked + window.countInFlight();
+        while (window.canSend() && next < messages.size())
+        {
+            if (!window.send("sim7600/pub", messages[next].data(), messages[next].size(), 1, millis()))
+                break;
+            resent += (next < sent);
+            sent = std::max(sent, ++next);
+        }
+
+        bool ok;
+        acked += window.wait(60000, ok);
+    }
+    return resent;
+}
+
+/**
+ * @brief Connects a simulated modem in which the broker acknowledges a publish after rtt ms.
+ *
+ */
+static bool connect_modem(ModemSimulator &modem, uint32_t rtt)
+{
+    modem.loadDefaultScript();
+    modem.respond("AT+CMQTTPUB", { { 0, "OK" }, { rtt, "+CMQTTPUB: 0,0" } });
+
+    SSL ssl(modem);
+    MQTT mqtt(modem);
+    MQTTConnection link(ssl, mqtt, { "tcp://simulated-endpoint", 8883, "Amazon-Root-Certificate-Filename",
+                                     "Thing-Certificate-Filename", "Private-Key-Filename", 1000, 60000, 2 });
+    SIM7600::invalidateState();
+    return mqtt.echoOFF() && link.attempt();
+}
+
+/**
+ * @brief Throughput of the publishes of the track fixes at a few round trip times to the broker:
+ * the blocking publish (AT+CMQTTPUB waiting for its completion, QoS 0) against the window
+ * with QoS 1 and 1 or 4 messages in flight. Then a window with an injected publish error, to
+ * check that every message is delivered. Times are on the virtual clock of the simulator.
+ *
+ * @param path      Path of the track file, for the payloads.
+ */
+void bench_publish_window(const char *path)
+{
+    std::vector<TrackBuffer::record_t> track = load_track(path);
+    if (track.empty())
+        return;
+
+    const size_t count = 100;
+    std::vector<std::string> messages;
+    char buffer[256];
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t length = Payload::formatJSON(buffer, sizeof(buffer), track[i % track.size()]);
+        messages.push_back(std::string(buffer, length));
+    }
+
+    hostUseVirtualClock(true);
+    ModemSimulator::profile_t profile;
+    profile.latency = 30;
+    profile.jitter = 10;
+
+    const uint32_t rtts[] = { 100, 300, 600 };
+    for (uint32_t rtt : rtts)
+    {
+        double rates[3];
+        for (uint8_t mode = 0; mode < 3; mode++)
+        {
+            ModemSimulator modem(profile);
+            MQTT mqtt(modem);
+            if (!connect_modem(modem, rtt))
+            {
+                fprintf(stderr, "bench_publish_window: simulated modem did not connect\n");
+                hostUseVirtualClock(false);
+                return;
+            }
+
+            uint32_t start = millis();
+            if (mode == 0)
+            {
+                for (const std::string &message : messages)
+                    if (!mqtt.setPublishTopicPayload("sim7600/pub", message.data(), message.size()) || !mqtt.publish())
+                        fprintf(stderr, "bench_publish_window: blocking publish failed\n");
+            }
+            else
+            {
+                PublishWindow window(mqtt, { (uint8_t)(mode == 1 ? 1 : 4), 1, 60 });
+                drain_window(window, messages);
+            }
+            rates[mode] = count * 1000.0 / (millis() - start);
+
+            const char *names[] = { "blocking", "window1", "window4" };
+            snprintf(buffer, sizeof(buffer), "publish_%s_rtt%lu", names[mode], (unsigned long)rtt);
+            bench_record(buffer, 1000.0 / rates[mode], "ms/msg");
+        }
+        printf("publish rtt %3lu ms: blocking QoS 0 %5.1f msg/s, QoS 1 window 1 %5.1f msg/s, window 4 %5.1f msg/s (x%.1f)\n",
+               (unsigned long)rtt, rates[0], rates[1], rates[2], rates[2] / rates[0]);
+    }
+
+    // The 10th publish fails: it and the messages in flight after it are sent again.
+    ModemSimulator modem(profile);
+    MQTT mqtt(modem);
+    connect_modem(modem, 300);
+    // The rule added last is used first.
+    modem.respond("AT+CMQTTPUB", { { 0, "OK" }, { 300, "+CMQTTPUB: 0,11" } }, 1);
+    modem.respond("AT+CMQTTPUB", { { 0, "OK" }, { 300, "+CMQTTPUB: 0,0" } }, 9);
+
+    PublishWindow window(mqtt, { 4, 1, 60 });
+    unsigned int resent = drain_window(window, messages);
+    const PublishWindow::stats_t &stats = window.stats();
+    printf("publish window 4 with an error: %lu sent, %lu acked, %lu failed, %lu requeued, %u sent again, ack p50 %lu ms\n",
+           (unsigned long)stats.sent, (unsigned long)stats.acked, (unsigned long)stats.failed, (unsigned long)stats.requeued,
+           resent, (unsigned long)window.ackLatency().percentile(0.5));
+    if (stats.acked != count)
+        fprintf(stderr, "bench_publish_window: %lu of %zu messages acknowledged\n", (unsigned long)stats.acked, count);
+
+    hostUseVirtualClock(false);
+}
@@ -0,0 +1,75 @@
+#include "bench.h"
+#include "ReportScheduler.h"
+
+#include <vector>
+
+double track_distance(const TrackBuffer::record_t &a, const TrackBuffer::record_t &b)
+{
+    const double R = 6371000.0;
+    double lat1 = a.latitude / 1e7 * M_PI / 180, lat2 = b.latitude / 1e7 * M_PI / 180;
+    double dLat = lat2 - lat1, dLon = (b.longitude - a.longitude) / 1e7 * M_PI / 180;
+    double h = sin(dLat / 2) * sin(dLat / 2) + cos(lat1) * cos(lat2) * sin(dLon / 2) * sin(dLon / 2);
+    return 2 * R * asin(sqrt(h));
+}
+
+/**
+ * @brief Fix of the GPS Modem with the values of the record.
+ * 
+ */
+GPS::data_t record_data(const TrackBuffer::record_t &record)
+{
+    GPS::data_t data = {};
+    data.latitudeE7 = record.latitude;
+    data.longitudeE7 = record.longitude;
+    data.speedCms = lround(record.speed / 3.6);
+    data.courseCd = record.course;
+    data.timestamp = record.timestamp;
+    data.valid = GPS::VALID_POSITION | GPS::VALID_DATETIME | GPS::VALID_SPEED | GPS::VALID_COURSE;
+    return data;
+}
+
+/**
+ * @brief Replays a recorded track through ReportScheduler and compares it with a report every
+ * 5 s: points per km, polls and JSON bytes published.
+ * 
+ * @param path      Path of the track file.
+ */
+void bench_scheduler(const char *path)
+{
+    std::vector<TrackBuffer::record_t> track = load_track(path);
+    if (track.size() < 2)
+        return;
+
+    ReportScheduler::config_t config = { 2000, 300000, 30000, 100.0, 20.0, 3.0 };
+    ReportScheduler scheduler(config);
+
+    double km = 0;
+    for (size_t i = 1; i < track.size(); i++)
+        km += track_distance(track[i - 1], track[i]) / 1000.0;
+
+    uint32_t nextPoll = 0;
+    for (const TrackBuffer::record_t &record : track)
+    {
+        uint32_t now = (record.timestamp - track[0].timestamp) * 1000;
+        if (now < nextPoll)
+            continue;
+
+        GPS::data_t data = record_data(record);
+        if (scheduler.update(data, now))
+            scheduler.commit(data, now);
+        nextPoll = now + scheduler.nextPoll();
+    }
+
+    const ReportScheduler::stats_t &stats = scheduler.stats();
+    const double jsonBytes = 123.0;
+
+    printf("scheduler track: %zu fixes over %.1f km and %.0f min\n", track.size(), km, (track.back().timestamp - track[0].timestamp) / 60.0);
+    printf("scheduler fixed_5s:   %5zu reports, %6.1f points/km, %7.0f bytes\n", track.size(), track.size() / km, track.size() * jsonBytes);
+    printf("scheduler adaptive:   %5u reports, %6.1f points/km, %7.0f bytes (%.0f%% saved), %u polls\n", stats.reports,
+           stats.reports / km, stats.reports * jsonBytes, 100.0 * (1.0 - (double)stats.reports / track.size()), stats.polls);
+    printf("scheduler reasons: first %u, distance %u, heading %u, start/stop %u, max interval %u\n",
+           stats.reasons[ReportScheduler::REASON_FIRST], stats.reasons[ReportScheduler::REASON_DISTANCE],
+           stats.reasons[ReportScheduler::REASON_HEADING], stats.reasons[ReportScheduler::REASON_START_STOP],
+           stats.reasons[ReportScheduler::REASON_MAX_INTERVAL]);
+    bench_record("scheduler_adaptive_density", stats.reports / km, "points/km");
+}
@@ -0,0 +1,69 @@
+#include "bench.h"
+#include "TrackBuffer.h"
+
+/**
+ * @brief Benchmarks append and drain of TrackBuffer on the emulated flash partition, and
+ * checks the recovery of the ring after a long outage and a reboot.
+ * 
+ */
+void bench_track_buffer()
+{
+    const uint32_t size = 64 * 1024;
+
+    GPS::data_t data = {};
+    data.latitudeE7 = 312223881;
+    data.longitudeE7 = 1213539011;
+    data.speedCms = 1181;
+    data.courseCd = 18740;
+    data.timestamp = 1700000000;
+
+    TrackBuffer track;
+    host_flash_stats_t before = hostFlashStats();
+    const unsigned int appends = 100000;
+
+    auto append = [&]()
+    {
+        data.timestamp++;
+        TrackBuffer::record_t record = TrackBuffer::makeRecord(data, 7.4);
+        track.append(record);
+    };
+    // Every round starts from an erased partition, so the flash counters are the same for every round.
+    auto erase = [&]()
+    {
+        hostCreatePartition(ESP_PARTITION_TYPE_DATA, TRACK_PARTITION_SUBTYPE, "track", size);
+        track.begin();
+    };
+    bench_result("track_append", appends, append, BENCH_REPEATS, erase);
+
+    host_flash_stats_t &after = hostFlashStats();
+    const double appended = (double)appends * BENCH_REPEATS;
+    printf("track_append flash: %.3f writes/record, %.1f bytes/record, %.5f erases/record, %u dropped (ring of %u)\n",
+           (after.writes - before.writes) / appended, (after.bytesWritten - before.bytesWritten) / appended,
+           (after.erases - before.erases) / appended, track.stats().dropped / BENCH_REPEATS, track.capacity());
+
+    // Reboot with a full ring: the pointers and the sequence number are recovered from flash.
+    TrackBuffer rebooted;
+    rebooted.begin();
+
+    TrackBuffer::record_t record;
+    rebooted.peek(record);
+    printf("track_reboot: %u pending, oldest sequence %u, RAM %zu bytes\n", rebooted.pending(), record.sequence, sizeof(TrackBuffer));
+
+    // Every round drains the same full ring, written again and recovered by a reboot before the round.
+    unsigned int drains = rebooted.pending();
+    bench_result("track_drain", drains, [&]()
+    {
+        rebooted.peek(record);
+        rebooted.pop();
+    }, BENCH_REPEATS, [&]()
+    {
+        erase();
+        for (unsigned int i = 0; i < appends; i++)
+            append();
+        rebooted.begin();
+    });
+
+    TrackBuffer drained;
+    drained.begin();
+    printf("track_reboot_after_drain: %u pending\n", drained.pending());
+}
@@ -0,0 +1,86 @@
+#include "esp_partition.h"
+
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+typedef struct
+{
+    esp_partition_t partition;
+    std::vector<uint8_t> flash;
+}host_partition_t;
+
+static std::map<std::string, host_partition_t> partitions;
+static host_flash_stats_t stats;
+
+static host_partition_t *find(const esp_partition_t *partition)
+{
+    auto it = partitions.find(partition->label);
+    return (it == partitions.end()) ? NULL : &it->second;
+}
+
+void hostCreatePartition(esp_partition_type_t type, uint8_t subtype, const char *label, uint32_t size)
+{
+    host_partition_t &p = partitions[label];
+    p.partition.type = type;
+    p.partition.subtype = (esp_partition_subtype_t)subtype;
+    p.partition.address = 0;
+    p.partition.size = size;
+    p.partition.encrypted = false;
+    strncpy(p.partition.label, label, sizeof(p.partition.label) - 1);
+    p.partition.label[sizeof(p.partition.label) - 1] = '\0';
+    p.flash.assign(size, 0xFF);
+}
+
+host_flash_stats_t &hostFlashStats()
+{
+    return stats;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    for (auto &it : partitions)
+    {
+        const esp_partition_t &p = it.second.partition;
+        if (p.type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || p.subtype == subtype) &&
+            (label == NULL || strcmp(p.label, label) == 0))
+            return &p;
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    host_partition_t *p = find(partition);
+    if (p == NULL || src_offset + size > p->flash.size())
+        return ESP_ERR_INVALID_ARG;
+
+    stats.reads++;
+    memcpy(dst, &p->flash[src_offset], size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    host_partition_t *p = find(partition);
+    if (p == NULL || dst_offset + size > p->flash.size())
+        return ESP_ERR_INVALID_ARG;
+
+    stats.writes++;
+    stats.bytesWritten += size;
+    for (size_t i = 0; i < size; i++)
+        p->flash[dst_offset + i] &= ((const uint8_t *)src)[i];
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    host_partition_t *p = find(partition);
+    if (p == NULL || offset % 4096 != 0 || size % 4096 != 0 || offset + size > p->flash.size())
+        return ESP_ERR_INVALID_ARG;
+
+    stats.erases += size / 4096;
+    memset(&p->flash[offset], 0xFF, size);
+    return ESP_OK;
+}
@@ -0,0 +1,55 @@
+#ifndef HOST_ESP_PARTITION_H
+#define HOST_ESP_PARTITION_H
+
+/**
+ * RAM emulation of the ESP-IDF partition API for the host build. Like NOR flash, a write can
+ * only clear bits and an erase sets a whole sector to 0xFF. Operations are counted.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+
+typedef enum
+{
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01
+}esp_partition_type_t;
+
+typedef enum
+{
+    ESP_PARTITION_SUBTYPE_ANY = 0xff
+}esp_partition_subtype_t;
+
+typedef struct
+{
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+    bool encrypted;
+}esp_partition_t;
+
+typedef struct
+{
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long bytesWritten;
+    unsigned long erases;
+}host_flash_stats_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+// Creates (or resets to erased) an emulated partition.
+void hostCreatePartition(esp_partition_type_t type, uint8_t subtype, const char *label, uint32_t size);
+host_flash_stats_t &hostFlashStats();
+
+#endif
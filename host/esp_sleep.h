@@ -0,0 +1,12 @@
+#ifndef HOST_ESP_SLEEP_H
+#define HOST_ESP_SLEEP_H
+
+#include "Arduino.h"
+
+/**
+ * Sleep wakeup sources of ESP-IDF for the host build. There is no sleep on the host.
+ */
+
+inline esp_err_t esp_sleep_enable_gpio_wakeup() { return ESP_OK; }
+
+#endif
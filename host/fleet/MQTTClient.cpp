@@ -0,0 +1,305 @@
+#include "MQTTClient.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+enum
+{
+    PACKET_CONNECT      = 0x10,
+    PACKET_CONNACK      = 0x20,
+    PACKET_PUBLISH      = 0x30,
+    PACKET_PUBACK       = 0x40,
+    PACKET_SUBSCRIBE    = 0x82,
+    PACKET_SUBACK       = 0x90,
+    PACKET_PINGREQ      = 0xC0,
+    PACKET_PINGRESP     = 0xD0,
+    PACKET_DISCONNECT   = 0xE0
+};
+
+MQTTClient::~MQTTClient()
+{
+    close();
+}
+
+/**
+ * @brief Starts the TCP connection and queues the CONNECT packet (clean session).
+ * 
+ * @param address       IPv4 address of the broker, in network byte order.
+ * @param port          Port of the broker.
+ * @param clientId      Client identifier.
+ * @param keepalive     Keep alive interval in s, or 0 to disable it.
+ * @return true         If the connection is in progress.
+ */
+bool MQTTClient::connect(uint32_t address, uint16_t port, const std::string &clientId, uint16_t keepalive)
+{
+    close();
+
+    socketFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (socketFd < 0)
+        return false;
+
+    int one = 1;
+    setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in broker = {};
+    broker.sin_family = AF_INET;
+    broker.sin_addr.s_addr = address;
+    broker.sin_port = htons(port);
+    if (::connect(socketFd, (sockaddr *)&broker, sizeof(broker)) < 0 && errno != EINPROGRESS)
+    {
+        close();
+        return false;
+    }
+
+    this->clientId = clientId;
+    this->keepalive = keepalive;
+    current = STATE_CONNECTING;
+
+    std::string body("\x00\x04MQTT\x04\x02", 8);
+    body += (char)(keepalive >> 8);
+    body += (char)(keepalive & 0xFF);
+    appendString(body, clientId.data(), clientId.size());
+    queuePacket(PACKET_CONNECT, body);
+    return true;
+}
+
+/**
+ * @brief Queues a PUBLISH packet.
+ * 
+ * @param qos       0 or 1.
+ * @return uint16_t Packet identifier (acknowledged by onPuback) for QoS 1, 0 for QoS 0.
+ */
+uint16_t MQTTClient::publish(const char *topic, const char *payload, size_t length, uint8_t qos)
+{
+    std::string body;
+    uint16_t id = 0;
+
+    appendString(body, topic, strlen(topic));
+    if (qos > 0)
+    {
+        id = nextId;
+        nextId = (nextId == UINT16_MAX) ? 1 : nextId + 1;
+        body += (char)(id >> 8);
+        body += (char)(id & 0xFF);
+    }
+    body.append(payload, length);
+
+    queuePacket(PACKET_PUBLISH | (qos > 0 ? 0x02 : 0), body);
+    return id;
+}
+
+bool MQTTClient::subscribe(const char *filter, uint8_t qos)
+{
+    std::string body;
+    uint16_t id = nextId++;
+
+    body += (char)(id >> 8);
+    body += (char)(id & 0xFF);
+    appendString(body, filter, strlen(filter));
+    body += (char)qos;
+
+    queuePacket(PACKET_SUBSCRIBE, body);
+    return true;
+}
+
+void MQTTClient::ping()
+{
+    queuePacket(PACKET_PINGREQ, std::string());
+}
+
+void MQTTClient::disconnect()
+{
+    queuePacket(PACKET_DISCONNECT, std::string());
+}
+
+void MQTTClient::close()
+{
+    if (socketFd >= 0)
+        ::close(socketFd);
+    socketFd = -1;
+    current = STATE_CLOSED;
+    output.clear();
+    written = 0;
+    input.clear();
+}
+
+/**
+ * @brief Reads what the broker sent and handles the complete packets.
+ * 
+ * @return false    If the connection is closed or the broker sent an invalid packet.
+ */
+bool MQTTClient::onReadable()
+{
+    char buffer[16384];
+
+    while (true)
+    {
+        ssize_t received = recv(socketFd, buffer, sizeof(buffer), 0);
+        if (received > 0)
+        {
+            input.append(buffer, received);
+            continue;
+        }
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            close();
+            return false;
+        }
+        if (errno != EINTR)
+            break;
+    }
+
+    size_t offset = 0;
+    while (input.size() - offset >= 2)
+    {
+        // Remaining length: up to 4 bytes, 7 bits each.
+        size_t length = 0, position = offset + 1;
+        uint8_t shift = 0, byte = 0x80;     // Incomplete until a last byte is read.
+        do
+        {
+            if (position >= input.size())
+                break;
+            byte = input[position++];
+            length |= (size_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while ((byte & 0x80) && shift < 28);
+
+        if ((byte & 0x80) || input.size() - position < length)
+            break;
+
+        if (!handlePacket(input[offset], (const uint8_t *)input.data() + position, length))
+        {
+            close();
+            return false;
+        }
+        offset = position + length;
+    }
+    input.erase(0, offset);
+    return true;
+}
+
+/**
+ * @brief Completes the TCP connection and writes the queued packets, as far as the socket takes them.
+ * 
+ * @return false    If the connection failed.
+ */
+bool MQTTClient::onWritable()
+{
+    if (current == STATE_CONNECTING)
+    {
+        int error = 0;
+        socklen_t size = sizeof(error);
+        if (getsockopt(socketFd, SOL_SOCKET, SO_ERROR, &error, &size) < 0 || error != 0)
+        {
+            close();
+            return false;
+        }
+        current = STATE_WAIT_CONNACK;
+    }
+
+    while (written < output.size())
+    {
+        ssize_t sent = send(socketFd, output.data() + written, output.size() - written, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                stallCount++;
+                break;
+            }
+            close();
+            return false;
+        }
+        written += sent;
+    }
+
+    if (written == output.size())
+    {
+        output.clear();
+        written = 0;
+    }
+    else if (written > 65536)
+    {
+        output.erase(0, written);
+        written = 0;
+    }
+    return true;
+}
+
+void MQTTClient::queuePacket(uint8_t header, const std::string &body)
+{
+    output += (char)header;
+
+    size_t length = body.size();
+    do
+    {
+        uint8_t byte = length & 0x7F;
+        length >>= 7;
+        output += (char)(byte | (length > 0 ? 0x80 : 0));
+    } while (length > 0);
+
+    output += body;
+}
+
+void MQTTClient::appendString(std::string &body, const char *text, size_t length)
+{
+    body += (char)(length >> 8);
+    body += (char)(length & 0xFF);
+    body.append(text, length);
+}
+
+bool MQTTClient::handlePacket(uint8_t header, const uint8_t *body, size_t length)
+{
+    switch (header & 0xF0)
+    {
+        case PACKET_CONNACK:
+            if (length < 2)
+                return false;
+            if (body[1] == 0)
+                current = STATE_CONNECTED;
+            if (onConnack)
+                onConnack(*this, body[1]);
+            return body[1] == 0;
+
+        case PACKET_PUBACK:
+            if (length < 2)
+                return false;
+            if (onPuback)
+                onPuback(*this, (uint16_t)(body[0] << 8 | body[1]));
+            return true;
+
+        case PACKET_PUBLISH:
+        {
+            if (length < 2)
+                return false;
+            size_t topicLength = body[0] << 8 | body[1];
+            size_t start = 2 + topicLength + (((header >> 1) & 3) ? 2 : 0);
+            if (start > length)
+                return false;
+
+            // QoS 1 deliveries are acknowledged, as a real subscriber does.
+            if ((header >> 1) & 3)
+            {
+                std::string ack((const char *)body + 2 + topicLength, 2);
+                queuePacket(PACKET_PUBACK, ack);
+            }
+            if (onMessage)
+                onMessage(*this, (const char *)body + 2, topicLength, (const char *)body + start, length - start);
+            return true;
+        }
+
+        case PACKET_SUBACK & 0xF0:
+        case PACKET_PINGRESP:
+            return true;
+
+        default:
+            return false;
+    }
+}
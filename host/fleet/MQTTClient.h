@@ -0,0 +1,67 @@
+#ifndef FLEET_MQTT_CLIENT_H
+#define FLEET_MQTT_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+/**
+ * Minimal non-blocking MQTT 3.1.1 client over TCP for the fleet load simulator (env:fleet).
+ * 
+ * Only what a tracker and the measuring subscriber need: CONNECT with a clean session, PUBLISH
+ * with QoS 0 or 1, SUBSCRIBE, PINGREQ and DISCONNECT. The packets are queued in an output buffer
+ * and written when the socket is writable, so a slow broker shows as queued bytes instead of
+ * blocking the event loop. The owner polls the socket and calls onReadable() and onWritable().
+ */
+class MQTTClient
+{
+    public:
+        typedef enum
+        {
+            STATE_IDLE = 0,
+            STATE_CONNECTING,       // TCP connect in progress.
+            STATE_WAIT_CONNACK,
+            STATE_CONNECTED,
+            STATE_CLOSED
+        }state_t;
+
+        std::function<void(MQTTClient &client, uint8_t code)> onConnack;
+        std::function<void(MQTTClient &client, uint16_t id)> onPuback;
+        std::function<void(MQTTClient &client, const char *topic, size_t topicLength, const char *payload, size_t length)> onMessage;
+
+        ~MQTTClient();
+
+        bool connect(uint32_t address, uint16_t port, const std::string &clientId, uint16_t keepalive);
+        uint16_t publish(const char *topic, const char *payload, size_t length, uint8_t qos);
+        bool subscribe(const char *filter, uint8_t qos);
+        void ping();
+        void disconnect();
+
+        bool onReadable();
+        bool onWritable();
+        void close();
+
+        int fd() const { return socketFd; }
+        state_t state() const { return current; }
+        size_t queued() const { return output.size() - written; }
+        bool wantsWrite() const { return current == STATE_CONNECTING || queued() > 0; }
+        uint32_t stalls() const { return stallCount; }
+
+    private:
+        void queuePacket(uint8_t header, const std::string &body);
+        static void appendString(std::string &body, const char *text, size_t length);
+        bool handlePacket(uint8_t header, const uint8_t *body, size_t length);
+
+        int socketFd = -1;
+        state_t current = STATE_IDLE;
+        std::string clientId;
+        uint16_t keepalive = 0;
+        uint16_t nextId = 1;
+        std::string output;
+        size_t written = 0;         // Bytes of output already sent.
+        std::string input;
+        uint32_t stallCount = 0;    // Writes which did not send the whole output (socket buffer full).
+};
+
+#endif
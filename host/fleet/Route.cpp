@@ -0,0 +1,127 @@
+#include "Route.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <fstream>
+#include <string>
+
+/**
+ * @brief Synthetic drive from a start point.
+ * 
+ * @param seed          Seed of the random legs and turns.
+ * @param latitude      Start point, degrees x 1e7.
+ * @param longitude     Start point, degrees x 1e7.
+ * @param timestamp     Unix time of the first fix.
+ */
+Route::Route(uint32_t seed, int32_t latitude, int32_t longitude, int32_t timestamp)
+    : random(seed), latitude(latitude / 1e7), longitude(longitude / 1e7), timestamp(timestamp)
+{
+    course = std::uniform_real_distribution<double>(0, 360)(random);
+}
+
+/**
+ * @brief Replay of a recorded track, which wraps around at its end.
+ * 
+ * @param track         Recorded fixes. Must stay valid while the route is used.
+ * @param start         Index of the first fix.
+ * @param offset        Degrees x 1e7 added to the latitude and longitude.
+ * @param timestamp     Unix time of the first fix.
+ */
+Route::Route(const std::vector<TrackBuffer::record_t> &track, size_t start, int32_t offset, int32_t timestamp)
+    : track(&track), index(start), offset(offset), timestamp(timestamp)
+{
+}
+
+/**
+ * @brief Next fix, interval ms after the previous one. The sequence number increases by one.
+ * 
+ */
+TrackBuffer::record_t Route::next(uint32_t interval)
+{
+    TrackBuffer::record_t record = {};
+
+    if (track && !track->empty())
+    {
+        const TrackBuffer::record_t &fix = (*track)[index++ % track->size()];
+        record.latitude = fix.latitude + offset;
+        record.longitude = fix.longitude + offset;
+        record.speed = fix.speed;
+        record.course = fix.course;
+    }
+    else
+    {
+        drive(interval);
+        record.latitude = lround(latitude * 1e7);
+        record.longitude = lround(longitude * 1e7);
+        record.speed = lround(speed * 100);
+        record.course = lround(course * 100) % 36000;
+    }
+
+    // About 0.1 V per hour.
+    elapsed += interval;
+    record.battery = battery - elapsed / 36000;
+    record.sequence = sequence++;
+    record.timestamp = timestamp;
+    timestamp += (interval + 500) / 1000;
+    return record;
+}
+
+/**
+ * @brief Moves along the course at the speed of the current leg. Legs are parked (20 %), city
+ * (60 %) or highway (20 %) and last 1 to 5 minutes.
+ * 
+ */
+void Route::drive(uint32_t interval)
+{
+    if (legLeft <= interval)
+    {
+        double leg = std::uniform_real_distribution<double>(0, 1)(random);
+        speed = (leg < 0.2) ? 0 : (leg < 0.8) ? std::uniform_real_distribution<double>(20, 50)(random)
+                                              : std::uniform_real_distribution<double>(70, 110)(random);
+        legLeft = std::uniform_int_distribution<uint32_t>(60000, 300000)(random);
+    }
+    legLeft -= interval;
+
+    if (speed > 0)
+    {
+        double turn = (speed < 60) ? 20 : 3;
+        course = fmod(course + std::uniform_real_distribution<double>(-turn, turn)(random) + 360, 360);
+
+        double metres = speed / 3.6 * interval / 1000;
+        latitude += metres * cos(course * M_PI / 180) / 111320;
+        longitude += metres * sin(course * M_PI / 180) / (111320 * cos(latitude * M_PI / 180));
+    }
+}
+
+/**
+ * @brief Loads a track (timestamp,latitude,longitude,speed,course,battery per line), as the
+ * corpus of the host benchmarks.
+ * 
+ */
+std::vector<TrackBuffer::record_t> Route::load(const char *path)
+{
+    std::vector<TrackBuffer::record_t> fixes;
+    std::ifstream file(path);
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        double latitude, longitude, speed, course, battery;
+        long time;
+
+        if (line.empty() || line[0] == '#')
+            continue;
+        if (sscanf(line.c_str(), "%ld,%lf,%lf,%lf,%lf,%lf", &time, &latitude, &longitude, &speed, &course, &battery) != 6)
+            continue;
+
+        TrackBuffer::record_t record = {};
+        record.timestamp = time;
+        record.latitude = lround(latitude * 1e7);
+        record.longitude = lround(longitude * 1e7);
+        record.speed = lround(speed * 100);
+        record.course = lround(course * 100);
+        record.battery = lround(battery * 1000);
+        fixes.push_back(record);
+    }
+    return fixes;
+}
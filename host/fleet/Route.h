@@ -0,0 +1,43 @@
+#ifndef FLEET_ROUTE_H
+#define FLEET_ROUTE_H
+
+#include "TrackBuffer.h"
+
+#include <random>
+#include <vector>
+
+/**
+ * Fixes of one simulated tracker, as the records published by pubMQTT(). Either a synthetic drive
+ * (parked, city and highway legs with random turns) around a start point, or a recorded track
+ * replayed from a different starting fix and shifted by a small offset, so that the trackers of a
+ * fleet do not publish identical positions.
+ */
+class Route
+{
+    public:
+        Route(uint32_t seed, int32_t latitude, int32_t longitude, int32_t timestamp);
+        Route(const std::vector<TrackBuffer::record_t> &track, size_t start, int32_t offset, int32_t timestamp);
+
+        TrackBuffer::record_t next(uint32_t interval);
+
+        static std::vector<TrackBuffer::record_t> load(const char *path);
+
+    private:
+        void drive(uint32_t interval);
+
+        const std::vector<TrackBuffer::record_t> *track = nullptr;
+        size_t index = 0;
+        int32_t offset = 0;             // Degrees x 1e7 added to the replayed positions.
+
+        std::mt19937 random;
+        double latitude = 0, longitude = 0;     // Degrees.
+        double speed = 0, course = 0;           // km/h, degrees.
+        uint32_t legLeft = 0;                   // ms until the next leg.
+
+        uint32_t sequence = 0;
+        int32_t timestamp;
+        uint32_t battery = 8100;                // mV
+        uint32_t elapsed = 0;                   // ms, for the battery drain.
+};
+
+#endif
@@ -0,0 +1,497 @@
+#include "MQTTClient.h"
+#include "Route.h"
+#include "Payload.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+/**
+ * Fleet load simulator (env:fleet): many simulated trackers publish the same topic and JSON payload
+ * as pubMQTT() to a local broker (e.g. Mosquitto), to size the ingest path before adding vehicles.
+ *
+ * Every tracker has its own MQTT connection and publishes one fix every interval, on a synthetic
+ * drive or on a replayed track. A monitor connection subscribes to the topic and matches every
+ * delivered payload with its publish, for the end-to-end latency. After the warm-up, it reports
+ * over the measured window:
+ *  - offered and delivered messages per second, and the messages lost,
+ *  - end-to-end latency percentiles (publish queued to delivery to the monitor),
+ *  - backpressure: lag of the publishes behind their schedule, bytes queued because the broker
+ *    did not read them (socket buffer full) and, with QoS 1, the PUBACK latency and in-flight count,
+ *  - the connect time (TCP and CONNACK) of the trackers.
+ *
+ * Usage: program [-H host] [-p port] [-n trackers] [-i interval ms] [-d duration s] [-w warm-up s]
+ *                [-q qos] [-c connects/s] [-t track.csv] [-o results.json] [-m]
+ *
+ * -m disables the monitor (e.g. when the broker denies the subscription); there is no latency then.
+ * The results file has the format of the host benchmarks (name, value, unit per line).
+ */
+
+static const char *topic = "sim7600/pub";
+static const uint16_t keepalive = 60;
+
+typedef struct
+{
+    const char *host = "127.0.0.1";
+    uint16_t port = 1883;
+    uint32_t trackers = 1000;
+    uint32_t interval = 5000;       // ms, as AWS_update_interval_ms.
+    uint32_t duration = 60;         // s, measured window.
+    uint32_t warmup = 5;            // s, after the last tracker connected.
+    uint8_t qos = 0;                // As MQTT::publish().
+    uint32_t connectRate = 200;     // Connects per second.
+    const char *track = NULL;
+    const char *output = NULL;
+    bool monitor = true;
+}options_t;
+
+typedef struct
+{
+    MQTTClient client;
+    std::unique_ptr<Route> route;
+    uint64_t connectStart = 0;      // us
+    bool armedOut = false;          // EPOLLOUT set.
+    std::unordered_map<uint16_t, uint64_t> inflight;    // QoS 1 packet id -> publish time (us).
+}tracker_t;
+
+typedef struct
+{
+    uint64_t at;                    // us
+    uint32_t tracker;
+}due_t;
+
+struct laterFirst
+{
+    bool operator()(const due_t &a, const due_t &b) const { return a.at > b.at; }
+};
+
+/**
+ * @brief Microseconds on the monotonic clock.
+ *
+ */
+static uint64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Percentile of the samples (in us), exact. Sorts the samples.
+ *
+ */
+static double percentile(std::vector<uint32_t> &samples, double p)
+{
+    if (samples.empty())
+        return 0;
+
+    size_t rank = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+static std::vector<std::pair<std::string, std::pair<double, const char *>>> results;
+
+static void result(const char *name, double value, const char *unit)
+{
+    results.push_back({ name, { value, unit } });
+}
+
+/**
+ * @brief Prints the 50th, 90th, 99th percentile and maximum of the samples in ms, and records them.
+ *
+ */
+static void report_latency(const char *name, std::vector<uint32_t> &samples)
+{
+    double p50 = percentile(samples, 0.5) / 1000, p90 = percentile(samples, 0.9) / 1000;
+    double p99 = percentile(samples, 0.99) / 1000;
+    double max = samples.empty() ? 0 : *std::max_element(samples.begin(), samples.end()) / 1000.0;
+
+    printf("%-24s %8zu samples, p50 %8.2f ms, p90 %8.2f ms, p99 %8.2f ms, max %8.2f ms\n", name, samples.size(), p50, p90, p99, max);
+
+    std::string base(name);
+    result((base + "_p50").c_str(), p50, "ms");
+    result((base + "_p99").c_str(), p99, "ms");
+    result((base + "_max").c_str(), max, "ms");
+}
+
+static void arm(int epoll, uint32_t index, MQTTClient &client, bool &armedOut)
+{
+    bool want = client.wantsWrite();
+    if (want == armedOut || client.fd() < 0)
+        return;
+
+    epoll_event event = {};
+    event.events = EPOLLIN | (want ? (uint32_t)EPOLLOUT : 0u);
+    event.data.u32 = index;
+    epoll_ctl(epoll, EPOLL_CTL_MOD, client.fd(), &event);
+    armedOut = want;
+}
+
+static bool add(int epoll, uint32_t index, MQTTClient &client)
+{
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.u32 = index;
+    return epoll_ctl(epoll, EPOLL_CTL_ADD, client.fd(), &event) == 0;
+}
+
+static bool parse_options(int argc, char **argv, options_t &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool value = i + 1 < argc;
+        if (strcmp(argv[i], "-H") == 0 && value)
+            options.host = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0 && value)
+            options.port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && value)
+            options.trackers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-i") == 0 && value)
+            options.interval = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-d") == 0 && value)
+            options.duration = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-w") == 0 && value)
+            options.warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-q") == 0 && value)
+            options.qos = atoi(argv[++i]) > 0;
+        else if (strcmp(argv[i], "-c") == 0 && value)
+            options.connectRate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && value)
+            options.track = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && value)
+            options.output = argv[++i];
+        else if (strcmp(argv[i], "-m") == 0)
+            options.monitor = false;
+        else
+            return false;
+    }
+    return options.trackers > 0 && options.interval > 0 && options.duration > 0 && options.connectRate > 0;
+}
+
+int main(int argc, char **argv)
+{
+    options_t options;
+    if (!parse_options(argc, argv, options))
+    {
+        fprintf(stderr, "Usage: %s [-H host] [-p port] [-n trackers] [-i interval ms] [-d duration s] [-w warm-up s] "
+                        "[-q qos] [-c connects/s] [-t track.csv] [-o results.json] [-m]\n", argv[0]);
+        return 2;
+    }
+
+    addrinfo hints = {}, *resolved;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(options.host, NULL, &hints, &resolved) != 0)
+    {
+        fprintf(stderr, "Could not resolve %s\n", options.host);
+        return 2;
+    }
+    uint32_t address = ((sockaddr_in *)resolved->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(resolved);
+
+    // One socket per tracker.
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < options.trackers + 64)
+    {
+        limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, options.trackers + 64);
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < options.trackers + 64)
+            fprintf(stderr, "Only %lu file descriptors, fewer trackers will connect\n", (unsigned long)limit.rlim_cur);
+    }
+
+    std::vector<TrackBuffer::record_t> track;
+    if (options.track)
+    {
+        track = Route::load(options.track);
+        if (track.empty())
+        {
+            fprintf(stderr, "No fixes in %s\n", options.track);
+            return 2;
+        }
+    }
+
+    // Trackers spread over about 20 km around the start of the corpus track.
+    const int32_t timestamp = time(NULL);
+    std::mt19937 random(1);
+    std::vector<tracker_t> trackers(options.trackers);
+    for (uint32_t i = 0; i < options.trackers; i++)
+    {
+        if (!track.empty())
+            trackers[i].route.reset(new Route(track, random() % track.size(), (int32_t)(random() % 2000) - 1000, timestamp));
+        else
+            trackers[i].route.reset(new Route(i + 1, 174064962 + (int32_t)(random() % 2000000) - 1000000,
+                                              784772077 + (int32_t)(random() % 2000000) - 1000000, timestamp));
+    }
+
+    int epoll = epoll_create1(0);
+    const uint32_t MONITOR = options.trackers;
+
+    // Monitor: the payloads in flight, by content, with the time they were queued.
+    MQTTClient monitor;
+    std::unordered_map<std::string, std::deque<uint64_t>> pending;
+    std::vector<uint32_t> latency, pubackLatency, scheduleLag, connectTime;
+    uint64_t measureStart = UINT64_MAX, measureEnd = UINT64_MAX;
+    uint64_t offered = 0, delivered = 0, lost = 0, unmatched = 0;
+    uint32_t connectFailures = 0, disconnects = 0, maxInflight = 0;
+    size_t maxQueued = 0;
+
+    if (options.monitor)
+    {
+        monitor.onConnack = [&](MQTTClient &client, uint8_t code) {
+            if (code == 0)
+                client.subscribe(topic, options.qos);
+        };
+        monitor.onMessage = [&](MQTTClient &, const char *, size_t, const char *payload, size_t length) {
+            uint64_t now = now_us();
+            auto entry = pending.find(std::string(payload, length));
+            if (entry == pending.end())
+            {
+                unmatched++;
+                return;
+            }
+
+            uint64_t sent = entry->second.front();
+            entry->second.pop_front();
+            if (entry->second.empty())
+                pending.erase(entry);
+
+            if (sent >= measureStart && sent < measureEnd)
+            {
+                latency.push_back(now - sent);
+                delivered++;
+            }
+        };
+        if (!monitor.connect(address, options.port, "fleet-monitor", keepalive) || !add(epoll, MONITOR, monitor))
+        {
+            fprintf(stderr, "Could not connect to %s:%u\n", options.host, options.port);
+            return 1;
+        }
+    }
+
+    std::priority_queue<due_t, std::vector<due_t>, laterFirst> schedule;
+    uint32_t connecting = 0, connected = 0;
+    const uint64_t start = now_us();
+    uint64_t lastPing = start;
+    char payload[256];
+    epoll_event events[256];
+
+    printf("%u trackers, one fix every %u ms (%.1f msg/s), QoS %u, to %s:%u\n", options.trackers, options.interval,
+           options.trackers * 1000.0 / options.interval, options.qos, options.host, options.port);
+
+    while (true)
+    {
+        uint64_t now = now_us();
+
+        // Connects spread at connectRate, so that the broker is not flooded with handshakes.
+        while (connecting < options.trackers && now >= start + (uint64_t)connecting * 1000000 / options.connectRate)
+        {
+            uint32_t index = connecting++;
+            tracker_t &tracker = trackers[index];
+            char clientId[24];
+            snprintf(clientId, sizeof(clientId), "fleet-%u", index);
+
+            tracker.client.onConnack = [&, index](MQTTClient &, uint8_t code) {
+                if (code != 0)
+                {
+                    connectFailures++;
+                    return;
+                }
+                uint64_t at = now_us();
+                connectTime.push_back(at - trackers[index].connectStart);
+                connected++;
+                schedule.push({ at + (uint64_t)(random() % options.interval) * 1000, index });
+            };
+            tracker.client.onPuback = [&, index](MQTTClient &, uint16_t id) {
+                auto entry = trackers[index].inflight.find(id);
+                if (entry == trackers[index].inflight.end())
+                    return;
+                if (entry->second >= measureStart && entry->second < measureEnd)
+                    pubackLatency.push_back(now_us() - entry->second);
+                trackers[index].inflight.erase(entry);
+            };
+
+            tracker.connectStart = now;
+            if (!tracker.client.connect(address, options.port, clientId, keepalive) || !add(epoll, index, tracker.client))
+            {
+                connectFailures++;
+                tracker.client.close();
+            }
+            tracker.armedOut = true;
+        }
+
+        // The measured window starts after the warm-up, once all the trackers are connected or
+        // refused, or 10 s after the last connect.
+        const uint64_t connectEnd = start + (uint64_t)options.trackers * 1000000 / options.connectRate;
+        if (measureStart == UINT64_MAX && connecting == options.trackers &&
+            (connected + connectFailures >= options.trackers || now >= connectEnd + 10000000))
+        {
+            measureStart = now + (uint64_t)options.warmup * 1000000;
+            measureEnd = measureStart + (uint64_t)options.duration * 1000000;
+            printf("%u trackers connected in %.1f s, measuring from %u s for %u s\n", connected, (now - start) / 1e6,
+                   options.warmup, options.duration);
+        }
+
+        // Publishes due. The lag behind the schedule is the backpressure on the publishers.
+        while (!schedule.empty() && schedule.top().at <= now && now < measureEnd)
+        {
+            due_t due = schedule.top();
+            schedule.pop();
+            tracker_t &tracker = trackers[due.tracker];
+            if (tracker.client.state() != MQTTClient::STATE_CONNECTED)
+                continue;
+
+            TrackBuffer::record_t record = tracker.route->next(options.interval);
+            size_t length = Payload::formatJSON(payload, sizeof(payload), record);
+            uint64_t queued = now_us();
+
+            uint16_t id = tracker.client.publish(topic, payload, length, options.qos);
+            if (options.monitor)
+                pending[std::string(payload, length)].push_back(queued);
+            if (id != 0)
+            {
+                tracker.inflight[id] = queued;
+                maxInflight = std::max<uint32_t>(maxInflight, tracker.inflight.size());
+            }
+            if (queued >= measureStart)
+            {
+                offered++;
+                scheduleLag.push_back(queued - due.at);
+            }
+
+            tracker.client.onWritable();
+            maxQueued = std::max(maxQueued, tracker.client.queued());
+            arm(epoll, due.tracker, tracker.client, tracker.armedOut);
+            schedule.push({ due.at + (uint64_t)options.interval * 1000, due.tracker });
+        }
+
+        // Keep alive, at half the interval.
+        if (now - lastPing >= keepalive * 500000ULL)
+        {
+            lastPing = now;
+            for (uint32_t i = 0; i < options.trackers; i++)
+                if (trackers[i].client.state() == MQTTClient::STATE_CONNECTED)
+                {
+                    trackers[i].client.ping();
+                    arm(epoll, i, trackers[i].client, trackers[i].armedOut);
+                }
+            if (options.monitor && monitor.state() == MQTTClient::STATE_CONNECTED)
+            {
+                monitor.ping();
+                monitor.onWritable();
+            }
+        }
+
+        // After the window, the deliveries in flight have 5 s to arrive.
+        if (now >= measureEnd && (pending.empty() || now >= measureEnd + 5000000))
+            break;
+
+        uint64_t wake = now + 10000;
+        if (!schedule.empty() && now < measureEnd)
+            wake = std::min(wake, schedule.top().at);
+        if (connecting < options.trackers)
+            wake = std::min(wake, start + (uint64_t)connecting * 1000000 / options.connectRate);
+        int timeout = (wake > now) ? (int)((wake - now + 999) / 1000) : 0;
+
+        int count = epoll_wait(epoll, events, sizeof(events) / sizeof(events[0]), timeout);
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t index = events[i].data.u32;
+            MQTTClient &client = (index == MONITOR) ? monitor : trackers[index].client;
+            bool ok = true;
+
+            if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                ok = client.onWritable();
+            if (ok && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+                ok = client.onReadable();
+
+            if (!ok)
+            {
+                if (index == MONITOR)
+                    fprintf(stderr, "Monitor connection closed by the broker\n");
+                else if (client.state() == MQTTClient::STATE_CLOSED)
+                    disconnects++;
+                continue;
+            }
+
+            // The monitor acknowledges QoS 1 deliveries from its read handler.
+            if (index == MONITOR)
+                client.onWritable();
+            else
+                arm(epoll, index, client, trackers[index].armedOut);
+        }
+    }
+
+    // Publishes of the window which were not delivered to the monitor.
+    for (const auto &entry : pending)
+        for (uint64_t sent : entry.second)
+            lost += (sent >= measureStart && sent < measureEnd);
+
+    uint32_t stalls = 0;
+    for (tracker_t &tracker : trackers)
+    {
+        stalls += tracker.client.stalls();
+        if (tracker.client.state() == MQTTClient::STATE_CONNECTED)
+        {
+            tracker.client.disconnect();
+            tracker.client.onWritable();
+        }
+    }
+    if (options.monitor)
+    {
+        monitor.disconnect();
+        monitor.onWritable();
+    }
+
+    double window = options.duration;
+    printf("\n%-24s %8u connected, %u failed, %u disconnected\n", "trackers", connected, connectFailures, disconnects);
+    report_latency("connect", connectTime);
+    printf("%-24s %8.1f msg/s\n", "offered_rate", offered / window);
+    result("offered_rate", offered / window, "msg/s");
+    if (options.monitor)
+    {
+        printf("%-24s %8.1f msg/s, %lu lost, %lu not matched\n", "delivered_rate", delivered / window,
+               (unsigned long)lost, (unsigned long)unmatched);
+        result("delivered_rate", delivered / window, "msg/s");
+        result("lost", lost, "messages");
+        report_latency("latency", latency);
+    }
+    report_latency("schedule_lag", scheduleLag);
+    printf("%-24s %8zu bytes queued at most on a connection, %u writes stalled\n", "backpressure", maxQueued, stalls);
+    result("max_queued", maxQueued, "bytes");
+    result("stalls", stalls, "writes");
+    if (options.qos > 0)
+    {
+        report_latency("puback", pubackLatency);
+        printf("%-24s %8u in flight at most on a connection\n", "inflight", maxInflight);
+    }
+
+    if (options.output)
+    {
+        FILE *file = fopen(options.output, "w");
+        if (!file)
+        {
+            fprintf(stderr, "Could not write %s\n", options.output);
+            return 2;
+        }
+        fprintf(file, "[\n");
+        for (size_t i = 0; i < results.size(); i++)
+            fprintf(file, "{\"name\":\"%s\",\"value\":%.3f,\"unit\":\"%s\"}%s\n", results[i].first.c_str(),
+                    results[i].second.first, results[i].second.second, (i + 1 < results.size()) ? "," : "");
+        fprintf(file, "]\n");
+        fclose(file);
+    }
+
+    return (connected == 0) ? 1 : 0;
+}
@@ -0,0 +1,425 @@
+#include "Arduino.h"
+#include "ModemSimulator.h"
+#include "SIM7600.h"
+#include "MQTTConnection.h"
+#include "EnergyModel.h"
+#include "Payload.h"
+#include "CertStore.h"
+#include "BootProfile.h"
+#include "GNSSPolicy.h"
+
+/**
+ * Host run of the SIM7600 driver against the modem simulator (env:native).
+ * 
+ * Replays the AT flow of setup(), serial_monitor(), fetchGPS() and pubMQTT() for a few link
+ * profiles and prints the boot time, publish latency and reconnect time on the virtual clock,
+ * then the latency percentiles of every AT command over all the profiles (see CommandStats).
+ * Exits with 1 if a scenario fails, or if the boot, a publish cycle or a reconnect takes longer
+ * than the budget of its profile, so that it can gate a change of the AT flow.
+ * 
+ * Usage: program [-v] [cycles]
+ */
+
+// The unit tests (pio test -e native) are built with the sources of env:native and have their own main().
+#ifndef PIO_UNIT_TESTING
+
+static const char *aws_server = "tcp://simulated-endpoint";
+static const unsigned int aws_port = 8883;
+static const char *cacert = "Amazon-Root-Certificate-Filename";
+static const char *clientcert = "Thing-Certificate-Filename";
+static const char *clientkey = "Private-Key-Filename";
+
+static const MQTTConnection::config_t link_config = { aws_server, aws_port, cacert, clientcert, clientkey, 1000, 60000, 2 };
+static const uint32_t modem_baud = 921600;
+
+// Time budgets (in ms on the virtual clock) of a link profile, about 25 % above the times of the
+// current AT flow with the default cycles. The simulator is seeded, so a run is reproducible.
+typedef struct
+{
+    uint32_t boot;              // Power-on to the broker connection, as in setup().
+    uint32_t firstPublish;      // Power-on to the first fix published.
+    uint32_t cycle;             // Average publish cycle.
+    uint32_t cycleMax;          // Slowest publish cycle, with its polls and publishes sent again.
+    uint32_t reconnect;         // After a connection loss.
+    uint32_t reconnectFailures; // After a connection loss and 3 refused connects.
+}budget_t;
+
+static unsigned int failed = 0;     // Scenarios failed or over budget.
+
+/**
+ * @brief Same loop as serial_monitor() in functions.h: attempts spaced by the backoff.
+ * 
+ */
+static bool connectMQTT(MQTTConnection &link, unsigned int attempts = 10)
+{
+    for (unsigned int i = 0; i < attempts; i++)
+    {
+        if (link.attempt())
+            return true;
+        vTaskDelay(link.backoff() / portTICK_PERIOD_MS);
+    }
+    return false;
+}
+
+#define CYCLE_ATTEMPTS 3
+
+/**
+ * @brief Same AT flow as one report of fetchGPS() and pubMQTT() in functions.h. As in the
+ * firmware, a poll whose response lost a byte gives no fix and the GPS is polled again, and a
+ * publish whose completion lost a byte fails and the fix is sent again (from the track buffer).
+ * 
+ * @param retries   Incremented for every poll and publish sent again.
+ * @return true     If the fix was published within CYCLE_ATTEMPTS polls and publishes.
+ */
+static bool publishCycle(GPS &gps, MQTT &mqtt, unsigned int &retries)
+{
+    bool fix = gps.getData();
+    for (uint8_t attempt = 1; !fix && attempt < CYCLE_ATTEMPTS; attempt++, retries++)
+        fix = gps.getData();
+    if (!fix)
+        return false;
+
+    char publishTopic[20];
+    snprintf(publishTopic, sizeof(publishTopic), "sim7600/pub");
+
+    char payload[150];
+    snprintf(payload, sizeof(payload), "{\"latitude\":%.8lf,\"longitude\":%.8lf,\"speed\":%.2lf,\"course\":%.2lf,\"timestamp\":%li,\"battery\":%.2lf}",
+             gps.data.latitude(), gps.data.longitude(), gps.data.speed(), gps.data.course(), gps.data.timestamp, 7.4);
+
+    bool published = mqtt.setPublishTopicPayload(publishTopic, payload) && mqtt.publish();
+    for (uint8_t attempt = 1; !published && attempt < CYCLE_ATTEMPTS; attempt++, retries++)
+        published = mqtt.setPublishTopicPayload(publishTopic, payload) && mqtt.publish();
+    return published;
+}
+
+/**
+ * @brief Same as startGNSS() in functions.h, then polls until the first fix as fetchGPS() does.
+ * A start whose response lost a byte is sent again, as fetchGPS() does at the next poll with
+ * GNSS_DUTY_CYCLE, up to CYCLE_ATTEMPTS times.
+ * 
+ * @return uint32_t Time to first fix (in ms), or 0 if there is no fix within 2 minutes.
+ */
+static uint32_t startGNSS(SIM7600 &sim7600, GPS &gps, GNSSPolicy &policy)
+{
+    time_t clock = 0;
+    if (policy.needsClock() && !sim7600.networkTime(clock))
+        clock = 0;
+
+    GNSSPolicy::start_t start = policy.choose(millis(), clock);
+    bool success = false;
+    for (uint8_t attempt = 0; !success && attempt < CYCLE_ATTEMPTS; attempt++)
+        success = (start == GNSSPolicy::START_HOT) ? gps.hotStart() : (start == GNSSPolicy::START_WARM) ? gps.warmStart() : gps.coldStart();
+    if (!success)
+        return 0;
+    policy.started(start, millis());
+
+    for (uint32_t end = millis() + 120000; millis() < end; vTaskDelay(policy.acquirePoll() / portTICK_PERIOD_MS))
+        if (gps.getData() && policy.fix(gps.data.timestamp, millis()))
+            return millis() - policy.startTime();
+    return 0;
+}
+
+static void report(const char *profile, const char *scenario, uint32_t ms, bool success, uint32_t budget = UINT32_MAX)
+{
+    if (!success)
+        printf("%-10s %-24s %8u ms FAILED\n", profile, scenario, ms);
+    else if (ms > budget)
+        printf("%-10s %-24s %8u ms OVER BUDGET (%u ms)\n", profile, scenario, ms, budget);
+    else
+        printf("%-10s %-24s %8u ms ok\n", profile, scenario, ms);
+
+    failed += !success || ms > budget;
+}
+
+static void run(const char *name, const ModemSimulator::profile_t &profile, const budget_t &budget, unsigned int cycles)
+{
+    hostUseVirtualClock(true);
+    SIM7600::invalidateState();
+    uint32_t saved = SIM7600::commandsSaved();
+
+    ModemSimulator modem(profile);
+    modem.loadDefaultScript();
+    modem.boot(4000, 7000);
+
+    SIM7600 sim7600(modem);
+    GPS gps(modem);
+    MQTT mqtt(modem);
+    SSL ssl(modem);
+    MQTTConnection link(ssl, mqtt, link_config);
+
+    // Boot, as in setup(): GNSS is started before the registration and the first poll of
+    // fetchGPS() runs while the network comes up.
+    BootProfile profileBoot;
+    sim7600.syncBaudRate(modem_baud);
+    bool success = sim7600.waitReady(30000) && profileBoot.mark(BootProfile::PHASE_SIM_READY, millis());
+    success &= sim7600.echoOFF();
+    success &= sim7600.syncBaudRate(modem_baud);
+    success &= gps.begin() && profileBoot.mark(BootProfile::PHASE_GNSS_ON, millis());
+    if (gps.getData())
+        profileBoot.mark(BootProfile::PHASE_FIRST_FIX, millis());
+    success &= sim7600.waitRegistered(60000) && profileBoot.mark(BootProfile::PHASE_REGISTERED, millis());
+    success &= connectMQTT(link) && profileBoot.mark(BootProfile::PHASE_CONNECTED, millis());
+    uint32_t boot = millis();
+    report(name, "boot", boot, success, budget.boot);
+
+    unsigned int retries = 0;
+    success = publishCycle(gps, mqtt, retries) && profileBoot.mark(BootProfile::PHASE_FIRST_PUBLISH, millis());
+    report(name, "time_to_first_publish", millis(), success, budget.firstPublish);
+    for (uint8_t i = 0; i < BootProfile::PHASE_COUNT; i++)
+        if (profileBoot.done((BootProfile::phase_t)i))
+            printf("%-10s boot_%-19s %8lu ms\n", name, BootProfile::name((BootProfile::phase_t)i),
+                   (unsigned long)profileBoot.at((BootProfile::phase_t)i));
+
+    uint32_t total = 0, worst = 0;
+    unsigned int failures = 0;
+    for (unsigned int i = 0; i < cycles; i++)
+    {
+        uint32_t start = millis();
+        failures += !publishCycle(gps, mqtt, retries);
+        uint32_t elapsed = millis() - start;
+        total += elapsed;
+        worst = (elapsed > worst) ? elapsed : worst;
+    }
+    report(name, "publish_cycle_avg", cycles ? total / cycles : 0, failures == 0, budget.cycle);
+    report(name, "publish_cycle_max", worst, failures == 0, budget.cycleMax);
+    printf("%-10s %-24s %8u polls and publishes sent again\n", name, "publish_cycle_retries", retries);
+
+    // Batches of fixes in one publish, as in drainTrack().
+    static char buffer[2048];
+    const uint8_t batchSizes[] = { 1, 5, 10 };
+    for (uint8_t batchSize : batchSizes)
+    {
+        Payload payload(buffer, sizeof(buffer));
+        uint32_t exchanges = SIM7600::exchangeCount();
+
+        for (uint8_t i = 0; i < batchSize; i++)
+        {
+            gps.getData();
+            TrackBuffer::record_t record = TrackBuffer::makeRecord(gps.data, 7.4);
+            record.sequence = i;
+            payload.add(record);
+        }
+        exchanges = SIM7600::exchangeCount() - exchanges;
+
+        uint32_t start = millis();
+        const char *topic = payload.topic();
+        uint32_t publishExchanges = SIM7600::exchangeCount();
+        success = mqtt.setPublishTopicPayload(topic, payload.data(), payload.length()) && mqtt.publish();
+        publishExchanges = SIM7600::exchangeCount() - publishExchanges;
+        uint32_t publishTime = millis() - start;
+
+        char scenario[32];
+        snprintf(scenario, sizeof(scenario), "batch_%u_publish_per_fix", batchSize);
+        report(name, scenario, publishTime / batchSize, success);
+        printf("%-10s %-24s %8.1f AT exchanges/fix (publish), %.1f bytes airtime/fix\n", name, scenario,
+               (double)publishExchanges / batchSize, (double)MQTT::airtime(strlen(topic), payload.length()) / batchSize);
+    }
+
+    // Connection lost, recovered as in serial_monitor(): only the connection layer is replayed.
+    modem.urc(millis(), "+CMQTTCONNLOST: 0,1");
+    uint32_t start = millis();
+    success = sim7600.waitForResponse("+CMQTTCONNLOST", 1);
+    success &= connectMQTT(link);
+    report(name, "reconnect", millis() - start, success, budget.reconnect);
+
+    // Connection lost and the broker refuses the first connects: the client is released and
+    // acquired again after layerRetries failures.
+    modem.respond("AT+CMQTTCONNECT", { { 0, "OK" }, { 900, "+CMQTTCONNECT: 0,32" } }, 3);
+    modem.urc(millis(), "+CMQTTCONNLOST: 0,1");
+    start = millis();
+    success = sim7600.waitForResponse("+CMQTTCONNLOST", 1);
+    success &= connectMQTT(link);
+    report(name, "reconnect_3_failures", millis() - start, success, budget.reconnectFailures);
+    printf("%-10s %-24s %8lu attempts, %lu connection and %lu client failures\n", name, "reconnect_attempts",
+           (unsigned long)link.stats().attempts, (unsigned long)link.stats().failures[MQTTConnection::LAYER_CONNECTION],
+           (unsigned long)link.stats().failures[MQTTConnection::LAYER_CLIENT]);
+
+    // One hour parked, polled every 30 s as by the report scheduler, with and without the sleep mode.
+    const EnergyModel::config_t energyConfig = { { 75.0, 4.0, 20.0 }, 35.0, 2600.0 };
+    for (bool lowPower : { false, true })
+    {
+        EnergyModel energy(energyConfig);
+        energy.update(EnergyModel::STATE_ACTIVE, true, millis());
+        SIM7600::onSleep([](bool asleep, void *context) {
+            ((EnergyModel *)context)->update(asleep ? EnergyModel::STATE_SLEEP : EnergyModel::STATE_ACTIVE, true, millis());
+        }, &energy);
+
+        if (lowPower)
+            sim7600.enableSleep(GPIO_NUM_25, GPIO_NUM_26);
+
+        for (uint32_t end = millis() + 3600000; millis() < end; )
+        {
+            gps.getData();
+            sim7600.sleep();
+            vTaskDelay(30000 / portTICK_PERIOD_MS);
+        }
+        energy.update(SIM7600::isAsleep() ? EnergyModel::STATE_SLEEP : EnergyModel::STATE_ACTIVE, true, millis());
+        sim7600.disableSleep();
+        SIM7600::onSleep(NULL);
+
+        uint64_t awake = energy.timeIn(EnergyModel::STATE_ACTIVE), asleep = energy.timeIn(EnergyModel::STATE_SLEEP);
+        printf("%-10s %-24s %8.1f mA average, %.0f h per charge, %.1f%% asleep\n", name,
+               lowPower ? "parked_hour_sleep" : "parked_hour_awake", energy.averageCurrent(), energy.runtime(),
+               100.0 * asleep / (awake + asleep));
+    }
+
+    // GNSS starts chosen from the persisted fix and the modem clock, then one hour parked with the
+    // engine switched off between the polls (GNSS_DUTY_CYCLE), with the sleep mode.
+    const GNSSPolicy::config_t policyConfig = { 30000, 7200, 604800, 1000 };
+    const time_t clock = 1700000000;
+    modem.gnssTTFF(1500, 25000, 35000);
+    modem.setClock(clock);
+    const struct { const char *scenario; time_t persisted; } restarts[] =
+    {
+        { "gnss_start_no_fix", 0 },
+        { "gnss_start_fix_1_day", clock - 86400 },
+        { "gnss_start_fix_1_hour", clock - 3600 },
+    };
+    for (const auto &restart : restarts)
+    {
+        GNSSPolicy policy(policyConfig);
+        policy.restore(restart.persisted, restart.persisted != 0);
+        uint32_t ttff = startGNSS(sim7600, gps, policy);
+        report(name, restart.scenario, ttff, ttff > 0);
+        printf("%-10s %-24s %8s start\n", name, restart.scenario, GNSSPolicy::name(policy.restarts(GNSSPolicy::START_HOT) ? GNSSPolicy::START_HOT :
+               policy.restarts(GNSSPolicy::START_WARM) ? GNSSPolicy::START_WARM : GNSSPolicy::START_COLD));
+    }
+
+    {
+        GNSSPolicy policy(policyConfig);
+        EnergyModel energy(energyConfig);
+        startGNSS(sim7600, gps, policy);
+        energy.update(EnergyModel::STATE_ACTIVE, true, millis());
+        SIM7600::onSleep([](bool asleep, void *context) {
+            ((EnergyModel *)context)->update(asleep ? EnergyModel::STATE_SLEEP : EnergyModel::STATE_ACTIVE,
+                                             SIM7600::modemState().gnss == SIM7600::STATE_ON, millis());
+        }, &energy);
+        sim7600.enableSleep(GPIO_NUM_25, GPIO_NUM_26);
+
+        uint32_t begin = millis();
+        for (uint32_t end = millis() + 3600000; millis() < end; )
+        {
+            if (!policy.isOn() && gps.hotStart())
+                policy.started(GNSSPolicy::START_HOT, millis());
+            bool fix = gps.getData();
+            if (fix)
+                policy.fix(gps.data.timestamp, millis());
+            uint32_t poll = fix ? 30000 : policy.isAcquiring() ? policy.acquirePoll() : 5000;
+            if (policy.shouldStop(poll))
+            {
+                gps.stop();
+                policy.stopped(millis());
+            }
+            energy.update(EnergyModel::STATE_ACTIVE, SIM7600::modemState().gnss == SIM7600::STATE_ON, millis());
+            sim7600.sleep();
+            vTaskDelay(poll / portTICK_PERIOD_MS);
+        }
+        energy.update(SIM7600::isAsleep() ? EnergyModel::STATE_SLEEP : EnergyModel::STATE_ACTIVE, false, millis());
+        sim7600.disableSleep();
+        SIM7600::onSleep(NULL);
+
+        const LatencyHistogram &hot = policy.ttff(GNSSPolicy::START_HOT);
+        printf("%-10s %-24s %8.1f mA average, %.0f h per charge, GNSS on %.1f%% (%.1f%% of the hour), %lu hot starts, TTFF p50 %lu ms, max %lu ms\n",
+               name, "parked_hour_gnss_cycled", energy.averageCurrent(), energy.runtime(), policy.dutyCycle(millis()) * 100,
+               100.0 * energy.gnssTime() / (millis() - begin), (unsigned long)policy.restarts(GNSSPolicy::START_HOT),
+               (unsigned long)hot.percentile(0.5), (unsigned long)hot.max());
+    }
+    modem.gnssTTFF(0, 0, 0);
+    gps.begin();
+
+    // Certificates streamed from the certs partition: new device, reboot, one certificate renewed.
+    std::string files[3];
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        const size_t lengths[3] = { 1188, 1224, 1679 };
+        for (size_t j = 0; j < lengths[i]; j++)
+            files[i] += (j % 65 == 64) ? '\n' : "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[(i * 7 + j * 13) % 64];
+    }
+
+    hostCreatePartition(ESP_PARTITION_TYPE_DATA, CERT_PARTITION_SUBTYPE, "certs", 0x10000);
+    CertStore store;
+    store.begin();
+    store.format();
+    for (uint8_t i = 0; i < 3; i++)
+        store.add((i == 0) ? cacert : (i == 1) ? clientcert : clientkey, (const uint8_t *)files[i].data(), files[i].size());
+
+    modem.certificates().clear();
+    const char *provisioning[3] = { "provision_new_device", "provision_reboot", "provision_renewed_cert" };
+    for (uint8_t run = 0; run < 3; run++)
+    {
+        if (run == 2)
+        {
+            files[1][100] = '#';
+            store.format();
+            for (uint8_t i = 0; i < 3; i++)
+                store.add((i == 0) ? cacert : (i == 1) ? clientcert : clientkey, (const uint8_t *)files[i].data(), files[i].size());
+        }
+
+        CertStore rebooted;
+        rebooted.begin();
+        unsigned long commands = modem.stats().commands;
+        uint32_t start = millis();
+        success = ssl.downloadCertificates(rebooted);
+        success &= modem.certificates()[cacert] == files[0] && modem.certificates()[clientcert] == files[1] &&
+                   modem.certificates()[clientkey] == files[2];
+        report(name, provisioning[run], millis() - start, success);
+        printf("%-10s %-24s %8lu AT commands\n", name, provisioning[run], modem.stats().commands - commands);
+    }
+
+    const ModemSimulator::stats_t &stats = modem.stats();
+    printf("%-10s %-24s %8lu commands, %lu bytes to modem, %lu bytes from modem, %lu dropped\n",
+           name, "totals", stats.commands, stats.bytesToModem, stats.bytesFromModem, stats.droppedBytes);
+    printf("%-10s %-24s %8lu commands not sent (known modem state), %.0f per hour\n", name, "commands_saved",
+           (unsigned long)(SIM7600::commandsSaved() - saved), (SIM7600::commandsSaved() - saved) * 3600000.0 / millis());
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int cycles = 20;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-v") == 0)
+            hostLogLevel = 4;
+        else
+            cycles = atoi(argv[i]);
+    }
+
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    ModemSimulator::profile_t ideal;
+    ideal.latency = 5;
+
+    ModemSimulator::profile_t typical;
+    typical.latency = 30;
+    typical.jitter = 20;
+
+    ModemSimulator::profile_t poor;
+    poor.latency = 150;
+    poor.jitter = 200;
+    poor.dropRate = 0.001;
+
+    run("ideal", ideal, { 10000, 10500, 250, 500, 1200, 10000 }, cycles);
+    run("typical", typical, { 10500, 11000, 500, 1000, 1200, 12500 }, cycles);
+    run("poor", poor, { 13500, 15500, 2500, 9500, 1600, 14000 }, cycles);
+
+    const CommandStats &commands = SIM7600::commandStats();
+    printf("\n%-20s %6s %6s %6s %6s %6s %6s %6s\n", "command", "n", "p50", "p90", "p99", "max", "tmout", "error");
+    for (uint8_t i = 0; i < commands.size(); i++)
+    {
+        const CommandStats::entry_t &e = commands.entry(i);
+        printf("%-20s %6lu %6lu %6lu %6lu %6lu %6lu %6lu\n", e.name, (unsigned long)e.latency.count(),
+               (unsigned long)e.latency.percentile(0.5), (unsigned long)e.latency.percentile(0.9),
+               (unsigned long)e.latency.percentile(0.99), (unsigned long)e.latency.max(),
+               (unsigned long)e.timeouts, (unsigned long)e.errors);
+    }
+
+    if (failed > 0)
+    {
+        fprintf(stderr, "%u scenarios failed or over budget\n", failed);
+        return 1;
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,74 @@
+#include "CertStore.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/**
+ * Builds the image of the certs partition (env:certimage), to be flashed at the partition offset.
+ * The last sector of the partition is not part of the image, so the record of the certificates
+ * already downloaded into the modem is kept.
+ * 
+ * Usage: program <output> <name>=<file> ...
+ * e.g.   program certs.bin Amazon-Root-Certificate-Filename=AmazonRootCA1.pem ...
+ */
+int main(int argc, char **argv)
+{
+    const uint32_t size = 0x10000;      // As in partitions.csv.
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <output> <name>=<file> ...\n", argv[0]);
+        return 2;
+    }
+
+    hostCreatePartition(ESP_PARTITION_TYPE_DATA, CERT_PARTITION_SUBTYPE, "certs", size);
+    CertStore store;
+    store.begin();
+    store.format();
+
+    for (int i = 2; i < argc; i++)
+    {
+        const char *separator = strchr(argv[i], '=');
+        if (separator == NULL)
+        {
+            fprintf(stderr, "Missing '=' in %s\n", argv[i]);
+            return 2;
+        }
+
+        std::string name(argv[i], separator - argv[i]);
+        FILE *file = fopen(separator + 1, "rb");
+        if (file == NULL)
+        {
+            fprintf(stderr, "Could not read %s\n", separator + 1);
+            return 2;
+        }
+
+        std::vector<uint8_t> data;
+        uint8_t buffer[1024];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            data.insert(data.end(), buffer, buffer + read);
+        fclose(file);
+
+        if (!store.add(name.c_str(), data.data(), data.size()))
+        {
+            fprintf(stderr, "Could not add %s (%zu bytes)\n", name.c_str(), data.size());
+            return 1;
+        }
+        printf("%-40s %6zu bytes, hash %08lx\n", name.c_str(), data.size(), (unsigned long)store.entry(store.count() - 1).hash);
+    }
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)CERT_PARTITION_SUBTYPE, "certs");
+    std::vector<uint8_t> image(size - CERT_SECTOR_SIZE);
+    esp_partition_read(partition, 0, image.data(), image.size());
+
+    FILE *output = fopen(argv[1], "wb");
+    if (output == NULL || fwrite(image.data(), 1, image.size(), output) != image.size() || fclose(output) != 0)
+    {
+        fprintf(stderr, "Could not write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
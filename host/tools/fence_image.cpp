@@ -0,0 +1,118 @@
+#include "Geofence.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * Builds the image of the fences partition (env:fenceimage), to be flashed at the partition offset.
+ * One fence per line of the input file, in degrees and metres:
+ *
+ *   <id>,<name>,circle,<latitude>,<longitude>,<radius>
+ *   <id>,<name>,polygon,<latitude> <longitude>;<latitude> <longitude>;...
+ *
+ * The names are published in JSON without escaping, so they must not contain '"' or '\'.
+ * Lines starting with '#' are comments.
+ *
+ * Usage: program <output> <fences file>
+ * e.g.   program fences.bin fences.csv
+ */
+int main(int argc, char **argv)
+{
+    const uint32_t size = 0x20000;      // As in partitions.csv.
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <output> <fences file>\n", argv[0]);
+        return 2;
+    }
+
+    FILE *input = fopen(argv[2], "r");
+    if (input == NULL)
+    {
+        fprintf(stderr, "Could not read %s\n", argv[2]);
+        return 2;
+    }
+
+    hostCreatePartition(ESP_PARTITION_TYPE_DATA, GEOFENCE_PARTITION_SUBTYPE, "fences", size);
+    Geofence fences({ 0, 1 });
+    fences.begin();
+    fences.format();
+
+    char line[4096];
+    unsigned int number = 0;
+    while (fgets(line, sizeof(line), input))
+    {
+        number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+
+        unsigned int id;
+        char name[64], type[16];
+        int consumed = 0;
+        if (sscanf(line, "%u,%63[^,],%15[^,],%n", &id, name, type, &consumed) != 3 || consumed == 0 || id > UINT16_MAX)
+        {
+            fprintf(stderr, "Line %u: expected <id>,<name>,<type>,...\n", number);
+            return 2;
+        }
+
+        const char *shape = line + consumed;
+        bool added = false;
+        if (strcmp(type, "circle") == 0)
+        {
+            double latitude, longitude, radius;
+            if (sscanf(shape, "%lf,%lf,%lf", &latitude, &longitude, &radius) != 3 || radius <= 0)
+            {
+                fprintf(stderr, "Line %u: expected <latitude>,<longitude>,<radius>\n", number);
+                return 2;
+            }
+            added = fences.addCircle(id, name, lround(latitude * 1e7), lround(longitude * 1e7), lround(radius));
+            printf("%5u %-24s circle  %8.0f m\n", id, name, radius);
+        }
+        else if (strcmp(type, "polygon") == 0)
+        {
+            std::vector<Geofence::vertex_t> vertices;
+            for (char *vertex = strtok((char *)shape, ";"); vertex != NULL; vertex = strtok(NULL, ";"))
+            {
+                double latitude, longitude;
+                if (sscanf(vertex, "%lf %lf", &latitude, &longitude) != 2)
+                {
+                    fprintf(stderr, "Line %u: expected <latitude> <longitude> in %s\n", number, vertex);
+                    return 2;
+                }
+                vertices.push_back({ (int32_t)lround(latitude * 1e7), (int32_t)lround(longitude * 1e7) });
+            }
+            added = vertices.size() <= UINT16_MAX && fences.addPolygon(id, name, vertices.data(), vertices.size());
+            printf("%5u %-24s polygon %8zu vertices\n", id, name, vertices.size());
+        }
+        else
+        {
+            fprintf(stderr, "Line %u: unknown type %s\n", number, type);
+            return 2;
+        }
+
+        if (!added)
+        {
+            fprintf(stderr, "Line %u: could not add %s (name longer than %u characters or with '\"' or '\\', or partition full)\n",
+                    number, name, GEOFENCE_NAME_MAX - 1);
+            return 1;
+        }
+    }
+    fclose(input);
+    printf("%u fences in %u grid cells\n", fences.count(), fences.gridCells());
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)GEOFENCE_PARTITION_SUBTYPE, "fences");
+    std::vector<uint8_t> image(size);
+    esp_partition_read(partition, 0, image.data(), image.size());
+
+    FILE *output = fopen(argv[1], "wb");
+    if (output == NULL || fwrite(image.data(), 1, image.size(), output) != image.size() || fclose(output) != 0)
+    {
+        fprintf(stderr, "Could not write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
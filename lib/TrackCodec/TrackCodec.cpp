@@ -0,0 +1,195 @@
+#include "TrackCodec.h"
+
+#include <string.h>
+
+static size_t putUint32(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+    return 4;
+}
+
+static uint32_t getUint32(const uint8_t *p)
+{
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static size_t putVarint(uint8_t *p, uint32_t value)
+{
+    size_t length = 0;
+
+    while (value >= 0x80)
+    {
+        p[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    p[length++] = value;
+    return length;
+}
+
+static bool getVarint(const uint8_t *buffer, size_t length, size_t &position, uint32_t &value)
+{
+    value = 0;
+
+    for (uint8_t shift = 0; shift < 35 && position < length; shift += 7)
+    {
+        uint8_t byte = buffer[position++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * @brief Construct a new Encoder object.
+ * 
+ * @param buffer    Buffer for the encoded fixes. Must stay valid while the object is used.
+ * @param size      Size of the buffer.
+ */
+TrackCodec::Encoder::Encoder(uint8_t *buffer, size_t size) : buffer(buffer), size(size)
+{
+    clear();
+}
+
+/**
+ * @brief Removes all the fixes.
+ * 
+ */
+void TrackCodec::Encoder::clear()
+{
+    used = (size >= 2) ? 2 : 0;
+    count = 0;
+    if (used)
+    {
+        buffer[0] = VERSION;
+        buffer[1] = 0;
+    }
+}
+
+/**
+ * @brief Adds a fix.
+ * 
+ * @param fix       Fix to be added.
+ * @return true     If the fix was added.
+ * @return false    If the fix does not fit in the buffer, or there are 255 fixes. Nothing is written.
+ */
+bool TrackCodec::Encoder::add(const fix_t &fix)
+{
+    uint8_t scratch[FIX_MAX_LENGTH];
+    size_t length = 0;
+
+    if (used == 0 || count == 255)
+        return false;
+
+    if (count == 0)
+    {
+        length += putUint32(scratch + length, fix.sequence);
+        length += putUint32(scratch + length, fix.timestamp);
+        length += putUint32(scratch + length, fix.latitude);
+        length += putUint32(scratch + length, fix.longitude);
+        length += putVarint(scratch + length, fix.speed);
+        length += putVarint(scratch + length, fix.course);
+        length += putVarint(scratch + length, fix.battery);
+    }
+    else
+    {
+        length += putVarint(scratch + length, zigzag(fix.sequence - previous.sequence));
+        length += putVarint(scratch + length, zigzag((int32_t)((uint32_t)fix.timestamp - (uint32_t)previous.timestamp)));
+        length += putVarint(scratch + length, zigzag((int32_t)((uint32_t)fix.latitude - (uint32_t)previous.latitude)));
+        length += putVarint(scratch + length, zigzag((int32_t)((uint32_t)fix.longitude - (uint32_t)previous.longitude)));
+        length += putVarint(scratch + length, fix.speed);
+        length += putVarint(scratch + length, zigzag((int32_t)fix.course - previous.course));
+        length += putVarint(scratch + length, zigzag((int32_t)fix.battery - previous.battery));
+    }
+
+    if (used + length > size)
+        return false;
+
+    memcpy(buffer + used, scratch, length);
+    used += length;
+    buffer[1] = ++count;
+    previous = fix;
+    return true;
+}
+
+/**
+ * @brief Construct a new Decoder object. valid() is false if the header is not supported.
+ * 
+ * @param buffer    Encoded fixes.
+ * @param length    Length of the encoded fixes.
+ */
+TrackCodec::Decoder::Decoder(const uint8_t *buffer, size_t length)
+    : buffer(buffer), length(length), position(2), count(0), decoded(0), ok(false)
+{
+    if (length >= 2 && buffer[0] == VERSION)
+    {
+        count = buffer[1];
+        ok = true;
+    }
+}
+
+/**
+ * @brief Decodes the next fix.
+ * 
+ * @param fix       Decoded fix.
+ * @return true     If a fix was decoded.
+ * @return false    If all the fixes were decoded, or the data is truncated or invalid (valid() is then false).
+ */
+bool TrackCodec::Decoder::next(fix_t &fix)
+{
+    if (!ok || decoded == count)
+        return false;
+
+    uint32_t values[7];
+
+    if (decoded == 0)
+    {
+        if (position + 16 > length)
+            return ok = false;
+
+        for (uint8_t i = 0; i < 4; i++, position += 4)
+            values[i] = getUint32(buffer + position);
+        for (uint8_t i = 4; i < 7; i++)
+            if (!getVarint(buffer, length, position, values[i]))
+                return ok = false;
+
+        fix.sequence = values[0];
+        fix.timestamp = values[1];
+        fix.latitude = values[2];
+        fix.longitude = values[3];
+        fix.speed = values[4];
+        fix.course = values[5];
+        fix.battery = values[6];
+    }
+    else
+    {
+        for (uint8_t i = 0; i < 7; i++)
+            if (!getVarint(buffer, length, position, values[i]))
+                return ok = false;
+
+        fix.sequence = previous.sequence + unzigzag(values[0]);
+        fix.timestamp = (int32_t)((uint32_t)previous.timestamp + (uint32_t)unzigzag(values[1]));
+        fix.latitude = (int32_t)((uint32_t)previous.latitude + (uint32_t)unzigzag(values[2]));
+        fix.longitude = (int32_t)((uint32_t)previous.longitude + (uint32_t)unzigzag(values[3]));
+        fix.speed = values[4];
+        fix.course = previous.course + unzigzag(values[5]);
+        fix.battery = previous.battery + unzigzag(values[6]);
+    }
+
+    decoded++;
+    previous = fix;
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef TRACKCODEC_H
+#define TRACKCODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Compact binary encoding of a batch of fixes, shared by the tracker (encoder) and the backend (decoder).
+ * It does not depend on Arduino, so it can be built as is on any platform.
+ * 
+ * Format (version 1), all integers little-endian:
+ *   [0]     Version.
+ *   [1]     Number of fixes.
+ *   First fix:  sequence (uint32), timestamp (int32), latitude (int32), longitude (int32),
+ *               speed (varint), course (varint), battery (varint).
+ *   Next fixes: zigzag varint deltas against the previous fix of sequence, timestamp, latitude,
+ *               longitude and course, speed (varint) and zigzag varint delta of battery.
+ * Latitude and longitude are degrees x 1e7, speed is km/h x 100, course is degrees x 100 and
+ * battery is mV, the same units as TrackBuffer::record_t, so decoding is exact.
+ */
+class TrackCodec
+{
+    public:
+        static const uint8_t VERSION = 1;
+        static const uint8_t FIX_MAX_LENGTH = 35;   // Worst case length of one encoded fix.
+
+        typedef struct
+        {
+            uint32_t sequence;
+            int32_t timestamp;
+            int32_t latitude;
+            int32_t longitude;
+            uint16_t speed;
+            uint16_t course;
+            uint16_t battery;
+        }fix_t;
+
+        class Encoder
+        {
+            public:
+                Encoder(uint8_t *buffer, size_t size);
+
+                bool add(const fix_t &fix);
+                void clear();
+                size_t length() const { return used; }
+                uint8_t fixes() const { return count; }
+
+            private:
+                uint8_t *buffer;
+                size_t size;
+                size_t used;
+                uint8_t count;
+                fix_t previous;
+        };
+
+        class Decoder
+        {
+            public:
+                Decoder(const uint8_t *buffer, size_t length);
+
+                bool valid() const { return ok; }
+                uint8_t fixes() const { return count; }
+                bool next(fix_t &fix);
+
+            private:
+                const uint8_t *buffer;
+                size_t length;
+                size_t position;
+                uint8_t count;
+                uint8_t decoded;
+                bool ok;
+                fix_t previous;
+        };
+};
+
+#endif
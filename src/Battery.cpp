@@ -0,0 +1,59 @@
+#include "Battery.h"
+
+#include <algorithm>
+
+#define BATTERY_OVERSAMPLING_MAX 32
+
+/**
+ * @brief Configures the ADC and the divider MOSFET, computes the ADC calibration and takes the
+ * first sample.
+ * 
+ */
+void Battery::begin()
+{
+    gpio_reset_pin(config.enable);
+    gpio_set_direction(config.enable, GPIO_MODE_OUTPUT);
+
+    adc_set_clk_div(1);
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten(config.channel, ADC_ATTEN_DB_6);
+
+    esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_6, ADC_WIDTH_BIT_12, 1100, &calibration);
+
+    sample();
+}
+
+/**
+ * @brief Reads the battery voltage and updates the filtered value and the low state.
+ * Blocks for the settle time of the divider, so it is only called by the battery monitor task.
+ * 
+ * @return double   Filtered battery voltage.
+ */
+double Battery::sample()
+{
+    int readings[BATTERY_OVERSAMPLING_MAX];
+    uint8_t count = std::min<uint8_t>(std::max<uint8_t>(config.oversampling, 1), BATTERY_OVERSAMPLING_MAX);
+
+    gpio_set_level(config.enable, 1);
+    vTaskDelay(config.settle / portTICK_PERIOD_MS);
+
+    for (uint8_t i = 0; i < count; i++)
+        readings[i] = adc1_get_raw(config.channel);
+
+    gpio_set_level(config.enable, 0);
+
+    // The median rejects the single readings disturbed by the modem's current peaks.
+    std::nth_element(readings, readings + count / 2, readings + count);
+    uint32_t millivolts = esp_adc_cal_raw_to_voltage(readings[count / 2], &calibration);
+    double voltage = config.slope * (millivolts / 1000.0) + config.offset;
+
+    filtered = (latest.load(std::memory_order_relaxed) == 0) ? voltage : config.alpha * voltage + (1 - config.alpha) * filtered;
+    latest.store(filtered * 1000.0, std::memory_order_relaxed);
+
+    if (filtered < config.cutoff)
+        low.store(true, std::memory_order_relaxed);
+    else if (filtered > config.cutoff + config.hysteresis)
+        low.store(false, std::memory_order_relaxed);
+
+    return filtered;
+}
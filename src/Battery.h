@@ -0,0 +1,48 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include "Arduino.h"
+#include "driver/adc.h"
+#include "esp_adc_cal.h"
+#include <atomic>
+
+/**
+ * Battery voltage from the voltage divider, which is enabled through a MOSFET only while sampling.
+ * 
+ * The ADC calibration is computed once in begin(). Every sample() reads the ADC several times and
+ * takes the median, which is then smoothed with an exponential moving average. The filtered value
+ * is kept in an atomic, so voltage() can be read from any task without waiting for the ADC.
+ * isLow() compares the filtered value with the cutoff, with hysteresis.
+ */
+class Battery
+{
+    public:
+        typedef struct
+        {
+            adc1_channel_t channel;
+            gpio_num_t enable;          // MOSFET of the voltage divider.
+            float slope;                // Battery voltage per ADC voltage.
+            float offset;               // V
+            uint32_t settle;            // ms after enabling the divider.
+            uint8_t oversampling;       // ADC readings per sample (median).
+            float alpha;                // Weight of a new sample in the moving average.
+            float cutoff;               // V
+            float hysteresis;           // V above the cutoff to leave the low state.
+        }config_t;
+
+        Battery(const config_t &config) : config(config) {}
+
+        void begin();
+        double sample();
+        double voltage() const { return latest.load(std::memory_order_relaxed) / 1000.0; }
+        bool isLow() const { return low.load(std::memory_order_relaxed); }
+
+    private:
+        config_t config;
+        esp_adc_cal_characteristics_t calibration;
+        double filtered = 0;
+        std::atomic<uint32_t> latest{0};    // mV
+        std::atomic<bool> low{false};
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "BootProfile.h"
+
+#include <stdio.h>
+
+static const char *const names[BootProfile::PHASE_COUNT] =
+{
+    "sim_ready", "gnss_on", "certificates", "registered", "connected", "first_fix", "first_publish"
+};
+
+const char *BootProfile::name(phase_t phase)
+{
+    return phase < PHASE_COUNT ? names[phase] : "unknown";
+}
+
+/**
+ * @brief Mark the phase as reached, if it was not already.
+ * 
+ * @param phase     Phase reached.
+ * @param now       Time in ms since the start.
+ * @return true     If this is the first time the phase is reached.
+ */
+bool BootProfile::mark(phase_t phase, uint32_t now)
+{
+    if (phase >= PHASE_COUNT || marks[phase] != 0)
+        return false;
+
+    // 0 means not reached, so a phase reached in the first millisecond is marked at 1 ms.
+    marks[phase] = now != 0 ? now : 1;
+    return true;
+}
+
+/**
+ * @brief Write the phases as a JSON object, e.g. {"sim_ready":4212,"gnss_on":4340,...}. The phases
+ * not reached yet are null.
+ * 
+ * @return size_t   Length written. 0 if it does not fit.
+ */
+size_t BootProfile::toJSON(char *buffer, size_t size) const
+{
+    size_t length = 0;
+
+    for (uint8_t i = 0; i < PHASE_COUNT; i++)
+    {
+        int written = marks[i] != 0
+                          ? snprintf(buffer + length, size - length, "%c\"%s\":%lu", i == 0 ? '{' : ',', names[i], (unsigned long)marks[i])
+                          : snprintf(buffer + length, size - length, "%c\"%s\":null", i == 0 ? '{' : ',', names[i]);
+        if (written < 0 || length + written >= size)
+            return 0;
+        length += written;
+    }
+
+    if (length + 1 >= size)
+        return 0;
+    buffer[length++] = '}';
+    buffer[length] = '\0';
+    return length;
+}
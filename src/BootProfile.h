@@ -0,0 +1,39 @@
+#ifndef BOOTPROFILE_H
+#define BOOTPROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Time of each boot phase (in ms since the start), to see where the time to the first publish goes.
+ * The phases overlap: GNSS acquires while the modem registers and connects to the broker, so the
+ * first fix may come before or after the connection. Each phase is marked once, by the task which
+ * reaches it first; the marks are 32 bit writes, so other tasks may read them at any time.
+ */
+class BootProfile
+{
+    public:
+        typedef enum
+        {
+            PHASE_SIM_READY = 0,        // "+CPIN: READY", the modem accepts commands.
+            PHASE_GNSS_ON,              // GNSS started, acquiring from now on.
+            PHASE_CERTIFICATES,         // Certificates in the modem.
+            PHASE_REGISTERED,           // Registered to the packet domain.
+            PHASE_CONNECTED,            // Connected to the MQTT broker.
+            PHASE_FIRST_FIX,
+            PHASE_FIRST_PUBLISH,
+            PHASE_COUNT
+        }phase_t;
+
+        bool mark(phase_t phase, uint32_t now);
+        bool done(phase_t phase) const { return marks[phase] != 0; }
+        uint32_t at(phase_t phase) const { return marks[phase]; }
+        size_t toJSON(char *buffer, size_t size) const;
+
+        static const char *name(phase_t phase);
+
+    private:
+        volatile uint32_t marks[PHASE_COUNT] = {};  // 0 until the phase is reached.
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "CertStore.h"
+
+#include <string.h>
+
+#define DIRECTORY_MAGIC 0x31545243      // "CRT1"
+#define PROVISIONED_MAGIC 0x31564F50    // "POV1"
+#define DATA_OFFSET CERT_SECTOR_SIZE
+#define WRITE_ALIGN 16
+
+/**
+ * @brief Finds the partition and reads the directory and the provisioned hashes.
+ * 
+ * @param label     Label of the partition in partitions.csv.
+ * @return true     If the partition was found.
+ * @return false    If the partition is missing.
+ */
+bool CertStore::begin(const char *label)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)CERT_PARTITION_SUBTYPE, label);
+    if (partition == NULL)
+        return false;
+
+    if (esp_partition_read(partition, 0, &directory, sizeof(directory)) != ESP_OK || directory.magic != DIRECTORY_MAGIC ||
+        directory.count > CERT_STORE_MAX)
+        memset(&directory, 0, sizeof(directory));
+
+    if (esp_partition_read(partition, partition->size - CERT_SECTOR_SIZE, &provisioned, sizeof(provisioned)) != ESP_OK ||
+        provisioned.magic != PROVISIONED_MAGIC)
+        memset(&provisioned, 0, sizeof(provisioned));
+
+    return true;
+}
+
+/**
+ * @brief Reads a part of a file.
+ * 
+ * @param i         Index of the file.
+ * @param offset    Offset in the file.
+ * @param buffer    Output buffer.
+ * @param size      Number of bytes.
+ * @return true     If the bytes are inside the file and were read.
+ */
+bool CertStore::read(uint8_t i, uint32_t offset, uint8_t *buffer, size_t size) const
+{
+    if (partition == NULL || i >= directory.count || offset + size > directory.entries[i].length)
+        return false;
+
+    return esp_partition_read(partition, directory.entries[i].offset + offset, buffer, size) == ESP_OK;
+}
+
+/**
+ * @brief Records that the file is (or is not) in the modem with its current content.
+ * 
+ */
+bool CertStore::setProvisioned(uint8_t i, bool done)
+{
+    if (i >= directory.count)
+        return false;
+
+    uint32_t hash = done ? directory.entries[i].hash : 0;
+    if (provisioned.hash[i] == hash && provisioned.magic == PROVISIONED_MAGIC)
+        return true;
+
+    provisioned.magic = PROVISIONED_MAGIC;
+    provisioned.hash[i] = hash;
+    return writeSector(partition->size / CERT_SECTOR_SIZE - 1, &provisioned, sizeof(provisioned));
+}
+
+/**
+ * @brief Erases the directory and the files. The provisioned hashes are kept, so the files which
+ * are added again with the same content are not downloaded again.
+ * 
+ */
+bool CertStore::format()
+{
+    if (partition == NULL || esp_partition_erase_range(partition, 0, partition->size - CERT_SECTOR_SIZE) != ESP_OK)
+        return false;
+
+    memset(&directory, 0, sizeof(directory));
+    directory.magic = DIRECTORY_MAGIC;
+    return writeSector(0, &directory, sizeof(directory));
+}
+
+/**
+ * @brief Appends a file and rewrites the directory. The partition must have been formatted.
+ * 
+ * @param name      File name in the modem (e.g. "Amazon-Root-Certificate-Filename").
+ * @param data      Content of the file.
+ * @param length    Length of the content.
+ * @return true     If the file was added.
+ * @return false    If the directory or the partition is full.
+ */
+bool CertStore::add(const char *name, const uint8_t *data, size_t length)
+{
+    if (partition == NULL || directory.count >= CERT_STORE_MAX || strlen(name) >= CERT_NAME_MAX || length == 0)
+        return false;
+
+    uint32_t offset = DATA_OFFSET;
+    if (directory.count > 0)
+    {
+        const entry_t &last = directory.entries[directory.count - 1];
+        offset = (last.offset + last.length + WRITE_ALIGN - 1) & ~(WRITE_ALIGN - 1);
+    }
+    if (offset + length > partition->size - CERT_SECTOR_SIZE)
+        return false;
+
+    // Full blocks first, then the tail padded with 0xFF to the write alignment.
+    size_t aligned = length & ~(WRITE_ALIGN - 1);
+    uint8_t tail[WRITE_ALIGN];
+
+    if (aligned > 0 && esp_partition_write(partition, offset, data, aligned) != ESP_OK)
+        return false;
+    if (aligned < length)
+    {
+        memset(tail, 0xFF, sizeof(tail));
+        memcpy(tail, data + aligned, length - aligned);
+        if (esp_partition_write(partition, offset + aligned, tail, sizeof(tail)) != ESP_OK)
+            return false;
+    }
+
+    entry_t &entry = directory.entries[directory.count];
+    memset(&entry, 0, sizeof(entry));
+    strcpy(entry.name, name);
+    entry.offset = offset;
+    entry.length = length;
+    entry.hash = hash(data, length);
+    directory.count++;
+
+    return writeSector(0, &directory, sizeof(directory));
+}
+
+/**
+ * @brief FNV-1a hash, which can be computed chunk by chunk by passing the previous result.
+ * 
+ */
+uint32_t CertStore::hash(const uint8_t *data, size_t length, uint32_t hash)
+{
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+bool CertStore::writeSector(uint32_t sector, const void *data, size_t size)
+{
+    return esp_partition_erase_range(partition, sector * CERT_SECTOR_SIZE, CERT_SECTOR_SIZE) == ESP_OK &&
+           esp_partition_write(partition, sector * CERT_SECTOR_SIZE, data, size) == ESP_OK;
+}
@@ -0,0 +1,72 @@
+#ifndef CERTSTORE_H
+#define CERTSTORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_partition.h"
+
+#define CERT_PARTITION_SUBTYPE 0x41
+#define CERT_SECTOR_SIZE 4096
+#define CERT_STORE_MAX 4            // Certificates and keys in the partition.
+#define CERT_NAME_MAX 48            // File name in the modem, with the terminating null.
+
+/**
+ * Certificates and keys in a raw flash partition (encrypted with flash encryption), to be
+ * downloaded into the SIM7600 (see SSL::downloadCertificates).
+ * 
+ * Sector 0 holds the directory: name, offset, length and FNV-1a hash of every file. The files
+ * follow from sector 1, 16-byte aligned as needed for encrypted writes. The last sector holds the
+ * hash of every file as last downloaded into the modem, so unchanged files are not sent again.
+ * It is outside the image, so it is kept when a new image is flashed. Only the directory is kept
+ * in RAM; the files are read in chunks.
+ */
+class CertStore
+{
+    public:
+        typedef struct
+        {
+            char name[CERT_NAME_MAX];
+            uint32_t offset;
+            uint32_t length;
+            uint32_t hash;          // FNV-1a of the content.
+        }entry_t;
+
+        bool begin(const char *label = "certs");
+        uint8_t count() const { return directory.count; }
+        const entry_t &entry(uint8_t i) const { return directory.entries[i]; }
+        bool read(uint8_t i, uint32_t offset, uint8_t *buffer, size_t size) const;
+        bool isProvisioned(uint8_t i) const { return provisioned.hash[i] == directory.entries[i].hash; }
+        bool setProvisioned(uint8_t i, bool done = true);
+
+        // Writing the image (host tool or factory firmware).
+        bool format();
+        bool add(const char *name, const uint8_t *data, size_t length);
+
+        static uint32_t hash(const uint8_t *data, size_t length, uint32_t hash = 2166136261u);
+
+    private:
+        typedef struct
+        {
+            uint32_t magic;
+            uint32_t count;
+            entry_t entries[CERT_STORE_MAX];
+            uint8_t padding[8];     // Size multiple of 16 for encrypted writes.
+        }directory_t;
+
+        typedef struct
+        {
+            uint32_t magic;
+            uint32_t hash[CERT_STORE_MAX];
+            uint8_t padding[12];
+        }provisioned_t;
+
+        static_assert(sizeof(directory_t) % 16 == 0 && sizeof(provisioned_t) % 16 == 0, "Encrypted writes need 16-byte blocks");
+
+        bool writeSector(uint32_t sector, const void *data, size_t size);
+
+        const esp_partition_t *partition = NULL;
+        directory_t directory = {};
+        provisioned_t provisioned = {};
+};
+
+#endif
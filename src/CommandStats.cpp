@@ -0,0 +1,135 @@
+#include "CommandStats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Bucket of a latency: 0 to 3 ms have their own bucket, then 4 buckets per power of two.
+ * 
+ */
+uint8_t LatencyHistogram::bucket(uint32_t ms)
+{
+    if (ms < 4)
+        return ms;
+
+    uint8_t exponent = 31 - __builtin_clz(ms);
+    uint8_t index = (exponent - 1) * 4 + ((ms >> (exponent - 2)) & 3);
+
+    return (index < LATENCY_BUCKETS) ? index : LATENCY_BUCKETS - 1;
+}
+
+/**
+ * @brief Largest latency (in ms) counted in the bucket.
+ * 
+ */
+uint32_t LatencyHistogram::upperBound(uint8_t bucket)
+{
+    if (bucket < 4)
+        return bucket;
+
+    uint8_t exponent = bucket / 4 + 1;
+    uint32_t lower = (uint32_t)(4 + bucket % 4) << (exponent - 2);
+
+    return lower + (1UL << (exponent - 2)) - 1;
+}
+
+void LatencyHistogram::add(uint32_t ms)
+{
+    uint16_t &count = buckets[bucket(ms)];
+
+    if (count < UINT16_MAX)
+        count++;
+    total++;
+    if (ms > maximum)
+        maximum = ms;
+}
+
+/**
+ * @brief Latency (in ms) below which the fraction p of the samples are, rounded up to the bucket.
+ * 
+ * @param p     Fraction, from 0 to 1.
+ */
+uint32_t LatencyHistogram::percentile(float p) const
+{
+    uint32_t samples = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+        samples += buckets[i];
+
+    uint32_t rank = p * samples + 0.5f;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank && seen > 0)
+            return (upperBound(i) < maximum) ? upperBound(i) : maximum;
+    }
+    return maximum;
+}
+
+/**
+ * @brief Adds the latency and result of a command.
+ * 
+ * @param command   AT command as sent.
+ * @param ms        Time from sending the command to its terminator.
+ * @param timeout   Set it to 'true' if no terminator was received.
+ * @param error     Set it to 'true' for "ERROR" or "+CME ERROR".
+ */
+void CommandStats::record(const char *command, uint32_t ms, bool timeout, bool error)
+{
+    size_t length = strcspn(command, "=?");
+    if (command[length] != '\0')
+        length++;
+    if (length >= COMMAND_NAME_MAX)
+        length = COMMAND_NAME_MAX - 1;
+
+    uint8_t i;
+    for (i = 0; i < used; i++)
+        if (strncmp(entries[i].name, command, length) == 0 && entries[i].name[length] == '\0')
+            break;
+
+    if (i == used)
+    {
+        if (used < COMMAND_STATS_MAX - 1)
+        {
+            memcpy(entries[i].name, command, length);
+            entries[i].name[length] = '\0';
+            used++;
+        }
+        else
+        {
+            i = COMMAND_STATS_MAX - 1;
+            strcpy(entries[i].name, "other");
+            used = COMMAND_STATS_MAX;
+        }
+    }
+
+    entries[i].latency.add(ms);
+    entries[i].timeouts += timeout;
+    entries[i].errors += error;
+}
+
+/**
+ * @brief Writes the statistics as a JSON array: count, timeouts, errors and the 50th, 90th and
+ * 99th percentile and maximum latency (in ms) for every command.
+ * 
+ * @return size_t   Length written, or 0 if the buffer is too small.
+ */
+size_t CommandStats::toJSON(char *buffer, size_t size) const
+{
+    size_t length = snprintf(buffer, size, "[");
+
+    for (uint8_t i = 0; i < used && length < size; i++)
+    {
+        const entry_t &e = entries[i];
+        length += snprintf(buffer + length, size - length,
+                           "%s{\"cmd\":\"%s\",\"n\":%lu,\"timeouts\":%lu,\"errors\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu}",
+                           i ? "," : "", e.name, (unsigned long)e.latency.count(), (unsigned long)e.timeouts, (unsigned long)e.errors,
+                           (unsigned long)e.latency.percentile(0.5), (unsigned long)e.latency.percentile(0.9),
+                           (unsigned long)e.latency.percentile(0.99), (unsigned long)e.latency.max());
+    }
+
+    if (length < size)
+        length += snprintf(buffer + length, size - length, "]");
+
+    return (length < size) ? length : 0;
+}
@@ -0,0 +1,58 @@
+#ifndef COMMANDSTATS_H
+#define COMMANDSTATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LATENCY_BUCKETS 60          // Log-linear buckets from 0 ms to 64 s.
+#define COMMAND_STATS_MAX 24        // Commands with their own histogram. The others share the last one.
+#define COMMAND_NAME_MAX 20
+
+/**
+ * Histogram of latencies (in ms) in fixed memory. Below 4 ms every value has its own bucket,
+ * above it every power of two is split in 4 buckets, so the error of a percentile is below 25 %.
+ */
+class LatencyHistogram
+{
+    public:
+        void add(uint32_t ms);
+        uint32_t count() const { return total; }
+        uint32_t max() const { return maximum; }
+        uint32_t percentile(float p) const;
+
+        static uint8_t bucket(uint32_t ms);
+        static uint32_t upperBound(uint8_t bucket);
+
+    private:
+        uint16_t buckets[LATENCY_BUCKETS] = {};     // Saturate at UINT16_MAX.
+        uint32_t total = 0;
+        uint32_t maximum = 0;
+};
+
+/**
+ * Latency histogram, timeouts and errors for every AT command, from sending it to its terminator.
+ * Commands are grouped by their name up to the first '=' or '?' (e.g. "AT+CMQTTPUB=", "AT+CGPS?").
+ * Only the modem I/O task records. A snapshot taken by another task may miss the latest command.
+ */
+class CommandStats
+{
+    public:
+        typedef struct
+        {
+            char name[COMMAND_NAME_MAX];
+            LatencyHistogram latency;
+            uint32_t timeouts;
+            uint32_t errors;
+        }entry_t;
+
+        void record(const char *command, uint32_t ms, bool timeout, bool error);
+        uint8_t size() const { return used; }
+        const entry_t &entry(uint8_t i) const { return entries[i]; }
+        size_t toJSON(char *buffer, size_t size) const;
+
+    private:
+        entry_t entries[COMMAND_STATS_MAX] = {};
+        uint8_t used = 0;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "DeadBandFilter.h"
+
+// Metres per degree of latitude (mean Earth radius of 6371 km).
+#define METRES_PER_DEGREE 111194.93
+
+/**
+ * @brief Decides if the fix has to be published. Fixes without a position are never published.
+ * 
+ * @param data      Latest fix from the GPS Modem.
+ * @param now       Time (in ms) of the fix.
+ * @return true     If the fix has to be published.
+ * @return false    If the fix is within tolerance of the prediction.
+ */
+bool DeadBandFilter::update(const GPS::data_t &data, uint32_t now)
+{
+    if (!(data.valid & GPS::VALID_POSITION))
+        return false;
+
+    counters.fixes++;
+
+    if (published && now - lastTime < config.maxSilence)
+    {
+        double error = predictionError(data, now);
+        if (error <= config.tolerance)
+        {
+            counters.suppressed++;
+            if (error > counters.maxError)
+                counters.maxError = error;
+            return false;
+        }
+    }
+
+    published = true;
+    lastTime = now;
+    lastLatitude = data.latitude();
+    lastLongitude = data.longitude();
+    lastSpeed = (data.valid & GPS::VALID_SPEED) ? data.speedCms / 100.0 : 0;
+    lastCourse = (data.valid & GPS::VALID_COURSE) ? data.course() : 0;
+    counters.published++;
+    return true;
+}
+
+/**
+ * @brief Distance (in m) between the fix and the position predicted from the last published fix.
+ * 
+ * An equirectangular projection around the last published fix is used, which is accurate to
+ * well below a metre over the few kilometres between two published fixes.
+ */
+double DeadBandFilter::predictionError(const GPS::data_t &data, uint32_t now) const
+{
+    double travelled = lastSpeed * (now - lastTime) / 1000.0;
+    double course = lastCourse * M_PI / 180.0;
+
+    double north = (data.latitude() - lastLatitude) * METRES_PER_DEGREE - travelled * cos(course);
+    double east = (data.longitude() - lastLongitude) * METRES_PER_DEGREE * cos(lastLatitude * M_PI / 180.0) - travelled * sin(course);
+
+    return sqrt(north * north + east * east);
+}
@@ -0,0 +1,50 @@
+#ifndef DEADBANDFILTER_H
+#define DEADBANDFILTER_H
+
+#include "Arduino.h"
+#include "SIM7600.h"
+
+/**
+ * Suppresses fixes which the backend can rebuild from the last published fix.
+ * 
+ * The position is predicted from the last published fix, assuming constant speed and course. A fix
+ * is published only if it is more than tolerance metres away from the prediction, or if nothing was
+ * published for maxSilence. The backend rebuilds a suppressed fix with the same prediction, within
+ * tolerance metres. Only the last published fix is kept, so the memory used is constant.
+ */
+class DeadBandFilter
+{
+    public:
+        typedef struct
+        {
+            float tolerance;            // m
+            uint32_t maxSilence;        // ms
+        }config_t;
+
+        typedef struct
+        {
+            uint32_t fixes;
+            uint32_t published;
+            uint32_t suppressed;
+            float maxError;             // m. Largest error of a suppressed fix.
+        }stats_t;
+
+        DeadBandFilter(const config_t &config) : config(config) {}
+
+        bool update(const GPS::data_t &data, uint32_t now);
+        double predictionError(const GPS::data_t &data, uint32_t now) const;
+        const stats_t &stats() const { return counters; }
+        float suppressionRatio() const { return counters.fixes ? (float)counters.suppressed / counters.fixes : 0; }
+
+    private:
+        config_t config;
+        bool published = false;
+        uint32_t lastTime = 0;
+        double lastLatitude = 0;
+        double lastLongitude = 0;
+        double lastSpeed = 0;           // m/s
+        double lastCourse = 0;          // degrees
+        stats_t counters = {};
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "EnergyModel.h"
+
+/**
+ * @brief Counts the time since the last update in the previous state and sets the new state.
+ * The first update only sets the state.
+ * 
+ * @param state     Power state from now on.
+ * @param gnss      Set it to 'true' if the GNSS engine is on from now on.
+ * @param now       Time (in ms).
+ */
+void EnergyModel::update(state_t state, bool gnss, uint32_t now)
+{
+    uint32_t elapsed = started ? now - last : 0;
+
+    time[current] += elapsed;
+    if (this->gnss)
+        gnssOn += elapsed;
+
+    current = state;
+    this->gnss = gnss;
+    last = now;
+    started = true;
+}
+
+/**
+ * @brief Charge (in mAh) drawn until the last update.
+ * 
+ */
+double EnergyModel::charge() const
+{
+    double mAms = gnssOn * (double)config.gnssCurrent;
+
+    for (uint8_t i = 0; i < STATE_COUNT; i++)
+        mAms += time[i] * (double)config.current[i];
+
+    return mAms / 3600000.0;
+}
+
+/**
+ * @brief Average current (in mA) until the last update.
+ * 
+ */
+double EnergyModel::averageCurrent() const
+{
+    uint64_t total = 0;
+    for (uint8_t i = 0; i < STATE_COUNT; i++)
+        total += time[i];
+
+    return total ? charge() * 3600000.0 / total : 0;
+}
+
+/**
+ * @brief Predicted runtime (in hours) of a full charge at the average current.
+ * 
+ */
+double EnergyModel::runtime() const
+{
+    double current = averageCurrent();
+    return current > 0 ? config.capacity / current : 0;
+}
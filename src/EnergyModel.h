@@ -0,0 +1,50 @@
+#ifndef ENERGYMODEL_H
+#define ENERGYMODEL_H
+
+#include "Arduino.h"
+
+/**
+ * Estimates the charge drawn from the battery from the time spent in each power state and the
+ * current of the board in that state, and predicts the runtime per charge.
+ * 
+ * The currents are configured (measure them on the board), the times are counted from the state
+ * changes passed to update(). The GNSS current is added while the GNSS engine is on.
+ */
+class EnergyModel
+{
+    public:
+        typedef enum
+        {
+            STATE_ACTIVE = 0,       // ESP32 running, modem awake.
+            STATE_SLEEP,            // ESP32 in light sleep, modem in sleep mode.
+            STATE_OFF,              // Modem switched off.
+            STATE_COUNT
+        }state_t;
+
+        typedef struct
+        {
+            float current[STATE_COUNT];     // mA
+            float gnssCurrent;              // mA, added while the GNSS engine is on.
+            float capacity;                 // mAh of a full charge.
+        }config_t;
+
+        EnergyModel(const config_t &config) : config(config) {}
+
+        void update(state_t state, bool gnss, uint32_t now);
+        uint64_t timeIn(state_t state) const { return time[state]; }
+        uint64_t gnssTime() const { return gnssOn; }
+        double charge() const;
+        double averageCurrent() const;
+        double runtime() const;
+
+    private:
+        config_t config;
+        state_t current = STATE_ACTIVE;
+        bool gnss = false;
+        bool started = false;
+        uint32_t last = 0;
+        uint64_t time[STATE_COUNT] = {};    // ms
+        uint64_t gnssOn = 0;                // ms
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "GNSSPolicy.h"
+
+#include <stdio.h>
+
+static const char *const names[GNSSPolicy::START_COUNT] = { "hot", "warm", "cold" };
+
+const char *GNSSPolicy::name(start_t start)
+{
+    return start < START_COUNT ? names[start] : "unknown";
+}
+
+/**
+ * @brief Sets the fix persisted before the reboot.
+ * 
+ * @param timestamp     Unix timestamp of the fix, or 0 if there is none.
+ * @param position      Set it to 'true' if the fix has a position.
+ */
+void GNSSPolicy::restore(time_t timestamp, bool position)
+{
+    lastFix = timestamp;
+    this->position = position && timestamp != 0;
+}
+
+/**
+ * @brief Chooses the start from the age of the last fix.
+ * 
+ * @param now       millis().
+ * @param clock     Unix time of the modem clock, or 0 if it is not set. Only used without a fix in this run.
+ */
+GNSSPolicy::start_t GNSSPolicy::choose(uint32_t now, time_t clock) const
+{
+    uint32_t age;
+
+    if (fixInRun)
+        age = (now - lastFixAt) / 1000;
+    else if (lastFix != 0 && clock >= lastFix)
+        age = clock - lastFix;
+    else
+        return position ? START_WARM : START_COLD;
+
+    if (age <= config.hotMaxAge)
+        return START_HOT;
+    return (position && age <= config.warmMaxAge) ? START_WARM : START_COLD;
+}
+
+/**
+ * @brief The engine was started. The time to first fix is counted from now.
+ * 
+ */
+void GNSSPolicy::started(start_t start, uint32_t now)
+{
+    if (on)
+        stopped(now);
+
+    if (!counting)
+    {
+        firstStart = now;
+        counting = true;
+    }
+
+    on = true;
+    acquiring = true;
+    current = start;
+    startedAt = now;
+    starts[start]++;
+}
+
+void GNSSPolicy::stopped(uint32_t now)
+{
+    if (!on)
+        return;
+
+    onTime += now - startedAt;
+    on = false;
+    acquiring = false;
+}
+
+/**
+ * @brief A valid fix was read.
+ * 
+ * @return true     If it is the first fix after a start. Its TTFF is added to the histogram.
+ */
+bool GNSSPolicy::fix(time_t timestamp, uint32_t now)
+{
+    lastFix = timestamp;
+    position = true;
+    fixInRun = true;
+    lastFixAt = now;
+
+    if (!acquiring)
+        return false;
+
+    histograms[current].add(now - startedAt);
+    acquiring = false;
+    return true;
+}
+
+/**
+ * @brief Fraction of the time the engine was on, since the first start.
+ * 
+ */
+float GNSSPolicy::dutyCycle(uint32_t now) const
+{
+    if (!counting)
+        return 0;
+
+    uint64_t active = onTime + (on ? now - startedAt : 0);
+    uint32_t total = now - firstStart;
+    return total ? (float)active / total : 1;
+}
+
+/**
+ * @brief Writes the duty cycle and, for every start type, the number of starts and the 50th and
+ * 90th percentile and maximum TTFF (in ms) as a JSON object.
+ * 
+ * @return size_t   Length written, or 0 if the buffer is too small.
+ */
+size_t GNSSPolicy::toJSON(char *buffer, size_t size, uint32_t now) const
+{
+    size_t length = snprintf(buffer, size, "{\"duty\":%.3f", dutyCycle(now));
+
+    for (uint8_t i = 0; i < START_COUNT && length < size; i++)
+    {
+        const LatencyHistogram &h = histograms[i];
+        length += snprintf(buffer + length, size - length, ",\"%s\":{\"n\":%lu,\"p50\":%lu,\"p90\":%lu,\"max\":%lu}",
+                           names[i], (unsigned long)starts[i], (unsigned long)h.percentile(0.5),
+                           (unsigned long)h.percentile(0.9), (unsigned long)h.max());
+    }
+
+    if (length < size)
+        length += snprintf(buffer + length, size - length, "}");
+
+    return (length < size) ? length : 0;
+}
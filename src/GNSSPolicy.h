@@ -0,0 +1,79 @@
+#ifndef GNSSPOLICY_H
+#define GNSSPOLICY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "CommandStats.h"
+
+/**
+ * Power policy of the GNSS engine. The engine is switched off when the next poll is at least
+ * offGap away, and restarted before the poll with the cheapest start the stored data allows:
+ * hot (ephemeris still valid, fix in a few seconds), warm (almanac and last position) or cold.
+ * 
+ * The age of the last fix is known from millis() within a run. After a reboot it is the age of
+ * the persisted fix (the newest record of the track buffer) on the modem clock, if the clock is
+ * set; otherwise a warm start is used when a position is known. The time to first fix (TTFF) of
+ * every start is added to a histogram per start type (above 64 s in the last bucket, the maximum
+ * is exact). Only the GPS task changes it; a snapshot taken by another task may miss the latest start.
+ */
+class GNSSPolicy
+{
+    public:
+        typedef enum
+        {
+            START_HOT = 0,
+            START_WARM,
+            START_COLD,
+            START_COUNT
+        }start_t;
+
+        typedef struct
+        {
+            uint32_t offGap;        // ms. The engine is switched off when the next poll is at least this far.
+            uint32_t hotMaxAge;     // s. Age of the last fix up to which the ephemeris is valid.
+            uint32_t warmMaxAge;    // s. Age of the last fix up to which the almanac and position are usable.
+            uint32_t acquirePoll;   // ms. Poll interval while waiting for the first fix after a start.
+        }config_t;
+
+        GNSSPolicy(const config_t &config) : config(config) {}
+
+        void restore(time_t timestamp, bool position);
+        start_t choose(uint32_t now, time_t clock = 0) const;
+        void started(start_t start, uint32_t now);
+        void stopped(uint32_t now);
+        bool fix(time_t timestamp, uint32_t now);
+        bool shouldStop(uint32_t nextPoll) const { return on && !acquiring && nextPoll >= config.offGap; }
+        bool isOn() const { return on; }
+        bool isAcquiring() const { return acquiring; }
+        uint32_t startTime() const { return startedAt; }
+        bool needsClock() const { return !fixInRun; }
+        uint32_t acquirePoll() const { return config.acquirePoll; }
+
+        uint32_t restarts(start_t start) const { return starts[start]; }
+        const LatencyHistogram &ttff(start_t start) const { return histograms[start]; }
+        float dutyCycle(uint32_t now) const;
+        size_t toJSON(char *buffer, size_t size, uint32_t now) const;
+
+        static const char *name(start_t start);
+
+    private:
+        config_t config;
+        time_t lastFix = 0;             // Timestamp of the last fix, 0 if none.
+        bool position = false;          // A position is known (for a warm start).
+        bool fixInRun = false;          // lastFixAt is set.
+        uint32_t lastFixAt = 0;         // millis() of the last fix.
+
+        bool on = false;
+        bool acquiring = false;         // Started, no fix yet.
+        start_t current = START_COLD;
+        uint32_t startedAt = 0;         // millis() of the last start.
+        bool counting = false;          // firstStart is set.
+        uint32_t firstStart = 0;        // millis() of the first start, for the duty cycle.
+        uint64_t onTime = 0;            // ms, without the current on period.
+
+        uint32_t starts[START_COUNT] = {};
+        LatencyHistogram histograms[START_COUNT];
+};
+
+#endif
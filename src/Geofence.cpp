@@ -0,0 +1,558 @@
+#include "Geofence.h"
+
+#include <math.h>
+#include <string.h>
+
+#define HEADER_MAGIC 0x31434E46         // "FNC1"
+#define RECORDS_OFFSET 16
+#define DATA_OFFSET ((RECORDS_OFFSET + GEOFENCE_MAX * sizeof(record_t) + GEOFENCE_SECTOR_SIZE - 1) & ~(GEOFENCE_SECTOR_SIZE - 1))
+#define VERTEX_CHUNK 32                 // Vertices read from flash at once.
+
+// Metres per degree x 1e7 of latitude (mean Earth radius of 6371 km).
+#define METRES_PER_E7 0.011119493f
+
+static const char *const eventNames[] = { "enter", "exit" };
+
+/**
+ * @brief Finds the partition, reads the fences and builds the grid.
+ *
+ * @param label     Label of the partition in partitions.csv.
+ * @return true     If the partition was found. It may hold no fences.
+ * @return false    If the partition is missing.
+ */
+bool Geofence::begin(const char *label)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)GEOFENCE_PARTITION_SUBTYPE, label);
+    fenceCount = 0;
+    trackedCount = 0;
+    memset(state, 0, sizeof(state));
+    counters = {};
+    if (partition == NULL)
+        return false;
+
+    uint32_t magic = 0;
+    record_t record;
+    if (esp_partition_read(partition, 0, &magic, sizeof(magic)) == ESP_OK && magic == HEADER_MAGIC)
+    {
+        while (fenceCount < GEOFENCE_MAX &&
+               esp_partition_read(partition, RECORDS_OFFSET + fenceCount * sizeof(record_t), &record, sizeof(record)) == ESP_OK &&
+               record.type <= TYPE_POLYGON)
+            load(record);
+    }
+
+    buildGrid();
+    return true;
+}
+
+/**
+ * @brief Reads the name of a fence from flash.
+ *
+ */
+bool Geofence::name(uint16_t i, char *buffer, size_t size) const
+{
+    char name[GEOFENCE_NAME_MAX];
+
+    if (partition == NULL || i >= fenceCount || size == 0 ||
+        esp_partition_read(partition, RECORDS_OFFSET + i * sizeof(record_t) + offsetof(record_t, name), name, sizeof(name)) != ESP_OK)
+        return false;
+
+    name[sizeof(name) - 1] = '\0';
+    strncpy(buffer, name, size - 1);
+    buffer[size - 1] = '\0';
+    return true;
+}
+
+/**
+ * @brief Distance (in m) from the position to the edge of the fence: negative inside the fence,
+ * positive outside of it.
+ *
+ */
+float Geofence::distance(uint16_t i, int32_t latitudeE7, int32_t longitudeE7) const
+{
+    return distance(fences[i], latitudeE7, longitudeE7, cosf(latitudeE7 * (float)(M_PI / 180e7)));
+}
+
+/**
+ * @brief Distance to the edge, in an equirectangular projection around the position. It is
+ * accurate to well below a metre over the few kilometres of a fence.
+ *
+ * The edges of a polygon are read from flash in chunks. The position is inside if a ray from
+ * it crosses an odd number of edges, and the distance is the one to the nearest edge.
+ */
+float Geofence::distance(const fence_t &fence, int32_t latitudeE7, int32_t longitudeE7, float cosLatitude) const
+{
+    const float scaleX = METRES_PER_E7 * cosLatitude;
+
+    if (fence.type == TYPE_CIRCLE)
+    {
+        float x = (float)((int64_t)fence.longitudeE7 - longitudeE7) * scaleX;
+        float y = (float)((int64_t)fence.latitudeE7 - latitudeE7) * METRES_PER_E7;
+        return sqrtf(x * x + y * y) - fence.radius;
+    }
+
+    vertex_t chunk[VERTEX_CHUNK];
+    float firstX = 0, firstY = 0, lastX = 0, lastY = 0;
+    float nearest = INFINITY;
+    bool inside = false;
+
+    for (uint16_t start = 0; start < fence.vertexCount; start += VERTEX_CHUNK)
+    {
+        uint16_t n = (fence.vertexCount - start < VERTEX_CHUNK) ? fence.vertexCount - start : VERTEX_CHUNK;
+        if (esp_partition_read(partition, fence.vertexOffset + start * sizeof(vertex_t), chunk, n * sizeof(vertex_t)) != ESP_OK)
+            return INFINITY;
+
+        for (uint16_t k = 0; k <= n; k++)
+        {
+            // The edge back to the first vertex closes the polygon.
+            bool closing = (k == n);
+            if (closing && start + n < fence.vertexCount)
+                break;
+
+            float x = closing ? firstX : (float)((int64_t)chunk[k].longitudeE7 - longitudeE7) * scaleX;
+            float y = closing ? firstY : (float)((int64_t)chunk[k].latitudeE7 - latitudeE7) * METRES_PER_E7;
+
+            if (start == 0 && k == 0)
+            {
+                firstX = x;
+                firstY = y;
+            }
+            else
+            {
+                // Edge from (lastX, lastY) to (x, y), the position is at the origin.
+                if ((lastY > 0) != (y > 0) && lastX + (0 - lastY) * (x - lastX) / (y - lastY) > 0)
+                    inside = !inside;
+
+                float dx = x - lastX, dy = y - lastY;
+                float length = dx * dx + dy * dy;
+                float t = (length > 0) ? -(lastX * dx + lastY * dy) / length : 0;
+                t = (t < 0) ? 0 : (t > 1) ? 1 : t;
+                float px = lastX + t * dx, py = lastY + t * dy;
+                float d = px * px + py * py;
+                if (d < nearest)
+                    nearest = d;
+            }
+            lastX = x;
+            lastY = y;
+        }
+    }
+
+    nearest = sqrtf(nearest);
+    return inside ? -nearest : nearest;
+}
+
+/**
+ * @brief Bounding box expanded by margin: outside of it, a position is more than margin metres
+ * outside the fence.
+ *
+ */
+Geofence::box_t Geofence::expanded(const box_t &box) const
+{
+    int32_t maxLatitude = (box.maxLatitudeE7 > -box.minLatitudeE7) ? box.maxLatitudeE7 : -box.minLatitudeE7;
+    float cosLatitude = cosf(maxLatitude * (float)(M_PI / 180e7));
+    int32_t latitudeMargin = ceilf(config.margin / METRES_PER_E7) + 1;
+    int32_t longitudeMargin = (cosLatitude > 0.01f) ? (int32_t)ceilf(config.margin / (METRES_PER_E7 * cosLatitude)) + 1 : 1800000000;
+
+    box_t result;
+    result.minLatitudeE7 = box.minLatitudeE7 - latitudeMargin;
+    result.maxLatitudeE7 = box.maxLatitudeE7 + latitudeMargin;
+    result.minLongitudeE7 = (box.minLongitudeE7 > -1800000000 + longitudeMargin) ? box.minLongitudeE7 - longitudeMargin : -1800000000;
+    result.maxLongitudeE7 = (box.maxLongitudeE7 < 1800000000 - longitudeMargin) ? box.maxLongitudeE7 + longitudeMargin : 1800000000;
+    return result;
+}
+
+/**
+ * @brief Copies a record without its name to RAM.
+ *
+ */
+void Geofence::load(const record_t &record)
+{
+    fence_t &fence = fences[fenceCount++];
+    fence.id = record.id;
+    fence.type = record.type;
+    fence.vertexCount = record.vertexCount;
+    fence.box = expanded(record.box);
+    fence.latitudeE7 = record.latitudeE7;
+    fence.longitudeE7 = record.longitudeE7;
+    fence.radius = record.radius;
+    fence.vertexOffset = record.vertexOffset;
+}
+
+/**
+ * @brief Builds the grid over the expanded bounding boxes. There are about 4 cells per fence,
+ * about square in metres. If the fences cover too many cells for GEOFENCE_GRID_REFS, the cells
+ * are made larger.
+ *
+ */
+void Geofence::buildGrid()
+{
+    gridColumns = gridRows = 0;
+    if (fenceCount == 0)
+        return;
+
+    grid = fences[0].box;
+    for (uint16_t i = 1; i < fenceCount; i++)
+    {
+        const box_t &box = fences[i].box;
+        grid.minLatitudeE7 = (box.minLatitudeE7 < grid.minLatitudeE7) ? box.minLatitudeE7 : grid.minLatitudeE7;
+        grid.minLongitudeE7 = (box.minLongitudeE7 < grid.minLongitudeE7) ? box.minLongitudeE7 : grid.minLongitudeE7;
+        grid.maxLatitudeE7 = (box.maxLatitudeE7 > grid.maxLatitudeE7) ? box.maxLatitudeE7 : grid.maxLatitudeE7;
+        grid.maxLongitudeE7 = (box.maxLongitudeE7 > grid.maxLongitudeE7) ? box.maxLongitudeE7 : grid.maxLongitudeE7;
+    }
+
+    const int64_t height = (int64_t)grid.maxLatitudeE7 - grid.minLatitudeE7 + 1;
+    const int64_t width = (int64_t)grid.maxLongitudeE7 - grid.minLongitudeE7 + 1;
+    const float aspect = width * cosf(((int64_t)grid.minLatitudeE7 + grid.maxLatitudeE7) / 2 * (float)(M_PI / 180e7)) / height;
+
+    for (uint32_t target = (4 * fenceCount < GEOFENCE_GRID_MAX) ? 4 * fenceCount : GEOFENCE_GRID_MAX; target >= 1; target /= 2)
+    {
+        long columns = lroundf(sqrtf(target * aspect));
+        gridColumns = (columns < 1) ? 1 : (columns > (long)target) ? target : columns;
+        gridRows = target / gridColumns;
+
+        // Number of fences per cell, in cellStart[cell + 1].
+        uint32_t cells = gridColumns * gridRows, references = 0;
+        memset(cellStart, 0, (cells + 1) * sizeof(cellStart[0]));
+        for (uint16_t i = 0; i < fenceCount && references <= GEOFENCE_GRID_REFS; i++)
+        {
+            const box_t &box = fences[i].box;
+            uint32_t row0 = ((int64_t)box.minLatitudeE7 - grid.minLatitudeE7) * gridRows / height;
+            uint32_t row1 = ((int64_t)box.maxLatitudeE7 - grid.minLatitudeE7) * gridRows / height;
+            uint32_t column0 = ((int64_t)box.minLongitudeE7 - grid.minLongitudeE7) * gridColumns / width;
+            uint32_t column1 = ((int64_t)box.maxLongitudeE7 - grid.minLongitudeE7) * gridColumns / width;
+
+            for (uint32_t row = row0; row <= row1; row++)
+                for (uint32_t column = column0; column <= column1; column++)
+                    cellStart[row * gridColumns + column + 1]++;
+            references += (row1 - row0 + 1) * (column1 - column0 + 1);
+        }
+        if (references > GEOFENCE_GRID_REFS && target > 1)
+            continue;
+
+        for (uint32_t cell = 0; cell < cells; cell++)
+            cellStart[cell + 1] += cellStart[cell];
+
+        // Filled with cellStart[cell] as the write position, which is then the start of the next cell.
+        for (uint16_t i = 0; i < fenceCount; i++)
+        {
+            const box_t &box = fences[i].box;
+            uint32_t row0 = ((int64_t)box.minLatitudeE7 - grid.minLatitudeE7) * gridRows / height;
+            uint32_t row1 = ((int64_t)box.maxLatitudeE7 - grid.minLatitudeE7) * gridRows / height;
+            uint32_t column0 = ((int64_t)box.minLongitudeE7 - grid.minLongitudeE7) * gridColumns / width;
+            uint32_t column1 = ((int64_t)box.maxLongitudeE7 - grid.minLongitudeE7) * gridColumns / width;
+
+            for (uint32_t row = row0; row <= row1; row++)
+                for (uint32_t column = column0; column <= column1; column++)
+                    cellFences[cellStart[row * gridColumns + column]++] = i;
+        }
+        for (uint32_t cell = cells; cell > 0; cell--)
+            cellStart[cell] = cellStart[cell - 1];
+        cellStart[0] = 0;
+        return;
+    }
+}
+
+/**
+ * @brief Adds the fence to the fences followed, so that it is tested on every fix.
+ *
+ */
+bool Geofence::track(uint16_t i)
+{
+    if (trackedCount >= GEOFENCE_TRACKED_MAX)
+        return false;
+    tracked[trackedCount++] = i;
+    return true;
+}
+
+void Geofence::untrack(uint16_t i)
+{
+    for (uint8_t j = 0; j < trackedCount; j++)
+        if (tracked[j] == i)
+        {
+            tracked[j] = tracked[--trackedCount];
+            return;
+        }
+}
+
+/**
+ * @brief Tests the position against a fence and updates its state.
+ *
+ * @param event     Set if there is a transition.
+ * @return true     If the fence was entered or left.
+ */
+bool Geofence::evaluate(uint16_t i, int32_t latitudeE7, int32_t longitudeE7, float cosLatitude, event_t &event)
+{
+    const fence_t &fence = fences[i];
+    evaluated[i] = updates;
+
+    // Outside the expanded box, the position is more than margin metres outside the fence.
+    float d = config.margin;
+    if (latitudeE7 >= fence.box.minLatitudeE7 && latitudeE7 <= fence.box.maxLatitudeE7 &&
+        longitudeE7 >= fence.box.minLongitudeE7 && longitudeE7 <= fence.box.maxLongitudeE7)
+    {
+        counters.tests++;
+        d = distance(fence, latitudeE7, longitudeE7, cosLatitude);
+    }
+
+    uint8_t previous = state[i];
+    bool inside = previous & STATE_INSIDE;
+    uint8_t count = previous & STATE_COUNT;
+
+    bool towards = inside ? (d >= config.margin) : (d < 0);
+    count = towards ? count + 1 : 0;
+    bool transition = count >= (config.confirm ? config.confirm : 1);
+    if (transition)
+    {
+        inside = !inside;
+        count = 0;
+    }
+
+    uint8_t next = (inside ? STATE_INSIDE : 0) | count;
+    if (previous == 0 && next != 0 && !track(i))
+    {
+        counters.overflows++;
+        return false;
+    }
+    if (previous != 0 && next == 0)
+        untrack(i);
+    state[i] = next;
+
+    if (!transition)
+        return false;
+
+    event.id = fence.id;
+    event.index = i;
+    event.type = inside ? EVENT_ENTER : EVENT_EXIT;
+    event.latitudeE7 = latitudeE7;
+    event.longitudeE7 = longitudeE7;
+    counters.events++;
+    return true;
+}
+
+/**
+ * @brief Tests a fix against the fences. Fixes without a position are ignored.
+ *
+ */
+size_t Geofence::update(const GPS::data_t &data, event_t *events, size_t max)
+{
+    if (!(data.valid & GPS::VALID_POSITION))
+        return 0;
+    return update(data.latitudeE7, data.longitudeE7, data.timestamp, events, max);
+}
+
+/**
+ * @brief Tests a position against the fences of its grid cell and the fences it is inside of
+ * (or which wait for a confirmation), and reports the transitions.
+ *
+ * @param events    Output: fences entered or left.
+ * @param max       Size of events. The fences beyond it are tested on the next fix.
+ * @return size_t   Number of events.
+ */
+size_t Geofence::update(int32_t latitudeE7, int32_t longitudeE7, time_t timestamp, event_t *events, size_t max)
+{
+    size_t n = 0;
+    const float cosLatitude = cosf(latitudeE7 * (float)(M_PI / 180e7));
+
+    counters.fixes++;
+    if (++updates == 0)
+    {
+        memset(evaluated, 0, sizeof(evaluated));
+        updates = 1;
+    }
+
+    if (gridColumns > 0 && latitudeE7 >= grid.minLatitudeE7 && latitudeE7 <= grid.maxLatitudeE7 &&
+        longitudeE7 >= grid.minLongitudeE7 && longitudeE7 <= grid.maxLongitudeE7)
+    {
+        uint32_t row = ((int64_t)latitudeE7 - grid.minLatitudeE7) * gridRows / ((int64_t)grid.maxLatitudeE7 - grid.minLatitudeE7 + 1);
+        uint32_t column = ((int64_t)longitudeE7 - grid.minLongitudeE7) * gridColumns / ((int64_t)grid.maxLongitudeE7 - grid.minLongitudeE7 + 1);
+        uint32_t cell = row * gridColumns + column;
+
+        uint16_t candidates = cellStart[cell + 1] - cellStart[cell];
+        counters.candidates += candidates;
+        if (candidates > counters.maxCandidates)
+            counters.maxCandidates = candidates;
+
+        for (uint16_t k = cellStart[cell]; k < cellStart[cell + 1] && n < max; k++)
+            if (evaluate(cellFences[k], latitudeE7, longitudeE7, cosLatitude, events[n]))
+                events[n++].timestamp = timestamp;
+    }
+
+    // Backwards, as a fence which is not followed any more is replaced by the last one.
+    for (uint8_t j = trackedCount; j > 0 && n < max; j--)
+    {
+        uint16_t i = tracked[j - 1];
+        if (evaluated[i] != updates && evaluate(i, latitudeE7, longitudeE7, cosLatitude, events[n]))
+            events[n++].timestamp = timestamp;
+    }
+    return n;
+}
+
+/**
+ * @brief Writes the statistics as JSON: fences, grid cells, fixes, fences of the grid cell and
+ * exact tests per fix, largest grid cell, events and transitions lost to GEOFENCE_TRACKED_MAX.
+ *
+ * @return size_t   Length of the JSON object. 0 if it does not fit.
+ */
+size_t Geofence::toJSON(char *buffer, size_t size) const
+{
+    double fixes = counters.fixes ? counters.fixes : 1;
+    int length = snprintf(buffer, size, "{\"fences\":%u,\"cells\":%u,\"fixes\":%lu,\"candidates\":%.2f,\"tests\":%.2f,"
+                          "\"max_candidates\":%u,\"events\":%lu,\"overflows\":%u}",
+                          fenceCount, gridCells(), (unsigned long)counters.fixes, counters.candidates / fixes,
+                          counters.tests / fixes, counters.maxCandidates, (unsigned long)counters.events, counters.overflows);
+
+    return (length < 0 || (size_t)length >= size) ? 0 : length;
+}
+
+/**
+ * @brief Formats an event as the JSON object published to the geofence topic.
+ *
+ * @return size_t   Length of the JSON object, or 0 if it does not fit.
+ */
+size_t Geofence::eventJSON(const event_t &event, char *buffer, size_t size) const
+{
+    char fenceName[GEOFENCE_NAME_MAX];
+    if (!name(event.index, fenceName, sizeof(fenceName)))
+        fenceName[0] = '\0';
+
+    int length = snprintf(buffer, size, "{\"fence\":%u,\"name\":\"%s\",\"event\":\"%s\",\"latitude\":%.7lf,\"longitude\":%.7lf,\"timestamp\":%li}",
+                          event.id, fenceName, name((event_type_t)event.type), event.latitudeE7 / 1e7, event.longitudeE7 / 1e7,
+                          (long)event.timestamp);
+
+    return (length < 0 || (size_t)length >= size) ? 0 : length;
+}
+
+const char *Geofence::name(event_type_t type)
+{
+    return (type <= EVENT_EXIT) ? eventNames[type] : "?";
+}
+
+/**
+ * @brief Erases the partition and writes the header. There are no fences until added.
+ *
+ */
+bool Geofence::format()
+{
+    const uint32_t magic = HEADER_MAGIC;
+
+    if (partition == NULL || esp_partition_erase_range(partition, 0, partition->size) != ESP_OK ||
+        esp_partition_write(partition, 0, &magic, sizeof(magic)) != ESP_OK)
+        return false;
+
+    fenceCount = 0;
+    trackedCount = 0;
+    memset(state, 0, sizeof(state));
+    buildGrid();
+    return true;
+}
+
+/**
+ * @brief Checks that a name fits in a record and can be published as is in the JSON string of
+ * eventJSON(): no quote, backslash or control character.
+ *
+ */
+bool Geofence::validName(const char *name)
+{
+    if (name == NULL || strlen(name) >= GEOFENCE_NAME_MAX)
+        return false;
+
+    for (const char *c = name; *c; c++)
+        if (*c == '"' || *c == '\\' || (unsigned char)*c < 0x20)
+            return false;
+    return true;
+}
+
+/**
+ * @brief Appends a circle. The partition must have been formatted.
+ *
+ * @param name      Name of the fence, published with its events.
+ * @param radius    Radius in m.
+ * @return false    If the name is not valid (see validName) or the partition is full.
+ */
+bool Geofence::addCircle(uint16_t id, const char *name, int32_t latitudeE7, int32_t longitudeE7, uint32_t radius)
+{
+    record_t record;
+    memset(&record, 0, sizeof(record));
+    record.id = id;
+    record.type = TYPE_CIRCLE;
+    record.latitudeE7 = latitudeE7;
+    record.longitudeE7 = longitudeE7;
+    record.radius = radius;
+
+    // The box is widened by a metre for the rounding.
+    int32_t latitudeRadius = (radius + 1) / METRES_PER_E7;
+    float cosLatitude = cosf(((latitudeE7 < 0) ? -latitudeE7 : latitudeE7) * (float)(M_PI / 180e7) + (radius + 1) / 6371000.0f);
+    int32_t longitudeRadius = (cosLatitude > 0.01f) ? (int32_t)((radius + 1) / (METRES_PER_E7 * cosLatitude)) : 1800000000;
+    record.box.minLatitudeE7 = latitudeE7 - latitudeRadius;
+    record.box.maxLatitudeE7 = latitudeE7 + latitudeRadius;
+    record.box.minLongitudeE7 = (longitudeE7 > -1800000000 + longitudeRadius) ? longitudeE7 - longitudeRadius : -1800000000;
+    record.box.maxLongitudeE7 = (longitudeE7 < 1800000000 - longitudeRadius) ? longitudeE7 + longitudeRadius : 1800000000;
+
+    if (!validName(name))
+        return false;
+    strcpy(record.name, name);
+    return add(record, NULL);
+}
+
+/**
+ * @brief Appends a polygon. The partition must have been formatted.
+ *
+ * @param name      Name of the fence, published with its events.
+ * @param vertices  Vertices in order, the last one is joined to the first one.
+ * @param count     Number of vertices, at least 3.
+ * @return false    If the name is not valid (see validName) or the partition is full.
+ */
+bool Geofence::addPolygon(uint16_t id, const char *name, const vertex_t *vertices, uint16_t count)
+{
+    if (count < 3 || !validName(name))
+        return false;
+
+    record_t record;
+    memset(&record, 0, sizeof(record));
+    record.id = id;
+    record.type = TYPE_POLYGON;
+    record.vertexCount = count;
+    strcpy(record.name, name);
+
+    record.box = { vertices[0].latitudeE7, vertices[0].longitudeE7, vertices[0].latitudeE7, vertices[0].longitudeE7 };
+    for (uint16_t k = 1; k < count; k++)
+    {
+        record.box.minLatitudeE7 = (vertices[k].latitudeE7 < record.box.minLatitudeE7) ? vertices[k].latitudeE7 : record.box.minLatitudeE7;
+        record.box.minLongitudeE7 = (vertices[k].longitudeE7 < record.box.minLongitudeE7) ? vertices[k].longitudeE7 : record.box.minLongitudeE7;
+        record.box.maxLatitudeE7 = (vertices[k].latitudeE7 > record.box.maxLatitudeE7) ? vertices[k].latitudeE7 : record.box.maxLatitudeE7;
+        record.box.maxLongitudeE7 = (vertices[k].longitudeE7 > record.box.maxLongitudeE7) ? vertices[k].longitudeE7 : record.box.maxLongitudeE7;
+    }
+    record.latitudeE7 = record.box.minLatitudeE7 / 2 + record.box.maxLatitudeE7 / 2;
+    record.longitudeE7 = record.box.minLongitudeE7 / 2 + record.box.maxLongitudeE7 / 2;
+    return add(record, vertices);
+}
+
+/**
+ * @brief Writes the vertices after the ones of the previous fences, then the record, into the
+ * erased partition, and rebuilds the grid.
+ *
+ */
+bool Geofence::add(record_t &record, const vertex_t *vertices)
+{
+    if (partition == NULL || fenceCount >= GEOFENCE_MAX)
+        return false;
+
+    uint32_t offset = DATA_OFFSET;
+    for (uint16_t i = 0; i < fenceCount; i++)
+        if (fences[i].type == TYPE_POLYGON && fences[i].vertexOffset + fences[i].vertexCount * sizeof(vertex_t) > offset)
+            offset = fences[i].vertexOffset + fences[i].vertexCount * sizeof(vertex_t);
+
+    if (record.vertexCount > 0)
+    {
+        if (offset + record.vertexCount * sizeof(vertex_t) > partition->size ||
+            esp_partition_write(partition, offset, vertices, record.vertexCount * sizeof(vertex_t)) != ESP_OK)
+            return false;
+        record.vertexOffset = offset;
+    }
+
+    if (esp_partition_write(partition, RECORDS_OFFSET + fenceCount * sizeof(record_t), &record, sizeof(record)) != ESP_OK)
+        return false;
+
+    load(record);
+    buildGrid();
+    return true;
+}
@@ -0,0 +1,182 @@
+#ifndef GEOFENCE_H
+#define GEOFENCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_partition.h"
+#include "SIM7600.h"
+
+#define GEOFENCE_PARTITION_SUBTYPE 0x42
+#define GEOFENCE_SECTOR_SIZE 4096
+#ifndef GEOFENCE_MAX
+#define GEOFENCE_MAX 256            // Fences in the partition.
+#endif
+#define GEOFENCE_NAME_MAX 24        // Name of a fence, with the terminating null. No '"' or '\'.
+#define GEOFENCE_GRID_MAX 1024      // Cells of the grid index.
+#define GEOFENCE_GRID_REFS 4096     // Fence references in all the cells.
+#define GEOFENCE_TRACKED_MAX 16     // Fences inside or waiting for a confirmation at the same time.
+
+/**
+ * Geofences (circles and polygons) in a raw flash partition, checked on every fix.
+ *
+ * The first sectors hold a header and one record per fence: id, type, name, bounding box, and
+ * the centre and radius of a circle or the offset and count of the vertices of a polygon. The
+ * vertices (latitude and longitude x 1e7) follow the records. The records are written once into
+ * the erased partition, so no count has to be rewritten: the first erased record ends the list.
+ *
+ * The records without the names are kept in RAM with a uniform grid over the bounding boxes of
+ * the fences, built in begin(). A fix is only tested against the fences of its grid cell and the
+ * fences it is inside of, so the cost of a fix depends on the fences around it and not on the
+ * number of fences. The vertices are read from flash when a polygon is tested.
+ *
+ * Only the transitions are reported. A fence is entered after confirm fixes inside it, and left
+ * after confirm fixes more than margin metres outside of it, so the jitter of the fixes along an
+ * edge does not produce enter and exit events. The state is not persisted: after a reboot, the
+ * fences the tracker is inside of are entered again.
+ */
+class Geofence
+{
+    public:
+        typedef enum
+        {
+            TYPE_CIRCLE = 0,
+            TYPE_POLYGON = 1
+        }type_t;
+
+        typedef enum
+        {
+            EVENT_ENTER = 0,
+            EVENT_EXIT = 1
+        }event_type_t;
+
+        typedef struct
+        {
+            float margin;           // m outside the fence for an exit.
+            uint8_t confirm;        // Consecutive fixes for an enter or an exit.
+        }config_t;
+
+        typedef struct
+        {
+            int32_t latitudeE7;
+            int32_t longitudeE7;
+        }vertex_t;
+
+        typedef struct
+        {
+            uint16_t id;
+            uint16_t index;         // Index of the fence, for name().
+            uint8_t type;           // event_type_t
+            time_t timestamp;
+            int32_t latitudeE7;
+            int32_t longitudeE7;
+        }event_t;
+
+        typedef struct
+        {
+            uint32_t fixes;
+            uint32_t candidates;    // Fences of the grid cells of the fixes.
+            uint32_t tests;         // Exact tests of a fix against a fence.
+            uint32_t events;
+            uint16_t maxCandidates; // Largest grid cell.
+            uint16_t overflows;     // Transitions not followed because GEOFENCE_TRACKED_MAX fences were tracked.
+        }stats_t;
+
+        Geofence(const config_t &config) : config(config) {}
+
+        bool begin(const char *label = "fences");
+        uint16_t count() const { return fenceCount; }
+        uint16_t id(uint16_t i) const { return fences[i].id; }
+        type_t type(uint16_t i) const { return (type_t)fences[i].type; }
+        bool name(uint16_t i, char *buffer, size_t size) const;
+        bool isInside(uint16_t i) const { return state[i] & STATE_INSIDE; }
+        float distance(uint16_t i, int32_t latitudeE7, int32_t longitudeE7) const;
+
+        size_t update(const GPS::data_t &data, event_t *events, size_t max);
+        size_t update(int32_t latitudeE7, int32_t longitudeE7, time_t timestamp, event_t *events, size_t max);
+
+        uint16_t gridCells() const { return gridColumns * gridRows; }
+        const stats_t &stats() const { return counters; }
+        size_t toJSON(char *buffer, size_t size) const;
+        size_t eventJSON(const event_t &event, char *buffer, size_t size) const;
+        static const char *name(event_type_t type);
+
+        // Writing the image (host tool or factory firmware).
+        bool format();
+        bool addCircle(uint16_t id, const char *name, int32_t latitudeE7, int32_t longitudeE7, uint32_t radius);
+        bool addPolygon(uint16_t id, const char *name, const vertex_t *vertices, uint16_t count);
+        static bool validName(const char *name);
+
+    private:
+        typedef struct
+        {
+            int32_t minLatitudeE7;
+            int32_t minLongitudeE7;
+            int32_t maxLatitudeE7;
+            int32_t maxLongitudeE7;
+        }box_t;
+
+        // Record in flash. The name is not kept in RAM.
+        typedef struct
+        {
+            uint16_t id;
+            uint8_t type;           // type_t. 0xFF for an erased record.
+            uint8_t reserved;
+            uint16_t vertexCount;
+            uint16_t reserved2;
+            box_t box;
+            int32_t latitudeE7;     // Centre of a circle.
+            int32_t longitudeE7;
+            uint32_t radius;        // m
+            uint32_t vertexOffset;  // Offset of the first vertex in the partition.
+            char name[GEOFENCE_NAME_MAX];
+        }record_t;
+
+        typedef struct
+        {
+            uint16_t id;
+            uint8_t type;
+            uint16_t vertexCount;
+            box_t box;              // Expanded by margin.
+            int32_t latitudeE7;
+            int32_t longitudeE7;
+            uint32_t radius;
+            uint32_t vertexOffset;
+        }fence_t;
+
+        enum
+        {
+            STATE_INSIDE = 0x80,
+            STATE_COUNT = 0x7F      // Consecutive fixes towards the other state.
+        };
+
+        bool add(record_t &record, const vertex_t *vertices);
+        void buildGrid();
+        box_t expanded(const box_t &box) const;
+        void load(const record_t &record);
+        bool evaluate(uint16_t i, int32_t latitudeE7, int32_t longitudeE7, float cosLatitude, event_t &event);
+        float distance(const fence_t &fence, int32_t latitudeE7, int32_t longitudeE7, float cosLatitude) const;
+        bool track(uint16_t i);
+        void untrack(uint16_t i);
+
+        config_t config;
+        const esp_partition_t *partition = NULL;
+        fence_t fences[GEOFENCE_MAX];
+        uint16_t fenceCount = 0;
+        uint8_t state[GEOFENCE_MAX] = {};
+        uint16_t evaluated[GEOFENCE_MAX] = {};  // Update in which the fence was last tested.
+        uint16_t updates = 0;
+        uint16_t tracked[GEOFENCE_TRACKED_MAX];
+        uint8_t trackedCount = 0;
+
+        // Grid over the bounding boxes expanded by margin. The fences of cell c are
+        // cellFences[cellStart[c]] to cellFences[cellStart[c + 1] - 1].
+        box_t grid = {};
+        uint16_t gridColumns = 0;
+        uint16_t gridRows = 0;
+        uint16_t cellStart[GEOFENCE_GRID_MAX + 1];
+        uint16_t cellFences[GEOFENCE_GRID_REFS];
+
+        stats_t counters = {};
+};
+
+#endif
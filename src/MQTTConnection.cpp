@@ -0,0 +1,146 @@
+#include "MQTTConnection.h"
+
+/**
+ * @brief One attempt to connect to the MQTT broker, from the lowest layer which is not up.
+ * 
+ * @return true     If connected to the broker.
+ * @return false    If a layer failed. Wait backoff() before the next attempt.
+ */
+bool MQTTConnection::attempt()
+{
+    if (!down && connected())
+        return true;
+
+    if (!down)
+    {
+        down = true;
+        downSince = millis();
+    }
+
+    counters.attempts++;
+
+    for (uint8_t layer = lowestDown(); layer < LAYER_COUNT; layer++)
+    {
+        if (bringUp((layer_t)layer))
+        {
+            layerFailures[layer] = 0;
+            continue;
+        }
+
+        counters.failures[layer]++;
+        if (failedAttempts < 31)
+            failedAttempts++;
+
+        if (++layerFailures[layer] >= config.layerRetries)
+        {
+            layerFailures[layer] = 0;
+            escalate((layer_t)layer);
+        }
+        ESP_LOGW("MQTTConnection", "Layer %u failed, attempt %lu", layer, (unsigned long)counters.attempts);
+        return false;
+    }
+
+    down = false;
+    failedAttempts = 0;
+    counters.connects++;
+    counters.lastDuration = millis() - downSince;
+    if (counters.lastDuration > counters.maxDuration)
+        counters.maxDuration = counters.lastDuration;
+
+    ESP_LOGI("MQTTConnection", "Connected in %lu ms, %lu attempts", (unsigned long)counters.lastDuration, (unsigned long)counters.attempts);
+    return true;
+}
+
+/**
+ * @brief Time (in ms) to wait before the next attempt: backoffMin doubled for every failed attempt,
+ * up to backoffMax, with a random jitter of up to half of it.
+ * 
+ */
+uint32_t MQTTConnection::backoff() const
+{
+    uint32_t delay = config.backoffMin;
+
+    for (uint8_t i = 1; i < failedAttempts && delay < config.backoffMax; i++)
+        delay *= 2;
+    if (delay > config.backoffMax)
+        delay = config.backoffMax;
+
+    return delay / 2 + esp_random() % (delay / 2 + 1);
+}
+
+/**
+ * @brief Lowest layer which is not up, from the known modem state. The packet domain attach is
+ * only checked when the MQTT service is not running.
+ * 
+ */
+MQTTConnection::layer_t MQTTConnection::lowestDown() const
+{
+    const SIM7600::modemState_t &state = SIM7600::modemState();
+
+    if (state.sslContext != SIM7600::STATE_ON)
+        return LAYER_SSL;
+    if (state.mqttService != SIM7600::STATE_ON)
+        return LAYER_NETWORK;
+    if (state.mqttClient != SIM7600::STATE_ON || state.mqttSSL != SIM7600::STATE_ON)
+        return LAYER_CLIENT;
+    return LAYER_CONNECTION;
+}
+
+/**
+ * @brief Brings up one layer. The commands for a layer which is already up are not sent.
+ * 
+ */
+bool MQTTConnection::bringUp(layer_t layer)
+{
+    switch (layer)
+    {
+        case LAYER_NETWORK:
+            return mqtt.isAttached();
+
+        case LAYER_SSL:
+            return ssl.checkCertificates(config.cacert, config.clientcert, config.clientkey) &&
+                   ssl.configureSSL(config.cacert, config.clientcert, config.clientkey);
+
+        case LAYER_SERVICE:
+            return mqtt.begin();
+
+        case LAYER_CLIENT:
+            return mqtt.acquireClient() && mqtt.setSSLContext();
+
+        case LAYER_CONNECTION:
+            // The state of the connection is not known after a failed publish or connect.
+            if (SIM7600::modemState().mqttConnection == SIM7600::STATE_UNKNOWN)
+                mqtt.disconnect();
+            return mqtt.connect(config.server, config.port);
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Tears down the layer which the failing layer runs on, so that the next attempt starts
+ * one layer lower.
+ * 
+ */
+void MQTTConnection::escalate(layer_t layer)
+{
+    switch (layer)
+    {
+        case LAYER_CONNECTION:
+            ESP_LOGW("MQTTConnection", "Connection keeps failing, releasing the client");
+            mqtt.disconnect();
+            mqtt.releaseClient();
+            break;
+
+        case LAYER_CLIENT:
+        case LAYER_SERVICE:
+            ESP_LOGW("MQTTConnection", "Client or service keeps failing, stopping the service");
+            mqtt.end();
+            break;
+
+        default:
+            // The packet domain attach and the SSL context are checked again by every attempt.
+            break;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef MQTTCONNECTION_H
+#define MQTTCONNECTION_H
+
+#include "Arduino.h"
+#include "SIM7600.h"
+
+/**
+ * Brings up the connection to the MQTT broker layer by layer: SSL context, packet domain attach,
+ * MQTT service (PDP context), MQTT client and broker connection.
+ * 
+ * An attempt starts at the lowest layer which is not up (from the known modem state), so after a
+ * lost connection only AT+CMQTTCONNECT is sent. When a layer fails layerRetries times in a row,
+ * the layer it runs on is torn down, so the next attempt starts one layer lower: connection, then
+ * client, then service and packet domain. Attempts are spaced by an exponential backoff with jitter.
+ */
+class MQTTConnection
+{
+    public:
+        typedef enum
+        {
+            LAYER_SSL = 0,
+            LAYER_NETWORK,
+            LAYER_SERVICE,
+            LAYER_CLIENT,
+            LAYER_CONNECTION,
+            LAYER_COUNT
+        }layer_t;
+
+        typedef struct
+        {
+            const char *server;
+            unsigned int port;
+            const char *cacert;
+            const char *clientcert;
+            const char *clientkey;
+            uint32_t backoffMin;        // ms
+            uint32_t backoffMax;        // ms
+            uint8_t layerRetries;       // Failures of a layer before the layer below is torn down.
+        }config_t;
+
+        typedef struct
+        {
+            uint32_t attempts;
+            uint32_t connects;
+            uint32_t failures[LAYER_COUNT];
+            uint32_t lastDuration;      // ms from the loss of the connection to the next connect.
+            uint32_t maxDuration;       // ms
+        }stats_t;
+
+        MQTTConnection(SSL &ssl, MQTT &mqtt, const config_t &config) : ssl(ssl), mqtt(mqtt), config(config) {}
+
+        bool attempt();
+        bool connected() const { return SIM7600::modemState().mqttConnection == SIM7600::STATE_ON; }
+        uint32_t backoff() const;
+        layer_t lowestDown() const;
+        const stats_t &stats() const { return counters; }
+
+    private:
+        bool bringUp(layer_t layer);
+        void escalate(layer_t layer);
+
+        SSL &ssl;
+        MQTT &mqtt;
+        config_t config;
+        bool down = true;
+        uint32_t downSince = 0;
+        uint8_t failedAttempts = 0;
+        uint8_t layerFailures[LAYER_COUNT] = {};
+        stats_t counters = {};
+};
+
+#endif
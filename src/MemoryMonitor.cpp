@@ -0,0 +1,79 @@
+#include "MemoryMonitor.h"
+
+/**
+ * @brief Registers a task whose stack is sampled.
+ *
+ * @param name      Short name, the key in the JSON snapshot.
+ * @param handle    Handle of the task. NULL if it was not created.
+ * @param stackSize Stack size in bytes.
+ * @return true     If the task is registered.
+ * @return false    If the handle is NULL or MEMORY_TASKS_MAX tasks are registered.
+ */
+bool MemoryMonitor::addTask(const char *name, TaskHandle_t handle, uint32_t stackSize)
+{
+    if (handle == NULL || count >= MEMORY_TASKS_MAX)
+        return false;
+
+    tasks[count++] = { name, handle, stackSize, stackSize };
+    return true;
+}
+
+/**
+ * @brief Reads the stack high-water mark of every task and the state of the 8-bit heap.
+ *
+ * @return uint8_t  Values below the thresholds: tasks with less than minFreeStack bytes, free
+ *                  heap and largest block below minFreeHeap.
+ */
+uint8_t MemoryMonitor::sample()
+{
+    uint8_t warnings = 0;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        // In bytes on the ESP32, where StackType_t is a byte.
+        tasks[i].minFree = uxTaskGetStackHighWaterMark(tasks[i].handle) * sizeof(StackType_t);
+        warnings += (tasks[i].minFree < config.minFreeStack);
+    }
+
+    heapFree = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heapMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heapLargest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    if (heapLargest < heapMinLargest)
+        heapMinLargest = heapLargest;
+
+    warnings += (heapMinFree < config.minFreeHeap);
+    warnings += (heapLargest < config.minFreeHeap);
+    return warnings;
+}
+
+/**
+ * @brief Writes the last sample as JSON: the heap values and the free stack bytes per task.
+ *
+ * @param buffer    Output buffer.
+ * @param size      Size of the buffer.
+ * @return size_t   Length of the JSON. 0 if it does not fit.
+ */
+size_t MemoryMonitor::toJSON(char *buffer, size_t size) const
+{
+    int length = snprintf(buffer, size, "{\"heap_free\":%lu,\"heap_min\":%lu,\"heap_largest\":%lu,\"heap_largest_min\":%lu,\"stack_free\":{",
+                          (unsigned long)heapFree, (unsigned long)heapMinFree, (unsigned long)heapLargest,
+                          (unsigned long)(heapMinLargest == UINT32_MAX ? 0 : heapMinLargest));
+    if (length < 0 || (size_t)length >= size)
+        return 0;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        int written = snprintf(buffer + length, size - length, "%s\"%s\":%lu", (i > 0) ? "," : "", tasks[i].name,
+                               (unsigned long)tasks[i].minFree);
+        if (written < 0 || (size_t)(length + written) >= size)
+            return 0;
+        length += written;
+    }
+
+    if ((size_t)length + 2 >= size)
+        return 0;
+    buffer[length++] = '}';
+    buffer[length++] = '}';
+    buffer[length] = '\0';
+    return length;
+}
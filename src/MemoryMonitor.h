@@ -0,0 +1,62 @@
+#ifndef MEMORYMONITOR_H
+#define MEMORYMONITOR_H
+
+#include "Arduino.h"
+#include "esp_heap_caps.h"
+
+#define MEMORY_TASKS_MAX 10
+
+/**
+ * Stack and heap headroom of the tracker, sampled periodically by the Arduino loop task.
+ *
+ * For every registered task, sample() reads the stack high-water mark: the fewest bytes of its
+ * stack left free since it started. For the 8-bit heap it reads the free bytes, the minimum ever
+ * free and the largest free block, whose minimum is kept too: a small largest block means the
+ * heap is fragmented, even with enough bytes free. The values below the thresholds are counted
+ * as warnings. The tasks and queues are statically allocated, so after the boot the heap only
+ * changes through the libraries (e.g. the logs, see the memory budget in functions.h).
+ *
+ * Not thread-safe: addTask(), sample() and toJSON() share the task list and the heap values, so
+ * the callers in different tasks hold a mutex (Semaphore_memory in functions.h).
+ */
+class MemoryMonitor
+{
+    public:
+        typedef struct
+        {
+            uint32_t minFreeStack;      // Bytes: warning below it, for every task.
+            uint32_t minFreeHeap;       // Bytes: warning below it, for the free heap and the largest block.
+        }config_t;
+
+        typedef struct
+        {
+            const char *name;           // Key in the JSON snapshot.
+            TaskHandle_t handle;
+            uint32_t stackSize;         // Bytes.
+            uint32_t minFree;           // Bytes, high-water mark of the last sample.
+        }task_t;
+
+        MemoryMonitor(const config_t &config) : config(config) {}
+
+        bool addTask(const char *name, TaskHandle_t handle, uint32_t stackSize);
+        uint8_t sample();
+        size_t toJSON(char *buffer, size_t size) const;
+
+        uint8_t taskCount() const { return count; }
+        const task_t &task(uint8_t i) const { return tasks[i]; }
+        uint32_t freeHeap() const { return heapFree; }
+        uint32_t minFreeHeap() const { return heapMinFree; }
+        uint32_t largestBlock() const { return heapLargest; }
+        uint32_t minLargestBlock() const { return heapMinLargest; }
+
+    private:
+        config_t config;
+        task_t tasks[MEMORY_TASKS_MAX];
+        uint8_t count = 0;
+        uint32_t heapFree = 0;
+        uint32_t heapMinFree = 0;
+        uint32_t heapLargest = 0;
+        uint32_t heapMinLargest = UINT32_MAX;
+};
+
+#endif
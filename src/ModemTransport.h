@@ -0,0 +1,27 @@
+#ifndef MODEMTRANSPORT_H
+#define MODEMTRANSPORT_H
+
+#include "Arduino.h"
+
+#define MODEM_DEFAULT_BAUD 115200   // Rate of the modem after a restart: AT+IPR is not saved.
+#define MODEM_WAIT_FOREVER 0xFFFFFFFF   // Timeout of waitData(): until bytes are received or wake().
+
+/**
+ * Serial link to the modem which can block until bytes are received, instead of being polled,
+ * and change its baud rate (see ModemUART, and ModemSimulator on the host). SIM7600 also works
+ * on a plain Stream, which it polls every tick. The I/O task blocks in waitData() while idle, so
+ * the other tasks end the wait with wake() when they queue a request.
+ */
+class ModemTransport: public Stream
+{
+    public:
+        // Blocks until bytes are received or the timeout (in ms) expires. Returns true if bytes are available.
+        virtual bool waitData(uint32_t timeout) = 0;
+        // Ends the current or the next waitData(), from another task.
+        virtual void wake() = 0;
+        // Changes the baud rate of the ESP32 side once the bytes written are sent.
+        virtual bool setBaudRate(uint32_t baud) = 0;
+        virtual uint32_t baudRate() const = 0;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "ModemUART.h"
+
+#define MODEM_UART_FLOW_THRESHOLD 100   // Bytes in the 128-byte RX FIFO at which RTS stops the modem.
+
+/**
+ * @brief Installs the UART driver with its event queue and RX and TX ring buffers, sets the pins
+ * and enables the detection of the line ends.
+ *
+ * @return true     If the driver is installed.
+ * @return false    If the driver could not be installed (e.g. no memory for the buffers).
+ */
+bool ModemUART::begin()
+{
+    uart_config_t uart = {};
+    uart.baud_rate = baud;
+    uart.data_bits = UART_DATA_8_BITS;
+    uart.parity = UART_PARITY_DISABLE;
+    uart.stop_bits = UART_STOP_BITS_1;
+    uart.flow_ctrl = config.flowControl ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE;
+    uart.rx_flow_ctrl_thresh = MODEM_UART_FLOW_THRESHOLD;
+    uart.source_clk = UART_SCLK_APB;
+
+    if (uart_driver_install(config.port, MODEM_UART_RX_BUFFER, MODEM_UART_TX_BUFFER, MODEM_UART_EVENT_QUEUE, &events, 0) != ESP_OK)
+        return false;
+
+    if (uart_param_config(config.port, &uart) != ESP_OK ||
+        uart_set_pin(config.port, config.txPin, config.rxPin, config.rtsPin, config.ctsPin) != ESP_OK)
+        return false;
+
+    // One '\n' ends a line; the line ends in a stream of bytes are detected too, without idle time around them.
+    uart_enable_pattern_det_baud_intr(config.port, '\n', 1, 9, 0, 0);
+    uart_pattern_queue_reset(config.port, MODEM_UART_EVENT_QUEUE);
+    return true;
+}
+
+/**
+ * @brief Moves the received bytes from the RX ring buffer to the chunk, if it is empty.
+ *
+ * @return true     If the chunk has bytes.
+ */
+bool ModemUART::fill()
+{
+    if (chunkStart < chunkEnd)
+        return true;
+
+    size_t buffered = 0;
+    uart_get_buffered_data_len(config.port, &buffered);
+    if (buffered == 0)
+        return false;
+
+    int read = uart_read_bytes(config.port, chunk, (buffered < sizeof(chunk)) ? buffered : sizeof(chunk), 0);
+    chunkStart = 0;
+    chunkEnd = (read > 0) ? read : 0;
+    counters.rxBytes += chunkEnd;
+    return chunkEnd > 0;
+}
+
+/**
+ * @brief Bytes which can be read. Only the chunk while it has bytes, so that reading a line is
+ * not a driver call per byte.
+ *
+ */
+int ModemUART::available()
+{
+    if (chunkStart < chunkEnd)
+        return chunkEnd - chunkStart;
+
+    size_t buffered = 0;
+    uart_get_buffered_data_len(config.port, &buffered);
+    return buffered;
+}
+
+int ModemUART::read()
+{
+    return fill() ? chunk[chunkStart++] : -1;
+}
+
+int ModemUART::peek()
+{
+    return fill() ? chunk[chunkStart] : -1;
+}
+
+/**
+ * @brief Copies the bytes to the TX ring buffer. Blocks only while the ring buffer is full.
+ *
+ */
+size_t ModemUART::write(const uint8_t *buffer, size_t size)
+{
+    int written = uart_write_bytes(config.port, (const char *)buffer, size);
+    if (written <= 0)
+        return 0;
+
+    counters.txBytes += written;
+    return written;
+}
+
+/**
+ * @brief Waits until the bytes written are sent.
+ *
+ */
+void ModemUART::flush()
+{
+    uart_wait_tx_done(config.port, portMAX_DELAY);
+}
+
+/**
+ * @brief Blocks on the UART events until a line end or an idle line, wake() or the timeout.
+ *
+ * @param timeout   Timeout in ms, or MODEM_WAIT_FOREVER.
+ * @return true     If bytes are available.
+ * @return false    On timeout or wake().
+ */
+bool ModemUART::waitData(uint32_t timeout)
+{
+    uint32_t start = millis();
+    uart_event_t event;
+
+    while (available() == 0)
+    {
+        uint32_t elapsed = millis() - start;
+        bool forever = (timeout == MODEM_WAIT_FOREVER);
+        if ((!forever && elapsed >= timeout) ||
+            xQueueReceive(events, &event, forever ? portMAX_DELAY : (timeout - elapsed) / portTICK_PERIOD_MS + 1) != pdTRUE)
+            return available() > 0;
+
+        switch (event.type)
+        {
+            case UART_EVENT_MAX:
+                // Posted by wake().
+                return available() > 0;
+            case UART_PATTERN_DET:
+                // The positions are not used: the lines are split by SIM7600::readLine().
+                counters.lines++;
+                while (uart_pattern_pop_pos(config.port) >= 0)
+                    ;
+                break;
+            case UART_FIFO_OVF:
+                // The driver dropped the bytes in the FIFO, the ones in the ring buffer are kept: only
+                // the line being received is garbled, SIM7600::readLine() goes on at the next line end.
+                counters.overflows++;
+                break;
+            case UART_BUFFER_FULL:
+                // The driver stops reading the FIFO until bytes are read, nothing is lost yet.
+                counters.overflows++;
+                break;
+            case UART_FRAME_ERR:
+            case UART_PARITY_ERR:
+                counters.errors++;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Posts an event which is not one of the driver to the event queue, so that the I/O task
+ * blocked in waitData() looks at its request queue. If the queue is full, it has events anyway.
+ *
+ */
+void ModemUART::wake()
+{
+    uart_event_t event = {};
+    event.type = UART_EVENT_MAX;
+    if (events != NULL)
+        xQueueSend(events, &event, 0);
+}
+
+/**
+ * @brief Changes the baud rate once the bytes written are sent. The bytes received at the old
+ * rate are kept.
+ *
+ * @return true     If the rate is set.
+ */
+bool ModemUART::setBaudRate(uint32_t baud)
+{
+    uart_wait_tx_done(config.port, 100 / portTICK_PERIOD_MS);
+    if (uart_set_baudrate(config.port, baud) != ESP_OK)
+        return false;
+
+    this->baud = baud;
+    return true;
+}
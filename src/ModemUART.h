@@ -0,0 +1,75 @@
+#ifndef MODEMUART_H
+#define MODEMUART_H
+
+#include "Arduino.h"
+#include "ModemTransport.h"
+#include "driver/uart.h"
+
+#define MODEM_UART_RX_BUFFER 4096   // 44 ms of data at 921600 baud: a certificate listing or a burst of URCs while the I/O task writes.
+#define MODEM_UART_TX_BUFFER 2048   // A write returns once it is copied, while the driver sends it.
+#define MODEM_UART_EVENT_QUEUE 16   // UART events and positions of the detected line ends.
+#define MODEM_UART_READ_CHUNK 128   // Bytes moved from the RX ring buffer at once, so read() is not a driver call per byte.
+
+/**
+ * Link to the modem on the ESP-IDF UART driver, used by the modem I/O task only.
+ *
+ * The driver fills the RX ring buffer from the UART interrupt and posts an event on the end of
+ * every line ('\n', detected by the UART pattern detection) and when the line goes idle (e.g.
+ * after the "> " prompt, which has no line end). waitData() blocks on these events, so the I/O
+ * task sleeps until there is something to read. With flowControl, RTS stops the modem before the
+ * RX FIFO overflows and CTS holds the writes while the modem is busy.
+ *
+ * The baud rate starts at MODEM_DEFAULT_BAUD, the rate of the modem after a restart;
+ * SIM7600::syncBaudRate() negotiates a higher one with AT+IPR.
+ */
+class ModemUART: public ModemTransport
+{
+    public:
+        typedef struct
+        {
+            uart_port_t port;
+            int txPin;
+            int rxPin;
+            int rtsPin;             // UART_PIN_NO_CHANGE without flow control.
+            int ctsPin;
+            bool flowControl;       // RTS/CTS, needs both pins wired to the modem.
+        }config_t;
+
+        typedef struct
+        {
+            uint32_t rxBytes;
+            uint32_t txBytes;
+            uint32_t lines;         // Line ends detected.
+            uint32_t overflows;     // RX FIFO overflows and full ring buffers.
+            uint32_t errors;        // Frame and parity errors, e.g. from a baud rate mismatch.
+        }stats_t;
+
+        ModemUART(const config_t &config) : config(config) {}
+
+        bool begin();
+        int available() override;
+        int read() override;
+        int peek() override;
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t *buffer, size_t size) override;
+        void flush() override;
+
+        bool waitData(uint32_t timeout) override;
+        void wake() override;
+        bool setBaudRate(uint32_t baud) override;
+        uint32_t baudRate() const override { return baud; }
+        const stats_t &stats() const { return counters; }
+
+    private:
+        bool fill();
+
+        config_t config;
+        QueueHandle_t events = NULL;
+        uint32_t baud = MODEM_DEFAULT_BAUD;
+        uint8_t chunk[MODEM_UART_READ_CHUNK];
+        size_t chunkStart = 0;
+        size_t chunkEnd = 0;
+        stats_t counters = {};
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "Payload.h"
+
+/**
+ * @brief Construct a new Payload object.
+ * 
+ * @param buffer    Buffer for the payload. Must stay valid while the object is used.
+ * @param size      Size of the buffer.
+ * @param format    JSON or BINARY.
+ */
+Payload::Payload(char *buffer, size_t size, format_t format)
+    : buffer(buffer), size(size), format(format), encoder((uint8_t *)buffer, size)
+{
+    clear();
+}
+
+/**
+ * @brief Formats a fix as a JSON object.
+ * 
+ * @param buffer    Buffer for the JSON object.
+ * @param size      Size of the buffer.
+ * @param record    Fix.
+ * @return size_t   Length of the JSON object, or 0 if it does not fit.
+ */
+size_t Payload::formatJSON(char *buffer, size_t size, const TrackBuffer::record_t &record)
+{
+    int length = snprintf(buffer, size, "{\"seq\":%lu,\"latitude\":%.7lf,\"longitude\":%.7lf,\"speed\":%.2lf,\"course\":%.2lf,\"timestamp\":%li,\"battery\":%.2lf}",
+                          (unsigned long)record.sequence, record.latitude / 1e7, record.longitude / 1e7, record.speed / 100.0,
+                          record.course / 100.0, (long)record.timestamp, record.battery / 1000.0);
+
+    return (length < 0 || (size_t)length >= size) ? 0 : length;
+}
+
+/**
+ * @brief Converts a record of the track buffer to a fix of TrackCodec. Units are the same.
+ * 
+ */
+TrackCodec::fix_t Payload::toFix(const TrackBuffer::record_t &record)
+{
+    TrackCodec::fix_t fix;
+    fix.sequence = record.sequence;
+    fix.timestamp = record.timestamp;
+    fix.latitude = record.latitude;
+    fix.longitude = record.longitude;
+    fix.speed = record.speed;
+    fix.course = record.course;
+    fix.battery = record.battery;
+    return fix;
+}
+
+/**
+ * @brief Adds a fix to the payload.
+ * 
+ * @param record    Fix.
+ * @return true     If the fix was added.
+ * @return false    If the fix does not fit in the buffer. The payload is not changed.
+ */
+bool Payload::add(const TrackBuffer::record_t &record)
+{
+    if (format == BINARY)
+        return encoder.add(toFix(record));
+
+    size_t start = used + (count > 0);
+
+    // Room is kept for the closing ']' and '\0'.
+    if (start + 2 >= size)
+        return false;
+
+    size_t length = formatJSON(buffer + start, size - start - 1, record);
+    if (length == 0)
+        return false;
+
+    if (count > 0)
+        buffer[used] = ',';
+
+    used = start + length;
+    count++;
+    return true;
+}
+
+/**
+ * @brief Removes all the fixes.
+ * 
+ */
+void Payload::clear()
+{
+    if (format == BINARY)
+    {
+        encoder.clear();
+        return;
+    }
+
+    buffer[0] = '[';
+    buffer[1] = '\0';
+    used = 1;
+    count = 0;
+}
+
+/**
+ * @brief Payload to be published.
+ * 
+ * @return const char* JSON: the null terminated JSON object for one fix or JSON array for
+ *                     several fixes. BINARY: the encoded fixes (may contain '\0').
+ */
+const char *Payload::data()
+{
+    if (format == BINARY || count == 1)
+        return (format == BINARY) ? buffer : buffer + 1;
+
+    buffer[used] = ']';
+    buffer[used + 1] = '\0';
+    return buffer;
+}
+
+/**
+ * @brief Length of the payload returned by data().
+ * 
+ */
+size_t Payload::length() const
+{
+    if (format == BINARY)
+        return encoder.length();
+
+    return (count == 1) ? used - 1 : used + 1;
+}
+
+/**
+ * @brief Topic to which the payload is published.
+ * 
+ */
+const char *Payload::topic() const
+{
+    if (format == BINARY)
+        return "sim7600/bin";
+
+    return (count > 1) ? "sim7600/batch" : "sim7600/pub";
+}
@@ -0,0 +1,45 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include "Arduino.h"
+#include "TrackBuffer.h"
+#include "TrackCodec.h"
+
+/**
+ * Builds the MQTT payload of one fix or a batch of fixes in a caller-provided buffer.
+ * 
+ * JSON: one fix is a JSON object, published to "sim7600/pub". Several fixes are a JSON array of
+ * these objects, published to "sim7600/batch".
+ * BINARY: one or more fixes encoded with TrackCodec, published to "sim7600/bin".
+ */
+class Payload
+{
+    public:
+        typedef enum
+        {
+            JSON = 0,
+            BINARY
+        }format_t;
+
+        Payload(char *buffer, size_t size, format_t format = JSON);
+
+        static size_t formatJSON(char *buffer, size_t size, const TrackBuffer::record_t &record);
+        static TrackCodec::fix_t toFix(const TrackBuffer::record_t &record);
+
+        bool add(const TrackBuffer::record_t &record);
+        void clear();
+        const char *data();
+        size_t length() const;
+        uint16_t fixes() const { return (format == BINARY) ? encoder.fixes() : count; }
+        const char *topic() const;
+
+    private:
+        char *buffer;
+        size_t size;
+        format_t format;
+        size_t used = 1;        // JSON: buffer[0] is '[' of the array.
+        uint16_t count = 0;
+        TrackCodec::Encoder encoder;
+};
+
+#endif
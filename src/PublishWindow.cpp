@@ -0,0 +1,165 @@
+#include "PublishWindow.h"
+
+#define WAIT_SLICE 50       // ms. The modem is free for the other tasks between two slices.
+#define ACK_GRACE 2000      // ms after the modem's own timeout before a message is counted as lost.
+
+/**
+ * @brief Sends the topic and payload of a message and publishes it, without waiting for its
+ * completion.
+ * 
+ * @param topic     Topic of the message.
+ * @param payload   Payload of the message. Not needed after the call.
+ * @param length    Length of the payload.
+ * @param count     Items of the message (e.g. fixes), returned by collect() when it is acknowledged.
+ * @param now       Time (millis()) of the publish.
+ * @return true     If the message is in flight.
+ * @return false    If the window is full, or the modem refused the message. The window is then
+ *                  cleared and the messages have to be sent again.
+ */
+bool PublishWindow::send(const char *topic, const char *payload, size_t length, uint16_t count, uint32_t now)
+{
+    if (!canSend())
+        return false;
+
+    // Nothing is in flight, so a completion still queued belongs to a cleared message.
+    if (used == 0)
+        MQTT::cancelPublishes();
+
+    if (!mqtt.setPublishTopicPayload(topic, payload, length) || !mqtt.publishAsync(config.qos, config.ackTimeout))
+    {
+        fail();
+        return false;
+    }
+
+    slot_t &slot = slots[(head + used) % PUBLISH_WINDOW_MAX];
+    slot.count = count;
+    slot.sentAt = now;
+    used++;
+    pendingCount += count;
+
+    counters.sent++;
+    if (used > counters.maxInFlight)
+        counters.maxInFlight = used;
+    return true;
+}
+
+/**
+ * @brief Matches the completions received so far to the oldest messages in flight.
+ * 
+ * @param now       Time (millis()).
+ * @param ok        Set to false if a message failed or was not completed in time. The window is
+ *                  then cleared.
+ * @return uint32_t Items of the messages acknowledged, oldest first, to be removed from their queue.
+ */
+uint32_t PublishWindow::collect(uint32_t now, bool &ok)
+{
+    uint32_t acked = 0;
+    uint8_t error;
+    ok = true;
+
+    while (used > 0 && MQTT::publishResult(error))
+    {
+        if (error != 0)
+        {
+            ESP_LOGW("MQTT", "Publish failed: %u", error);
+            fail();
+            ok = false;
+            return acked;
+        }
+
+        const slot_t &slot = slots[head];
+        latency.add(now - slot.sentAt);
+        acked += slot.count;
+        pendingCount -= slot.count;
+        head = (head + 1) % PUBLISH_WINDOW_MAX;
+        used--;
+        counters.acked++;
+    }
+
+    if (used > 0 && (SIM7600::modemState().mqttConnection == SIM7600::STATE_OFF ||
+                     now - slots[head].sentAt > config.ackTimeout * 1000UL + ACK_GRACE))
+    {
+        if (SIM7600::modemState().mqttConnection != SIM7600::STATE_OFF)
+            counters.timeouts++;
+        fail();
+        ok = false;
+    }
+    return acked;
+}
+
+/**
+ * @brief Waits for at least one completion. The wait is done in slices of WAIT_SLICE ms, so that
+ * a completion read by the modem I/O task between two slices is found by the next collect(), and
+ * the other tasks can send their commands in between.
+ * 
+ * @param timeout   Time (in ms) to wait at most.
+ * @param ok        See collect().
+ * @return uint32_t Items of the messages acknowledged.
+ */
+uint32_t PublishWindow::wait(uint32_t timeout, bool &ok)
+{
+    uint32_t start = millis();
+    uint32_t acked = collect(start, ok);
+
+    while (ok && acked == 0 && used > 0 && millis() - start < timeout)
+    {
+        uint32_t left = timeout - (millis() - start);
+        mqtt.execute(NULL, "+CMQTTPUB: 0,", (left < WAIT_SLICE) ? left : WAIT_SLICE, true);
+        acked = collect(millis(), ok);
+    }
+    return acked;
+}
+
+/**
+ * @brief Waits until every message in flight is acknowledged or the window is cleared.
+ * 
+ * @param ok        See collect().
+ * @return uint32_t Items of the messages acknowledged.
+ */
+uint32_t PublishWindow::flush(bool &ok)
+{
+    uint32_t acked = 0;
+    ok = true;
+
+    // collect() clears the window on the ack timeout, so the loop ends.
+    while (ok && used > 0)
+        acked += wait(config.ackTimeout * 1000UL + ACK_GRACE, ok);
+    return acked;
+}
+
+/**
+ * @brief Forgets the messages in flight, e.g. before a reconnect. They are sent again from their queue.
+ * 
+ */
+void PublishWindow::clear()
+{
+    counters.requeued += used;
+    head = 0;
+    used = 0;
+    pendingCount = 0;
+    MQTT::cancelPublishes();
+}
+
+void PublishWindow::fail()
+{
+    counters.failed++;
+    clear();
+}
+
+/**
+ * @brief Writes the statistics as JSON, with the percentiles (in ms) of the time from the
+ * publish to its completion.
+ * 
+ * @return size_t   Length of the JSON object. 0 if it does not fit.
+ */
+size_t PublishWindow::toJSON(char *buffer, size_t size) const
+{
+    int length = snprintf(buffer, size, "{\"window\":%u,\"qos\":%u,\"sent\":%lu,\"acked\":%lu,\"failed\":%lu,\"timeouts\":%lu,"
+                          "\"requeued\":%lu,\"max_in_flight\":%u,\"ack\":{\"p50\":%lu,\"p90\":%lu,\"max\":%lu}}",
+                          window(), config.qos, (unsigned long)counters.sent, (unsigned long)counters.acked,
+                          (unsigned long)counters.failed, (unsigned long)counters.timeouts, (unsigned long)counters.requeued,
+                          counters.maxInFlight, (unsigned long)latency.percentile(0.5), (unsigned long)latency.percentile(0.9),
+                          (unsigned long)latency.max());
+
+    return (length < 0 || (size_t)length >= size) ? 0 : length;
+}
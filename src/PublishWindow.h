@@ -0,0 +1,77 @@
+#ifndef PUBLISHWINDOW_H
+#define PUBLISHWINDOW_H
+
+#include "Arduino.h"
+#include "SIM7600.h"
+
+#define PUBLISH_WINDOW_MAX 8        // Messages in flight at most.
+
+/**
+ * Pipelined publishes: up to window messages are in flight, waiting for their completion
+ * ("+CMQTTPUB: 0,<err>", sent on the PUBACK with QoS 1), while the topic and payload of the next
+ * message are sent to the modem. The throughput is then bounded by the AT exchanges of a message
+ * instead of by the round trip to the broker.
+ *
+ * The completions come in the order of the publishes, so they are matched to the oldest message
+ * in flight. The messages are not copied: they stay in their queue (e.g. the track buffer) until
+ * acknowledged, and count() of the acknowledged messages is returned in order, to be removed from
+ * the queue. When a message fails (error, refused by the modem, no completion within ackTimeout
+ * or connection lost), the window is cleared and the messages in flight are counted as requeued:
+ * they are sent again from their queue.
+ */
+class PublishWindow
+{
+    public:
+        typedef struct
+        {
+            uint8_t window;         // Messages in flight, 1 for a publish at a time.
+            uint8_t qos;            // 1: completion on the PUBACK of the broker.
+            uint16_t ackTimeout;    // s. Also given to the modem in AT+CMQTTPUB.
+        }config_t;
+
+        typedef struct
+        {
+            uint32_t sent;
+            uint32_t acked;
+            uint32_t failed;        // Completions with an error, refused publishes and timeouts.
+            uint32_t timeouts;
+            uint32_t requeued;      // Messages in flight when the window was cleared.
+            uint8_t maxInFlight;
+        }stats_t;
+
+        PublishWindow(MQTT &mqtt, const config_t &config) : mqtt(mqtt), config(config) {}
+
+        bool canSend() const { return used < window(); }
+        uint8_t inFlight() const { return used; }
+        uint32_t countInFlight() const { return pendingCount; }
+        bool send(const char *topic, const char *payload, size_t length, uint16_t count, uint32_t now);
+        uint32_t collect(uint32_t now, bool &ok);
+        uint32_t wait(uint32_t timeout, bool &ok);
+        uint32_t flush(bool &ok);
+        void clear();
+
+        const stats_t &stats() const { return counters; }
+        const LatencyHistogram &ackLatency() const { return latency; }
+        size_t toJSON(char *buffer, size_t size) const;
+
+    private:
+        typedef struct
+        {
+            uint16_t count;         // Fixes (or other items) of the message.
+            uint32_t sentAt;        // ms
+        }slot_t;
+
+        uint8_t window() const { return (config.window < 1) ? 1 : (config.window > PUBLISH_WINDOW_MAX) ? PUBLISH_WINDOW_MAX : config.window; }
+        void fail();
+
+        MQTT &mqtt;
+        config_t config;
+        slot_t slots[PUBLISH_WINDOW_MAX];
+        uint8_t head = 0;           // Oldest message in flight.
+        uint8_t used = 0;
+        uint32_t pendingCount = 0;  // Sum of count of the messages in flight.
+        LatencyHistogram latency;   // From AT+CMQTTPUB to the completion.
+        stats_t counters = {};
+};
+
+#endif
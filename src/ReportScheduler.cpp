@@ -0,0 +1,91 @@
+#include "ReportScheduler.h"
+
+/**
+ * @brief Construct a new ReportScheduler object.
+ * 
+ * @param config    Intervals and thresholds.
+ */
+ReportScheduler::ReportScheduler(const config_t &config) : config(config), pollInterval(config.minInterval)
+{
+}
+
+/**
+ * @brief Decides if the fix has to be reported, and sets the time until the next poll. The fix
+ * counts as reported only after commit().
+ * 
+ * @param data      Latest fix from the GPS Modem.
+ * @param now       Time (in ms) of the fix.
+ * @return true     If the fix has to be reported.
+ * @return false    If the fix can be skipped.
+ */
+bool ReportScheduler::update(const GPS::data_t &data, uint32_t now)
+{
+    double speed = (data.valid & GPS::VALID_SPEED) ? data.speed() : 0;
+    bool movingNow = speed >= config.stationarySpeed;
+    uint32_t elapsed = now - lastReport;
+    reason_t reason = REASON_COUNT;
+
+    counters.polls++;
+
+    if (!reported)
+        reason = REASON_FIRST;
+    else if (movingNow != moving)
+        reason = REASON_START_STOP;
+    else if (movingNow && (data.valid & GPS::VALID_COURSE) && headingChange(lastCourse, data.course()) >= config.headingThreshold)
+        reason = REASON_HEADING;
+    else if (elapsed >= config.maxInterval)
+        reason = REASON_MAX_INTERVAL;
+    else if (movingNow && elapsed >= reportInterval(speed))
+        reason = REASON_DISTANCE;
+
+    moving = movingNow;
+    pollInterval = moving ? config.minInterval : config.parkedPoll;
+    pending = reason;
+
+    return reason != REASON_COUNT;
+}
+
+/**
+ * @brief Records the fix accepted by the last update() as reported: the time and distance to the
+ * next report, and the heading changes, count from it.
+ * 
+ * @param data      Fix passed to the last update().
+ * @param now       Time (in ms) of the fix.
+ */
+void ReportScheduler::commit(const GPS::data_t &data, uint32_t now)
+{
+    if (pending == REASON_COUNT)
+        return;
+
+    reported = true;
+    lastReport = now;
+    lastCourse = data.course();
+    counters.reports++;
+    counters.reasons[pending]++;
+    pending = REASON_COUNT;
+}
+
+/**
+ * @brief Time (in ms) to travel reportDistance at the speed, within minInterval and maxInterval.
+ * 
+ */
+uint32_t ReportScheduler::reportInterval(double speed) const
+{
+    double interval = config.reportDistance / (speed / 3.6) * 1000.0;
+
+    if (interval < config.minInterval)
+        return config.minInterval;
+    if (interval > config.maxInterval)
+        return config.maxInterval;
+    return interval;
+}
+
+/**
+ * @brief Absolute difference between two courses, from 0 to 180 degrees.
+ * 
+ */
+double ReportScheduler::headingChange(double from, double to)
+{
+    double change = fabs(to - from);
+    return (change > 180.0) ? 360.0 - change : change;
+}
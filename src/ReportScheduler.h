@@ -0,0 +1,71 @@
+#ifndef REPORTSCHEDULER_H
+#define REPORTSCHEDULER_H
+
+#include "Arduino.h"
+#include "SIM7600.h"
+
+/**
+ * Chooses when to poll the GPS Modem and which fixes to report, from the speed, the change of
+ * course and the time since the last report.
+ * 
+ * While moving, a fix is reported every reportDistance metres (at the current speed), on a turn
+ * larger than headingThreshold, and when the vehicle starts or stops. While parked, a fix is
+ * reported every maxInterval. The GPS Modem is polled every minInterval while moving and every
+ * parkedPoll while parked.
+ * 
+ * update() only decides: the time and course of the last report change when the caller reports
+ * the fix with commit(), so a fix dropped later (e.g. by the dead-band filter) does not restart
+ * the maxInterval heartbeat.
+ */
+class ReportScheduler
+{
+    public:
+        typedef struct
+        {
+            uint32_t minInterval;       // ms
+            uint32_t maxInterval;       // ms
+            uint32_t parkedPoll;        // ms
+            float reportDistance;       // m
+            float headingThreshold;     // degrees
+            float stationarySpeed;      // km/h. Below this the vehicle is parked and the course is ignored.
+        }config_t;
+
+        typedef enum
+        {
+            REASON_FIRST = 0,
+            REASON_DISTANCE,
+            REASON_HEADING,
+            REASON_START_STOP,
+            REASON_MAX_INTERVAL,
+            REASON_COUNT
+        }reason_t;
+
+        typedef struct
+        {
+            uint32_t polls;
+            uint32_t reports;
+            uint32_t reasons[REASON_COUNT];
+        }stats_t;
+
+        ReportScheduler(const config_t &config);
+
+        bool update(const GPS::data_t &data, uint32_t now);
+        void commit(const GPS::data_t &data, uint32_t now);
+        uint32_t nextPoll() const { return pollInterval; }
+        const stats_t &stats() const { return counters; }
+
+    private:
+        uint32_t reportInterval(double speed) const;
+        static double headingChange(double from, double to);
+
+        config_t config;
+        bool reported = false;
+        bool moving = false;
+        uint32_t lastReport = 0;
+        double lastCourse = 0;
+        reason_t pending = REASON_COUNT;    // Reason of the last update(), until commit().
+        uint32_t pollInterval;
+        stats_t counters = {};
+};
+
+#endif
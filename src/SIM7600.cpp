@@ -1,4 +1,6 @@
 #include "SIM7600.h"
+#include "CertStore.h"
+#include "esp_sleep.h"
 
 /**
  * @brief Construct a new SIM7600::SIM7600 object
@@ -12,43 +14,879 @@ SIM7600::SIM7600(Stream &serial) : port(serial)
     gpio_set_direction(SIM_POWER_EN, GPIO_MODE_OUTPUT);
 }
 
+/**
+ * @brief Construct a new SIM7600::SIM7600 object on a transport, which the I/O task waits on
+ * instead of polling, and whose baud rate can be changed with syncBaudRate().
+ * 
+ * @param transport Link to the SIM7600 (e.g. ModemUART).
+ */
+SIM7600::SIM7600(ModemTransport &transport) : SIM7600((Stream &)transport)
+{
+    this->transport = &transport;
+}
+
+QueueHandle_t SIM7600::requestQueue = NULL;
+std::atomic<TaskHandle_t> SIM7600::ioTask{NULL};
+uint8_t SIM7600::requestStorage[REQUEST_QUEUE_LENGTH * sizeof(request_t)];
+StaticQueue_t SIM7600::requestQueueBuffer;
+StackType_t SIM7600::ioStack[MODEM_IO_STACK_SIZE];
+StaticTask_t SIM7600::ioTaskBuffer;
+char SIM7600::rxLine[RESPONSE_LINE_MAX];
+size_t SIM7600::rxLength = 0;
+SIM7600::urc_t SIM7600::urcHandlers[URC_HANDLERS_MAX];
+uint8_t SIM7600::urcCount = 0;
+uint32_t SIM7600::exchanges = 0;
+SIM7600::modemState_t SIM7600::state = {};
+uint32_t SIM7600::saved = 0;
+std::atomic<uint8_t> SIM7600::publishesPending{0};
+SPSCQueue<uint8_t, PUBLISH_RESULTS_LENGTH> SIM7600::publishResults;
+CommandStats SIM7600::commands;
+gpio_num_t SIM7600::dtrPin = GPIO_NUM_25;
+gpio_num_t SIM7600::riPin = GPIO_NUM_26;
+bool SIM7600::sleepEnabled = false;
+volatile bool SIM7600::asleep = false;
+SIM7600::sleepHandler_t SIM7600::sleepHandler = NULL;
+void *SIM7600::sleepContext = NULL;
+#ifdef CONFIG_PM_ENABLE
+esp_pm_lock_handle_t SIM7600::pmLock = NULL;
+#endif
+
+/**
+ * @brief Days since 1970-01-01 of the proleptic Gregorian calendar, with the year starting in March.
+ * 
+ */
+static int32_t daysFromCivil(int32_t year, uint32_t month, uint32_t day)
+{
+    year -= month <= 2;
+    uint32_t yearOfEra = year % 400;
+    uint32_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    return (year / 400) * 146097 + yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear - 719468;
+}
+
 /**
  * @brief Checks if the expected response is received from the Modem.
  * 
- * @param s         Pointer to the character array for expected response.
- * @param timeout   Timeout (in seconds) for readString function.
- * @return true     If the expected response is present.
- * @return false    If the expected response is not present.
+ * @param s         Pointer to the character array for expected response.
+ * @param timeout   Timeout (in seconds) to wait for the response.
+ * @return true     If the expected response is present.
+ * @return false    If the expected response is not present.
+ */
+bool SIM7600::waitForResponse(const char *s, uint8_t timeout)
+{
+    return execute(NULL, s, timeout * 1000, true).status == AT_MATCH;
+}
+
+/**
+ * @brief Starts the modem I/O task. After this, only the I/O task reads and writes the serial port.
+ * Commands from other tasks are queued and the caller waits on its own semaphore until the response
+ * is complete, so the task notifications of the callers stay free for other uses.
+ * Unsolicited result codes received between commands are passed to the handlers set with onURC().
+ * The queue and the task are allocated statically.
+ * 
+ * @param priority  Priority of the I/O task.
+ * @param core      Core to which the I/O task is pinned.
+ * @return true     If the task is running.
+ * @return false    If the queue or task could not be created.
+ */
+bool SIM7600::startIOTask(UBaseType_t priority, BaseType_t core)
+{
+    if (ioTask != NULL)
+        return true;
+
+    requestQueue = xQueueCreateStatic(REQUEST_QUEUE_LENGTH, sizeof(request_t), requestStorage, &requestQueueBuffer);
+    if (requestQueue == NULL)
+        return false;
+
+    ioTask = xTaskCreateStaticPinnedToCore(ioTaskLoop, "Modem I/O", MODEM_IO_STACK_SIZE, this, priority, ioStack, &ioTaskBuffer, core);
+    return ioTask != NULL;
+}
+
+/**
+ * @brief Sets a handler for the unsolicited result codes starting with the prefix.
+ * The handler runs in the I/O task and must not block or send commands.
+ * 
+ * @param prefix    Prefix of the URC (e.g. "+CMQTTCONNLOST"). Must stay valid.
+ * @param handler   Function called with the URC line.
+ * @param context   Passed to the handler.
+ * @return true     If the handler was added.
+ * @return false    If there is no free slot.
+ */
+bool SIM7600::onURC(const char *prefix, lineHandler_t handler, void *context)
+{
+    if (urcCount >= URC_HANDLERS_MAX)
+        return false;
+
+    urcHandlers[urcCount].prefix = prefix;
+    urcHandlers[urcCount].handler = handler;
+    urcHandlers[urcCount].context = context;
+    urcCount++;
+    return true;
+}
+
+/**
+ * @brief Passes the line to the handler set for its prefix.
+ * 
+ * @return true     If the line is a known URC.
+ * @return false    If no handler is set for the line.
+ */
+bool SIM7600::dispatchURC(const char *line)
+{
+    for (uint8_t i = 0; i < urcCount; i++)
+    {
+        if (strncmp(line, urcHandlers[i].prefix, strlen(urcHandlers[i].prefix)) == 0)
+        {
+            urcHandlers[i].handler(line, urcHandlers[i].context);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Forgets the known state, so that the next commands are sent. Used when the modem restarts.
+ * 
+ */
+void SIM7600::invalidateState()
+{
+    state = {};
+}
+
+/**
+ * @brief Updates the known state from an unsolicited result code. Called with every line from the
+ * modem, also when the URC is the expected token of a response.
+ * 
+ * @param line      Line from the modem.
+ */
+void SIM7600::updateState(const char *line)
+{
+    // "PB DONE" only follows "RDY" with the phonebook, after the boot already went on.
+    if (strcmp(line, "RDY") == 0)
+        invalidateState();
+    else if (strncmp(line, "+CPIN: ", 7) == 0)
+        state.sim = strcmp(line + 7, "READY") == 0 ? STATE_ON : STATE_OFF;
+    else if (strncmp(line, "+CGREG: ", 8) == 0)
+    {
+        // The URC is "+CGREG: <stat>" and the query response "+CGREG: <n>,<stat>".
+        const char *stat = strchr(line + 8, ',');
+        stat = stat == NULL ? line + 8 : stat + 1;
+        int registration = atoi(stat);
+        state.network = registration == 1 || registration == 5 ? STATE_ON : STATE_OFF;
+    }
+    else if (strncmp(line, "+CMQTTCONNLOST: 0,", 18) == 0)
+        state.mqttConnection = STATE_OFF;
+    else if (strncmp(line, "+CMQTTNONET", 11) == 0)
+    {
+        state.mqttService = STATE_UNKNOWN;
+        state.mqttClient = STATE_UNKNOWN;
+        state.mqttSSL = STATE_UNKNOWN;
+        state.mqttConnection = STATE_OFF;
+    }
+    else if (strcmp(line, "+CGPS: 0") == 0)
+        state.gnss = STATE_OFF;
+    else if (strncmp(line, "+CMQTTPUB: 0,", 13) == 0)
+    {
+        // Completion of an asynchronous publish. The ones of blocking publishes are not counted.
+        uint8_t pending = publishesPending.load();
+        while (pending > 0 && !publishesPending.compare_exchange_weak(pending, pending - 1))
+            ;
+        if (pending > 0)
+            publishResults.push(atoi(line + 13));
+    }
+}
+
+/**
+ * @brief Task which owns the serial port. Processes the queued requests one at a time and
+ * reads the unsolicited result codes when idle.
+ * 
+ * @param parameter Object which started the task.
+ */
+void SIM7600::ioTaskLoop(void *parameter)
+{
+    SIM7600 *modem = (SIM7600 *)parameter;
+    request_t request;
+
+    // The static creation returns the handle only after this task may have started.
+    ioTask = xTaskGetCurrentTaskHandle();
+
+    while (true)
+    {
+        // While the modem sleeps it sends nothing, so the task blocks until a request or the ring
+        // indicator. Otherwise it blocks on the transport until bytes come or submit() wakes it up,
+        // so the idle task can enter the light sleep; a plain Stream is polled every 10 ms.
+        TickType_t wait = 0;
+        if (asleep)
+            wait = portMAX_DELAY;
+        else if (!modem->port.available())
+        {
+            if (modem->transport)
+                modem->transport->waitData(MODEM_WAIT_FOREVER);
+            else
+                wait = 10 / portTICK_PERIOD_MS;
+        }
+
+        if (xQueueReceive(requestQueue, &request, wait) == pdTRUE)
+        {
+            response_t response = modem->process(request);
+            if (request.response)
+                *request.response = response;
+            if (request.done)
+                xSemaphoreGive(request.done);
+            continue;
+        }
+
+        while (modem->readLine(millis(), 1) >= 0)
+        {
+            updateState(rxLine);
+            if (!dispatchURC(rxLine))
+                ESP_LOGD("URC", "Unhandled: %s", rxLine);
+        }
+    }
+}
+
+/**
+ * @brief Reads one line from the Modem. Returns as soon as a line terminator is received.
+ * A partial line is kept and completed by the next call, so no bytes are lost on a timeout.
+ * 
+ * @param start     Time (millis()) at which the wait started.
+ * @param timeout   Timeout (in ms) measured from start.
+ * @param prompt    Set it to 'true' to return on the "> " data prompt, which has no line terminator.
+ * @return int      Length of the line in rxLine (null terminated, without "\r\n"), or -1 on timeout.
+ */
+int SIM7600::readLine(uint32_t start, uint32_t timeout, bool prompt)
+{
+    while (millis() - start < timeout)
+    {
+        if (!port.available())
+        {
+            // A transport blocks until bytes come, a plain Stream is polled every tick.
+            if (transport)
+                transport->waitData(timeout - (millis() - start));
+            else
+                vTaskDelay(1);
+            continue;
+        }
+
+        char c = port.read();
+
+        if (c == '\r' || c == '\n')
+        {
+            if (rxLength == 0)
+                continue;
+
+            rxLine[rxLength] = '\0';
+            int length = rxLength;
+            rxLength = 0;
+            return length;
+        }
+
+        if (rxLength < sizeof(rxLine) - 1)
+            rxLine[rxLength++] = c;
+
+        if (prompt && rxLength == 1 && c == '>')
+        {
+            rxLine[rxLength] = '\0';
+            rxLength = 0;
+            return 1;
+        }
+    }
+
+    rxLine[rxLength] = '\0';
+    return -1;
+}
+
+/**
+ * @brief Reads the response from the Modem line by line until a terminator is received.
+ * 
+ * When afterOK is false, the response ends at the final result code ("OK", "ERROR" or "+CME ERROR").
+ * The status is AT_MATCH if the expected token was seen before it. When afterOK is true, "OK" is
+ * skipped and the response ends at the line with the expected token, for results which are sent
+ * after the "OK" (e.g. "+CMQTTCONNECT: 0,0"). The expected token ">" ends the response at the data prompt.
+ * Unsolicited result codes received meanwhile are passed to their handlers.
+ * 
+ * @param expected  Expected token in the response.
+ * @param timeout   Timeout (in ms) for the response.
+ * @param afterOK   Set it to 'true' if the expected token is sent after "OK".
+ * @param onLine    Called with the other lines of the response. Can be NULL.
+ * @param context   Passed to onLine.
+ * @return response_t Status, matched line and time taken.
+ */
+SIM7600::response_t SIM7600::readResponse(const char *expected, uint32_t timeout, bool afterOK, lineHandler_t onLine, void *context)
+{
+    response_t response;
+    response.status = AT_TIMEOUT;
+    response.line[0] = '\0';
+
+    bool prompt = (expected[0] == '>');
+    uint32_t start = millis();
+
+    while (readLine(start, timeout, prompt) >= 0)
+    {
+        const char *line = rxLine;
+        ESP_LOGD("Wait4Resp", "%s", line);
+        updateState(line);
+
+        if (strstr(line, expected))
+        {
+            response.status = AT_MATCH;
+            strcpy(response.line, line);
+
+            if (afterOK || prompt || strcmp(line, "OK") == 0)
+                break;
+        }
+        else if (strcmp(line, "OK") == 0)
+        {
+            if (afterOK)
+                continue;
+            if (response.status != AT_MATCH)
+                response.status = AT_OK;
+            break;
+        }
+        else if (strncmp(line, "+CME ERROR", 10) == 0)
+        {
+            response.status = AT_CME_ERROR;
+            strcpy(response.line, line);
+            break;
+        }
+        else if (strcmp(line, "ERROR") == 0)
+        {
+            response.status = AT_ERROR;
+            strcpy(response.line, line);
+            break;
+        }
+        else if (!dispatchURC(line) && onLine)
+        {
+            onLine(line, context);
+        }
+    }
+
+    response.elapsed = millis() - start;
+
+    ESP_LOGD("Wait4Resp", "%s [%d] %lu ms", response.line, response.status, (unsigned long)response.elapsed);
+
+    return response;
+}
+
+/**
+ * @brief Writes the request to the serial port and reads its response. The time from sending the
+ * command to its terminator is added to the command statistics.
+ * 
+ * @param request   Command, data and expected response.
+ * @return response_t Status, matched line and time taken.
+ */
+SIM7600::response_t SIM7600::process(const request_t &request)
+{
+    if (request.power != POWER_NONE)
+    {
+        response_t response = { AT_OK, "", 0 };
+        if (request.power == POWER_SLEEP)
+            enterSleep();
+        else
+            leaveSleep();
+        return response;
+    }
+
+    if (request.command == NULL && request.baud != 0)
+    {
+        response_t response = { findBaudRate(request.baud) ? AT_OK : AT_ERROR, "", 0 };
+        return response;
+    }
+
+    if (asleep)
+        leaveSleep();
+
+    uint32_t start = millis();
+    response_t response;
+
+    if (request.command)
+    {
+        // Written as is: printf() formats a command longer than 64 bytes in a heap buffer.
+        port.write((const uint8_t *)request.command, strlen(request.command));
+        port.write('\r');
+        exchanges++;
+    }
+
+    bool prompt = request.data || request.source;
+    bool sourceFailed = false;
+
+    if (prompt)
+    {
+        exchanges++;
+        response = readResponse(">", 1000, false, NULL, NULL);
+        if (response.status == AT_MATCH)
+        {
+            if (request.data)
+                port.write((const uint8_t *)request.data, request.length);
+            else
+                sourceFailed = !writeSource(request);
+        }
+    }
+
+    if (!prompt || response.status == AT_MATCH)
+        response = readResponse(request.expected, request.timeout, request.afterOK, request.onLine, request.context);
+
+    if (sourceFailed)
+        response.status = AT_ERROR;
+
+    // The modem answers at the old rate and switches right after its "OK".
+    if (request.baud != 0 && transport && response.status == AT_MATCH)
+    {
+        transport->setBaudRate(request.baud);
+        rxLength = 0;
+    }
+
+    if (request.command)
+        commands.record(request.command, millis() - start, response.status == AT_TIMEOUT,
+                        response.status == AT_ERROR || response.status == AT_CME_ERROR);
+
+    return response;
+}
+
+/**
+ * @brief Writes the data of the request's source in chunks of DATA_CHUNK_SIZE, so the data is
+ * never held in RAM as a whole. The modem waits for the announced length, so if the source fails
+ * the rest is sent as zeros.
+ * 
+ * @return true     If the source gave all the data.
+ * @return false    If the source failed.
+ */
+bool SIM7600::writeSource(const request_t &request)
+{
+    uint8_t chunk[DATA_CHUNK_SIZE];
+    bool success = true;
+
+    for (size_t sent = 0; sent < request.length;)
+    {
+        size_t size = (request.length - sent < sizeof(chunk)) ? request.length - sent : sizeof(chunk);
+        size_t read = success ? request.source(chunk, size, request.sourceContext) : 0;
+
+        if (read == 0 || read > size)
+        {
+            success = false;
+            memset(chunk, 0, size);
+            read = size;
+        }
+
+        port.write(chunk, read);
+        sent += read;
+    }
+    return success;
+}
+
+/**
+ * @brief Queues the request to the I/O task and waits for the response. Without the I/O task
+ * (or when called from it), the request is processed directly.
+ * 
+ * @param request   Command, data and expected response.
+ * @return response_t Status, matched line and time taken.
+ */
+SIM7600::response_t SIM7600::submit(request_t &request)
+{
+    if (ioTask == NULL || xTaskGetCurrentTaskHandle() == ioTask)
+        return process(request);
+
+    // Not the task notification, which the caller may be given for another reason (e.g. a new fix
+    // for the publish task) while it waits: the I/O task would then write into a returned frame.
+    StaticSemaphore_t doneBuffer;
+    response_t response;
+    response.status = AT_TIMEOUT;
+    request.response = &response;
+    request.done = xSemaphoreCreateBinaryStatic(&doneBuffer);
+
+    xQueueSend(requestQueue, &request, portMAX_DELAY);
+    if (transport)
+        transport->wake();
+    xSemaphoreTake(request.done, portMAX_DELAY);
+    vSemaphoreDelete(request.done);
+    request.done = NULL;
+    request.response = NULL;
+
+    return response;
+}
+
+/**
+ * @brief Sends an AT command ("\r" is appended) and reads its response.
+ * 
+ * @param command   AT command, or NULL to only wait for the expected token.
+ * @param expected  Expected token in the response.
+ * @param timeout   Timeout (in ms) for the response.
+ * @param afterOK   Set it to 'true' if the expected token is sent after "OK".
+ * @param onLine    Called with the other lines of the response. Can be NULL.
+ * @param context   Passed to onLine.
+ * @return response_t Status, matched line and time taken.
+ */
+SIM7600::response_t SIM7600::execute(const char *command, const char *expected, uint32_t timeout, bool afterOK, lineHandler_t onLine, void *context)
+{
+    request_t request = { command, NULL, 0, expected, timeout, afterOK, onLine, context, NULL, NULL, POWER_NONE, NULL, NULL, 0 };
+    return submit(request);
+}
+
+/**
+ * @brief Sends an AT command, waits for the "> " prompt, sends the data and reads the response.
+ * No other command can be sent in between.
+ * 
+ * @param command   AT command (e.g. AT+CMQTTPAYLOAD=0,<length>).
+ * @param data      Data to be sent.
+ * @param length    Length of the data.
+ * @param expected  Expected token in the response.
+ * @param timeout   Timeout (in ms) for the response.
+ * @return response_t Status, matched line and time taken.
+ */
+SIM7600::response_t SIM7600::executeData(const char *command, const char *data, size_t length, const char *expected, uint32_t timeout)
+{
+    request_t request = { command, data, length, expected, timeout, false, NULL, NULL, NULL, NULL, POWER_NONE, NULL, NULL, 0 };
+    return submit(request);
+}
+
+/**
+ * @brief Same as executeData(), but the data is read from the source in chunks by the I/O task
+ * (e.g. from flash), so it does not have to be in RAM.
+ * 
+ * @param command   AT command (e.g. AT+CCERTDOWN="<name>",<length>).
+ * @param length    Length of the data.
+ * @param source    Called for every chunk of the data, in order.
+ * @param context   Passed to source.
+ * @param expected  Expected token in the response.
+ * @param timeout   Timeout (in ms) for the response.
+ * @return response_t Status, matched line and time taken. AT_ERROR if the source failed.
+ */
+SIM7600::response_t SIM7600::executeStream(const char *command, size_t length, dataSource_t source, void *context, const char *expected, uint32_t timeout)
+{
+    request_t request = { command, NULL, length, expected, timeout, false, NULL, NULL, NULL, NULL, POWER_NONE, source, context, 0 };
+    return submit(request);
+}
+
+/**
+ * @brief Enables the sleep mode of the modem (AT+CSCLK=1). The modem sleeps while DTR is high and
+ * pulls RI low for an URC, which wakes the ESP32 from light sleep. With power management enabled,
+ * a lock keeps the ESP32 out of light sleep while the modem is awake, so no byte is lost.
+ * 
+ * @param dtr       Pin connected to the DTR input of the modem.
+ * @param ri        Pin connected to the RI output of the modem.
+ * @return true     If the sleep mode is enabled.
+ * @return false    If the modem did not accept AT+CSCLK=1.
+ */
+bool SIM7600::enableSleep(gpio_num_t dtr, gpio_num_t ri)
+{
+    dtrPin = dtr;
+    riPin = ri;
+
+    gpio_reset_pin(dtrPin);
+    gpio_set_direction(dtrPin, GPIO_MODE_OUTPUT);
+    gpio_set_level(dtrPin, 0);
+
+    if (execute("AT+CSCLK=1").status != AT_MATCH)
+        return false;
+
+#ifdef CONFIG_PM_ENABLE
+    if (pmLock == NULL && esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "SIM7600", &pmLock) == ESP_OK)
+        esp_pm_lock_acquire(pmLock);
+#endif
+
+    gpio_reset_pin(riPin);
+    gpio_set_direction(riPin, GPIO_MODE_INPUT);
+    gpio_wakeup_enable(riPin, GPIO_INTR_LOW_LEVEL);
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(riPin, ringInterrupt, this);
+    gpio_intr_disable(riPin);
+    esp_sleep_enable_gpio_wakeup();
+
+    sleepEnabled = true;
+    return true;
+}
+
+/**
+ * @brief Disables the sleep mode of the modem (AT+CSCLK=0). The modem is woken up first.
+ * 
+ * @return true     If the sleep mode is disabled.
+ * @return false    If the modem did not accept AT+CSCLK=0.
+ */
+bool SIM7600::disableSleep()
+{
+    if (!sleepEnabled)
+        return true;
+
+    if (execute("AT+CSCLK=0").status != AT_MATCH)
+        return false;
+
+    gpio_intr_disable(riPin);
+    sleepEnabled = false;
+    return true;
+}
+
+/**
+ * @brief Puts the modem to sleep after the queued requests. The next command wakes it up.
+ * 
+ * @return true     If the modem is asleep.
+ * @return false    If the sleep mode is not enabled.
+ */
+bool SIM7600::sleep()
+{
+    if (!sleepEnabled)
+        return false;
+
+    request_t request = { NULL, NULL, 0, NULL, 0, false, NULL, NULL, NULL, NULL, POWER_SLEEP, NULL, NULL, 0 };
+    submit(request);
+    return asleep;
+}
+
+/**
+ * @brief Sets a handler for the changes of the sleep mode, e.g. for energy accounting. The handler
+ * runs in the I/O task and must not block or send commands.
+ * 
+ */
+void SIM7600::onSleep(sleepHandler_t handler, void *context)
+{
+    sleepHandler = handler;
+    sleepContext = context;
+}
+
+/**
+ * @brief Ring indicator interrupt. Queues a wake request for the I/O task.
+ * 
+ */
+void IRAM_ATTR SIM7600::ringInterrupt(void *)
+{
+    request_t request = { NULL, NULL, 0, NULL, 0, false, NULL, NULL, NULL, NULL, POWER_WAKE, NULL, NULL, 0 };
+    BaseType_t woken = pdFALSE;
+
+    gpio_intr_disable(riPin);
+    if (requestQueue != NULL)
+        xQueueSendFromISR(requestQueue, &request, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void SIM7600::enterSleep()
+{
+    if (!sleepEnabled || asleep)
+        return;
+
+    gpio_set_level(dtrPin, 1);
+    asleep = true;
+    gpio_intr_enable(riPin);
+#ifdef CONFIG_PM_ENABLE
+    if (pmLock)
+        esp_pm_lock_release(pmLock);
+#endif
+
+    if (sleepHandler)
+        sleepHandler(true, sleepContext);
+}
+
+void SIM7600::leaveSleep()
+{
+    if (!asleep)
+        return;
+
+#ifdef CONFIG_PM_ENABLE
+    if (pmLock)
+        esp_pm_lock_acquire(pmLock);
+#endif
+    gpio_intr_disable(riPin);
+    gpio_set_level(dtrPin, 0);
+    delay(MODEM_WAKE_DELAY);
+    asleep = false;
+
+    if (sleepHandler)
+        sleepHandler(false, sleepContext);
+}
+
+/**
+ * @brief Switch OFF echo from the SIM7600 module.
+ * 
+ * @return true     If echo has been switched off.
+ * @return false    If echo has not been switched off.
+ */
+bool SIM7600::echoOFF()
+{
+    return execute("ATE0").status == AT_MATCH;
+}
+
+/**
+ * @brief Checks that the modem answers "AT" at the current baud rate.
+ * 
+ * @return true     If the modem answered.
+ */
+bool SIM7600::probe()
+{
+    for (uint8_t i = 0; i < 2; i++)
+        if (execute("AT", "OK", 200).status == AT_MATCH)
+            return true;
+    return false;
+}
+
+/**
+ * @brief Changes the baud rate of the transport only. In the I/O task, which owns the port.
+ * 
+ */
+void SIM7600::switchTransport(uint32_t baud)
+{
+    transport->setBaudRate(baud);
+    rxLength = 0;
+}
+
+/**
+ * @brief Switches the link to the modem to another baud rate: AT+IPR at the current rate, then
+ * the transport right after the "OK", then "AT" at the new rate. AT+IPR is not saved, so the
+ * modem is back at MODEM_DEFAULT_BAUD after a restart. If the modem does not answer at the new
+ * rate (e.g. the wiring does not carry it), it is asked to go back and so is the transport.
+ * In the I/O task, see findBaudRate().
+ * 
+ * @param baud      Rate supported by the SIM7600, e.g. 921600 or 3000000.
+ * @return true     If the modem answers at the new rate.
+ * @return false    If the modem refused the rate or did not answer at it.
+ */
+bool SIM7600::negotiateBaudRate(uint32_t baud)
+{
+    uint32_t previous = transport->baudRate();
+    if (baud == previous)
+        return true;
+
+    char command[24];
+    snprintf(command, sizeof(command), "AT+IPR=%lu", (unsigned long)baud);
+    request_t request = { command, NULL, 0, "OK", 3000, false, NULL, NULL, NULL, NULL, POWER_NONE, NULL, NULL, baud };
+    if (process(request).status != AT_MATCH)
+        return false;
+
+    if (probe())
+        return true;
+
+    snprintf(command, sizeof(command), "AT+IPR=%lu", (unsigned long)previous);
+    execute(command, "OK", 500);
+    switchTransport(previous);
+    return false;
+}
+
+/**
+ * @brief Finds the baud rate of the modem and negotiates baud, as a single request of the I/O
+ * task: the requests of the other tasks are not sent in between, at a rate which is changing.
+ * 
+ * @param baud      Rate to be used.
+ * @return true     If the modem answers at baud.
+ */
+bool SIM7600::findBaudRate(uint32_t baud)
+{
+    if (transport == NULL)
+        return false;
+
+    if (!probe())
+    {
+        switchTransport((transport->baudRate() == baud) ? MODEM_DEFAULT_BAUD : baud);
+        // No answer at either rate: the modem is starting, and sends its URCs at MODEM_DEFAULT_BAUD.
+        if (!probe())
+        {
+            switchTransport(MODEM_DEFAULT_BAUD);
+            return false;
+        }
+        // The URCs sent at the other rate were lost, "RDY" of a modem which restarted on its own among them.
+        invalidateState();
+    }
+    return negotiateBaudRate(baud);
+}
+
+/**
+ * @brief Finds the baud rate of the modem and switches it to baud. The modem is at
+ * MODEM_DEFAULT_BAUD after a restart, and still at baud after a restart of the ESP32 alone
+ * or when the transport was set back (e.g. by shutdown()) while the modem kept running.
+ * 
+ * @param baud      Rate to be used, supported by the SIM7600 (e.g. 921600 or 3000000).
+ * @return true     If the modem answers at baud.
+ * @return false    Without a transport, if the modem does not answer (e.g. while it starts) or
+ *                  refused the rate.
+ */
+bool SIM7600::syncBaudRate(uint32_t baud)
+{
+    request_t request = { NULL, NULL, 0, NULL, 0, false, NULL, NULL, NULL, NULL, POWER_NONE, NULL, NULL, baud };
+    return submit(request).status == AT_OK;
+}
+
+/**
+ * @brief Waits until the SIM is ready after the modem starts. The "+CPIN: READY" URC sets the
+ * state as soon as it comes; the query covers a modem which was already on and does not send it.
+ * 
+ * @param timeout   Time to wait in ms.
+ * @return true     If the SIM is ready.
+ * @return false    If the modem did not start in time.
+ */
+bool SIM7600::waitReady(uint32_t timeout)
+{
+    uint32_t start = millis();
+
+    while (state.sim != STATE_ON)
+    {
+        if (millis() - start >= timeout)
+            return false;
+        // Not answered while the modem boots. The URC is read during the waits all the same.
+        execute("AT+CPIN?", "+CPIN: READY", 500);
+        if (state.sim != STATE_ON)
+            execute(NULL, "+CPIN: ", 250, true);
+    }
+    return true;
+}
+
+/**
+ * @brief Waits until the module is registered to the packet domain, home or roaming. The
+ * registration URC is enabled and waited for; the query is repeated every 2 s in case it is lost.
+ * 
+ * @param timeout   Time to wait in ms.
+ * @return true     If the module is registered.
+ * @return false    If it is not registered in time.
  */
-bool SIM7600::waitForResponse(const char *s, uint8_t timeout)
+bool SIM7600::waitRegistered(uint32_t timeout)
 {
-    waitingForResponse = true;
-    port.setTimeout(timeout * 1000);
-    String resp1 = port.readString();
-    char *resp = (char *)resp1.c_str();
-    ESP_LOGI("Wait4Resp", "%s\n\n", resp);
+    uint32_t start = millis();
 
-    vTaskDelay(500 / portTICK_PERIOD_MS);
-
-    waitingForResponse = false;
-    port.setTimeout(defaultTimeout);
-    
-    if (strstr(resp, s))
+    if (state.network == STATE_ON)
         return true;
-    else
+
+    execute("AT+CGREG=1");
+    while (true)
+    {
+        execute("AT+CGREG?", "+CGREG: ");
+        // Short waits, so that the commands of the other tasks are not held back.
+        for (uint8_t i = 0; i < 8 && state.network != STATE_ON; i++)
+        {
+            if (millis() - start >= timeout)
+                return false;
+            execute(NULL, "+CGREG: ", 250, true);
+        }
+        if (state.network == STATE_ON)
+            return true;
+    }
+}
+
+/**
+ * @brief Reads the clock of the modem, set by the network time (NITZ) or kept from the last run.
+ * 
+ * @param now       Unix time (UTC).
+ * @return true     If the clock is set.
+ * @return false    If the clock still has its default value ("80/01/06") or there is no answer.
+ */
+bool SIM7600::networkTime(time_t &now)
+{
+    response_t response = execute("AT+CCLK?", "+CCLK: ");
+    if (response.status != AT_MATCH)
+        return false;
+
+    // +CCLK: "yy/MM/dd,hh:mm:ss±zz", local time with the zone in quarters of an hour.
+    int year, month, day, hour, minute, second, zone;
+    if (sscanf(response.line, "+CCLK: \"%d/%d/%d,%d:%d:%d%d\"", &year, &month, &day, &hour, &minute, &second, &zone) != 7 ||
+        year < 20 || year >= 80 || month < 1 || month > 12 || day < 1 || day > 31)
         return false;
+
+    now = (time_t)daysFromCivil(2000 + year, month, day) * 86400 + hour * 3600 + minute * 60 + second - zone * 900;
+    return true;
 }
 
 /**
- * @brief Switch OFF echo from the SIM7600 module.
+ * @brief To check if the module is attached to the packet domain service, which is needed for the
+ * PDP context of the MQTT service.
  * 
- * @return true     If echo has been switched off.
- * @return false    If echo has not been switched off.
+ * @return true     If the module is attached.
+ * @return false    If the module is not attached.
  */
-bool SIM7600::echoOFF()
+bool SIM7600::isAttached()
 {
-    port.printf("ATE0\r");
-    return waitForResponse("OK");
+    return execute("AT+CGATT?", "+CGATT: 1").status == AT_MATCH;
 }
 
 /**
@@ -70,8 +908,10 @@ bool SIM7600::start()
  */
 bool SIM7600::shutdown()
 {
-    port.printf("AT+CPOF\r");
-    return waitForResponse("OK");
+    invalidateState();
+    // The modem starts again at its default rate.
+    request_t request = { "AT+CPOF", NULL, 0, "OK", 3000, false, NULL, NULL, NULL, NULL, POWER_NONE, NULL, NULL, MODEM_DEFAULT_BAUD };
+    return submit(request).status == AT_MATCH;
 }
 
 /**
@@ -82,8 +922,10 @@ bool SIM7600::shutdown()
  */
 bool SIM7600::reset()
 {
-    port.printf("AT+CRESET\r");
-    return waitForResponse("OK");
+    invalidateState();
+    // The modem starts again at its default rate.
+    request_t request = { "AT+CRESET", NULL, 0, "OK", 3000, false, NULL, NULL, NULL, NULL, POWER_NONE, NULL, NULL, MODEM_DEFAULT_BAUD };
+    return submit(request).status == AT_MATCH;
 }
 
 /**
@@ -102,18 +944,30 @@ void SIM7600::powerON()
 void SIM7600::powerOFF()
 {
     gpio_set_level(SIM_POWER_EN, 0);
+    invalidateState();
 }
 
 /**
- * @brief To check if the GPS Modem is ON.
+ * @brief To check if the GPS Modem is ON. The modem is only asked when the state is not known.
  * 
  * @return true     If the GPS Modem is ON.
  * @return false    If the GPS Modem is OFF.
  */
 bool GPS::isOn()
 {
-    port.printf("AT+CGPS?\r");
-    return waitForResponse("+CGPS: 1,1", 3);
+    if (state.gnss != STATE_UNKNOWN)
+    {
+        saved++;
+        return state.gnss == STATE_ON;
+    }
+
+    response_t response = execute("AT+CGPS?", "+CGPS: 1,1");
+    if (response.status == AT_MATCH)
+        state.gnss = STATE_ON;
+    else if (response.status == AT_OK)
+        state.gnss = STATE_OFF;
+
+    return state.gnss == STATE_ON;
 }
 
 /**
@@ -127,12 +981,14 @@ bool GPS::begin()
     if (isOn())
         return true;
 
-    port.printf("AT+CGPS=1\r");
-
-    if (!waitForResponse("OK", 7))
+    if (execute("AT+CGPS=1", "OK", 7000).status != AT_MATCH)
+    {
+        state.gnss = STATE_UNKNOWN;
         return false;
+    }
 
-    return isOn();
+    state.gnss = STATE_ON;
+    return true;
 }
 
 /**
@@ -143,8 +999,12 @@ bool GPS::stop()
 {
     if (isOn())
     {
-        port.printf("AT+CGPS=0\r");
-        return waitForResponse("+CGPS: 0");
+        if (execute("AT+CGPS=0", "+CGPS: 0", defaultTimeout, true).status != AT_MATCH)
+        {
+            state.gnss = STATE_UNKNOWN;
+            return false;
+        }
+        state.gnss = STATE_OFF;
     }
     return true;
 }
@@ -161,8 +1021,27 @@ bool GPS::coldStart()
         if (!stop())
             return false;
 
-    port.printf("AT+CGPSCOLD\r");
-    return waitForResponse("OK");
+    bool success = execute("AT+CGPSCOLD").status == AT_MATCH;
+    state.gnss = success ? STATE_ON : STATE_UNKNOWN;
+    return success;
+}
+
+/**
+ * @brief Used to warm start the GPS Session: the almanac and the last position are kept, the
+ * ephemeris is downloaded again.
+ * 
+ * @return true     If the session is warm started successfully.
+ * @return false    If the session is not warm started due to some error.
+ */
+bool GPS::warmStart()
+{
+    if (isOn())
+        if (!stop())
+            return false;
+
+    bool success = execute("AT+CGPSWARM").status == AT_MATCH;
+    state.gnss = success ? STATE_ON : STATE_UNKNOWN;
+    return success;
 }
 
 /**
@@ -177,201 +1056,331 @@ bool GPS::hotStart()
         if (!stop())
             return false;
 
-    port.printf("AT+CGPSHOT\r");
-    return waitForResponse("OK");
+    bool success = execute("AT+CGPSHOT").status == AT_MATCH;
+    state.gnss = success ? STATE_ON : STATE_UNKNOWN;
+    return success;
+}
+
+/**
+ * @brief Converts ddmm.mmmmmm x 1e6 (micro-minutes) to degrees x 1e7, rounded.
+ * 
+ */
+static int32_t toDegreesE7(int64_t value)
+{
+    int64_t degrees = value / 100000000;
+    int64_t microMinutes = value % 100000000;
+
+    return degrees * 10000000 + (microMinutes * 10 + 30) / 60;
 }
 
 /**
- * @brief Convert data from GPS Modem to decimal degrees and store it in data_t.
+ * @brief Convert data from GPS Modem to degrees x 1e7 and store it in data_t.
  * 
- * @param lat   Latitude (ddmm.mmmmm) from GPS Modem.
+ * @param lat   Latitude (ddmm.mmmmmm x 1e6) from GPS Modem.
  * @param NS    North or South character from GPS Modem.
- * @param lon   Longitude (ddmm.mmmmm) from GPS Modem.
+ * @param lon   Longitude (dddmm.mmmmmm x 1e6) from GPS Modem.
  * @param EW    East or West character from GPS Modem.
  */
-void GPS::calcLatLong(double lat, char NS, double lon, char EW)
+void GPS::calcLatLong(int64_t lat, char NS, int64_t lon, char EW)
 {
-    data.latitude = (floor(lat / 100.0) + fmod(lat, 100.0) / 60.0) * (NS == 'N' ? 1 : -1);
-    data.longitude = (floor(lon / 100.0) + fmod(lon, 100.0) / 60.0) * (EW == 'E' ? 1 : -1);
+    data.latitudeE7 = toDegreesE7(lat) * (NS == 'N' ? 1 : -1);
+    data.longitudeE7 = toDegreesE7(lon) * (EW == 'E' ? 1 : -1);
 }
 
 /**
- * @brief Converts Date and Time to type tm.
+ * @brief Converts Date and Time (UTC) to a Unix timestamp, without mktime() and the time zone.
  * 
- * @param date  Date (ddmmyy) from GPS Modem.
- * @param time  Time (hhmmss.s) from GPS Modem.
+ * @param date      Date (ddmmyy) from GPS Modem.
+ * @param time      Time (hhmmss) from GPS Modem, without the fraction of second.
+ * @return true     If the date and time are in range.
  */
-void GPS::formatDateTime(long date, double timeF)
+bool GPS::formatDateTime(long date, long time)
 {
-    data.timeGPS.tm_year = (date % 100) + 100;
-    date /= 100;
+    int32_t year = 2000 + date % 100;
+    uint32_t month = (date / 100) % 100;
+    uint32_t day = date / 10000;
+    uint32_t hour = time / 10000, minute = (time / 100) % 100, second = time % 100;
 
-    data.timeGPS.tm_mon = (date % 100) - 1;
-    date /= 100;
-
-    data.timeGPS.tm_mday = date;
-
-    long time = long(floor(timeF));
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+        return false;
 
-    data.timeGPS.tm_sec = (time % 100);
-    time /= 100;
+    data.timestamp = (time_t)daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
 
-    data.timeGPS.tm_min = (time % 100);
-    time /= 100;
+/**
+ * @brief Splits the next comma separated field from the buffer. Does not modify the buffer.
+ * 
+ * @param cursor    Current position in the buffer. Moved past the field and its comma.
+ * @param end       End of the buffer.
+ * @param field     Start of the field.
+ * @param length    Length of the field (0 for an empty field).
+ * @return true     If a field (possibly empty) was present.
+ * @return false    If the end of the buffer was reached.
+ */
+static bool nextField(const char *&cursor, const char *end, const char *&field, size_t &length)
+{
+    if (cursor == NULL)
+        return false;
 
-    data.timeGPS.tm_hour = time;
+    field = cursor;
+    while (cursor < end && *cursor != ',' && *cursor != '\r' && *cursor != '\n' && *cursor != '\0')
+        cursor++;
+    length = cursor - field;
 
-    data.timestamp = mktime(&data.timeGPS);
+    if (cursor < end && *cursor == ',')
+        cursor++;
+    else
+        cursor = NULL;
 
-#ifdef ARDUINO_AVR_UNO
-    data.timestamp += UNIX_OFFSET;
-#endif
+    return true;
 }
 
 /**
- * @brief Used to get the coordinates from the GPS Modem and store it the structure data.
+ * @brief Converts a field with an unsigned or signed integer.
  * 
- * @param GNSS      Set it to 'true' to use GNSS or set it to 'false' to use GPS.
- * @return true     If the coordinates from the modem are valid.
- * @return false    If the coordinates from the modem are invalid.
+ * @return true     If the field is non-empty and has only digits.
  */
-bool GPS::getData(bool GNSS)
+static bool parseLong(const char *field, size_t length, long &value)
 {
-    if (!isOn())
-        return false;
+    size_t i = 0;
+    bool negative = false;
 
-    port.printf((GNSS) ? "AT+CGNSSINFO\r" : "AT+CGPSINFO\r");
-    
-    waitingForResponse = true;
+    if (length > 0 && (field[0] == '-' || field[0] == '+'))
+    {
+        negative = (field[0] == '-');
+        i++;
+    }
+    if (i == length || length > 10)
+        return false;
 
-    port.setTimeout(1000);
-   
-    String resp1 = port.readString();
-    int index = resp1.indexOf(": ");
-    index += 2;
+    long result = 0;
+    for (; i < length; i++)
+    {
+        if (field[i] < '0' || field[i] > '9')
+            return false;
+        result = result * 10 + (field[i] - '0');
+    }
 
-    waitingForResponse = false;
+    value = negative ? -result : result;
+    return true;
+}
 
-    resp1.remove(0, index);
-    char *ptr, *posData;
+/**
+ * @brief Converts a field with a decimal number (e.g. "3113.343286", "-12.5") to fixed point,
+ * without floating point. Decimals after the given number are dropped.
+ * 
+ * @param decimals  Number of decimals kept: the value is the number x 10^decimals.
+ * @return true     If the field is non-empty and is a valid decimal number.
+ */
+static bool parseFixed(const char *field, size_t length, uint8_t decimals, int64_t &value)
+{
+    size_t i = 0;
+    bool negative = false;
+    bool digits = false;
 
-    if (resp1.startsWith(","))
-        return false;
-    else
-        ptr = (char *)resp1.c_str();
+    if (length > 0 && (field[0] == '-' || field[0] == '+'))
+    {
+        negative = (field[0] == '-');
+        i++;
+    }
 
-    double lat, lon, time;
-    long date;
-    char NS, EW;
+    int64_t result = 0;
+    uint8_t integerDigits = 0;
+    for (; i < length && field[i] >= '0' && field[i] <= '9'; i++)
+    {
+        result = result * 10 + (field[i] - '0');
+        digits = true;
+        if (++integerDigits > 12)
+            return false;
+    }
 
-    if (GNSS)
+    uint8_t scale = decimals;
+    if (i < length && field[i] == '.')
     {
-        data.fixmode = atoi(ptr);
+        for (i++; i < length && field[i] >= '0' && field[i] <= '9'; i++)
+        {
+            if (scale > 0)
+            {
+                result = result * 10 + (field[i] - '0');
+                scale--;
+            }
+            digits = true;
+        }
+    }
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.GPS_sv = atoi(ptr);
+    if (!digits || i != length)
+        return false;
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.GLONASS_sv = atoi(ptr);
+    for (; scale > 0; scale--)
+        result *= 10;
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.BEIDOU_sv = atoi(ptr);
+    value = negative ? -result : result;
+    return true;
+}
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        lat = atof(ptr);
+/**
+ * @brief Converts a field with a hemisphere character.
+ * 
+ * @return true     If the field is one of the two allowed characters.
+ */
+static bool parseHemisphere(const char *field, size_t length, char positive, char negative, char &value)
+{
+    if (length != 1 || (field[0] != positive && field[0] != negative))
+        return false;
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        NS = ptr[0];
+    value = field[0];
+    return true;
+}
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        lon = atof(ptr);
+/**
+ * @brief Parses the response of AT+CGNSSINFO or AT+CGPSINFO and stores it in the structure data.
+ * 
+ * Single pass over the buffer, which is only read and never has to be null terminated. The
+ * numbers are converted from their digits to fixed point, without floating point.
+ * Missing (truncated) or empty fields are skipped and the corresponding bit in data.valid is left clear.
+ * 
+ * @param buffer    Response line, with or without the "+CGNSSINFO: " / "+CGPSINFO: " prefix.
+ * @param length    Length of the buffer.
+ * @param GNSS      Set it to 'true' for AT+CGNSSINFO or set it to 'false' for AT+CGPSINFO.
+ * @return true     If the position and time are valid.
+ * @return false    If the position or time are missing or invalid.
+ */
+bool GPS::parse(const char *buffer, size_t length, bool GNSS)
+{
+    const char *end = buffer + length;
+    const char *cursor = (const char *)memchr(buffer, ':', length);
+    const char *field;
+    size_t fieldLength;
+    long value;
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        EW = ptr[0];
+    data.valid = 0;
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        date = atol(ptr);
+    if (cursor == NULL)
+        cursor = buffer;
+    else
+        for (cursor++; cursor < end && *cursor == ' '; cursor++);
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        time = atof(ptr);
+    if (GNSS)
+    {
+        bool satellites = true;
+        int8_t *counts[3] = { &data.GPS_sv, &data.GLONASS_sv, &data.BEIDOU_sv };
+
+        if (nextField(cursor, end, field, fieldLength) && parseLong(field, fieldLength, value) && value >= 0 && value <= 3)
+        {
+            data.fixmode = value;
+            data.valid |= VALID_FIXMODE;
+        }
+
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            if (nextField(cursor, end, field, fieldLength) && parseLong(field, fieldLength, value) && value >= 0 && value <= INT8_MAX)
+                *counts[i] = value;
+            else
+                satellites = false;
+        }
+        if (satellites)
+            data.valid |= VALID_SATELLITES;
+    }
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.altitude = atof(ptr);
+    int64_t lat, lon, time, number;
+    long date;
+    char NS = 'N', EW = 'E';
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.speed = atof(ptr);
-        data.speed *= 1.852;
+    bool position = nextField(cursor, end, field, fieldLength) && parseFixed(field, fieldLength, 6, lat);
+    position &= nextField(cursor, end, field, fieldLength) && parseHemisphere(field, fieldLength, 'N', 'S', NS);
+    position &= nextField(cursor, end, field, fieldLength) && parseFixed(field, fieldLength, 6, lon);
+    position &= nextField(cursor, end, field, fieldLength) && parseHemisphere(field, fieldLength, 'E', 'W', EW);
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.course = atof(ptr);
+    if (position && lat >= 0 && lat < 9000000000LL && lon >= 0 && lon < 18000000000LL)
+    {
+        calcLatLong(lat, NS, lon, EW);
+        data.valid |= VALID_POSITION;
+    }
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.dop[PDOP] = atof(ptr);
+    bool dateTime = nextField(cursor, end, field, fieldLength) && fieldLength == 6 && parseLong(field, fieldLength, date);
+    dateTime &= nextField(cursor, end, field, fieldLength) && fieldLength >= 6 && parseFixed(field, fieldLength, 0, time);
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.dop[HDOP] = atof(ptr);
+    if (dateTime && formatDateTime(date, time))
+        data.valid |= VALID_DATETIME;
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.dop[VDOP] = atof(ptr);
-    }
-    else
+    if (nextField(cursor, end, field, fieldLength) && parseFixed(field, fieldLength, 2, number) && number >= INT32_MIN && number <= INT32_MAX)
     {
-        lat = atof(ptr);
+        data.altitudeCm = number;
+        data.valid |= VALID_ALTITUDE;
+    }
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        NS = ptr[0];
+    // Speed over ground in knots x 1000, to cm/s (1 knot = 1852 m/h).
+    if (nextField(cursor, end, field, fieldLength) && parseFixed(field, fieldLength, 3, number) && number >= 0)
+    {
+        number = (number * 1852 + 18000) / 36000;
+        if (number <= UINT16_MAX)
+        {
+            data.speedCms = number;
+            data.valid |= VALID_SPEED;
+        }
+    }
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        lon = atof(ptr);
+    if (nextField(cursor, end, field, fieldLength) && parseFixed(field, fieldLength, 2, number) && number >= 0 && number <= 36000)
+    {
+        data.courseCd = number;
+        data.valid |= VALID_COURSE;
+    }
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        EW = ptr[0];
+    if (GNSS)
+    {
+        bool dop = true;
+        for (uint8_t i = PDOP; i <= VDOP; i++)
+        {
+            dop &= nextField(cursor, end, field, fieldLength) && parseFixed(field, fieldLength, 2, number) && number >= 0 && number <= UINT16_MAX;
+            if (dop)
+                data.dopE2[i] = number;
+        }
+        if (dop)
+            data.valid |= VALID_DOP;
+    }
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        date = atol(ptr);
+    return (data.valid & (VALID_POSITION | VALID_DATETIME)) == (VALID_POSITION | VALID_DATETIME);
+}
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        time = atof(ptr);
+/**
+ * @brief Used to get the coordinates from the GPS Modem and store it the structure data.
+ * 
+ * @param GNSS      Set it to 'true' to use GNSS or set it to 'false' to use GPS.
+ * @return true     If the coordinates from the modem are valid.
+ * @return false    If the coordinates from the modem are invalid.
+ */
+bool GPS::getData(bool GNSS)
+{
+    if (!isOn())
+        return false;
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.altitude = atof(ptr);
+    response_t response = (GNSS) ? execute("AT+CGNSSINFO", "+CGNSSINFO: ", 1000)
+                                 : execute("AT+CGPSINFO", "+CGPSINFO: ", 1000);
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.speed = atof(ptr);
-        data.speed *= 1.852;
+    if (response.status != AT_MATCH)
+        return false;
 
-        posData = strchr(ptr, ',');
-        ptr = posData + 1;
-        data.course = atof(ptr);
-    }
+    return parse(response.line, strlen(response.line), GNSS);
+}
 
-    calcLatLong(lat, NS, lon, EW);
+typedef struct
+{
+    const char *names[3];
+    bool *found;
+}certificateList_t;
 
-    formatDateTime(date, time);
+/**
+ * @brief Marks the certificates listed in a "+CCERTLIST: " line as present.
+ * 
+ */
+static void certificateListLine(const char *line, void *context)
+{
+    certificateList_t *list = (certificateList_t *)context;
 
-    return true;
+    for (uint8_t i = 0; i < 3; i++)
+        if (strstr(line, list->names[i]))
+            list->found[i] = true;
 }
 
 /**
@@ -382,17 +1391,12 @@ bool GPS::getData(bool GNSS)
  */
 bool SSL::checkCertificates(const char *cacert, const char *clientcert, const char *clientkey)
 {
-    port.printf("AT+CCERTLIST\r");
-    
-    waitingForResponse = true;
-    String certificateList_ = port.readString();
-    waitingForResponse = false;
-
-    char *certificateList = (char *) certificateList_.c_str();
+    certs[CACERT]       = false;
+    certs[CLIENTCERT]   = false;
+    certs[CLIENTKEY]    = false;
 
-    certs[CACERT]       = (strstr(certificateList, cacert)) ? true : false;
-    certs[CLIENTCERT]   = (strstr(certificateList, clientcert)) ? true : false;
-    certs[CLIENTKEY]    = (strstr(certificateList, clientkey)) ? true : false;
+    certificateList_t list = { { cacert, clientcert, clientkey }, certs };
+    execute("AT+CCERTLIST", "OK", defaultTimeout, false, certificateListLine, &list);
 
     if (certs[CACERT] && certs[CLIENTCERT] && certs[CLIENTKEY])
         return true;
@@ -400,29 +1404,114 @@ bool SSL::checkCertificates(const char *cacert, const char *clientcert, const ch
         return false;
 }
 
+typedef struct
+{
+    const CertStore *store;
+    bool found[CERT_STORE_MAX];
+}storeList_t;
+
 /**
- * @brief Downloads the required Certificates into the SIM7600 modem from the encrypted nvs partition.
+ * @brief Marks the files of the store listed in a "+CCERTLIST: " line as present.
  * 
- * @todo Add code to get the certificates from the nvs partition and send them to the SIM7600 modem.
+ */
+static void storeListLine(const char *line, void *context)
+{
+    storeList_t *list = (storeList_t *)context;
+    const char *name = strchr(line, '"');
+
+    if (name == NULL)
+        return;
+
+    name++;
+    size_t length = strcspn(name, "\"");
+    for (uint8_t i = 0; i < list->store->count(); i++)
+        if (strlen(list->store->entry(i).name) == length && strncmp(name, list->store->entry(i).name, length) == 0)
+            list->found[i] = true;
+}
+
+typedef struct
+{
+    const CertStore *store;
+    uint8_t index;
+    uint32_t offset;
+    uint32_t hash;
+}storeSource_t;
+
+/**
+ * @brief Data source of AT+CCERTDOWN: the next chunk of the file from flash. Runs in the I/O task.
  * 
- * @return true 
- * @return false 
  */
-bool SSL::downloadCertificates()
+static size_t storeSourceChunk(uint8_t *buffer, size_t size, void *context)
 {
-    if(!certs[CACERT])
-    {
-        
-    }
-    if(!certs[CLIENTCERT])
+    storeSource_t *source = (storeSource_t *)context;
+
+    if (!source->store->read(source->index, source->offset, buffer, size))
+        return 0;
+
+    source->offset += size;
+    source->hash = CertStore::hash(buffer, size, source->hash);
+    return size;
+}
+
+/**
+ * @brief Downloads the certificates and keys of the store into the SIM7600 modem with
+ * AT+CCERTDOWN, streamed from flash in chunks of DATA_CHUNK_SIZE. A file which is listed by the
+ * modem and was last downloaded with the same content hash is skipped, so provisioning is only
+ * done on the first boot or after a certificate changed.
+ * 
+ * @param store     Certificates in flash (see CertStore).
+ * @return true     If all the files of the store are in the modem.
+ * @return false    If a download failed or the content read back from flash did not match its hash.
+ */
+bool SSL::downloadCertificates(CertStore &store)
+{
+    storeList_t list = { &store, {} };
+    if (store.count() > 0 && execute("AT+CCERTLIST", "OK", defaultTimeout, false, storeListLine, &list).status != AT_MATCH)
+        return false;
+
+    bool success = true;
+    char command[32 + CERT_NAME_MAX];
+
+    for (uint8_t i = 0; i < store.count(); i++)
     {
+        const CertStore::entry_t &entry = store.entry(i);
+
+        if (list.found[i] && store.isProvisioned(i))
+        {
+            saved++;
+            continue;
+        }
+
+        storeSource_t source = { &store, i, 0, 2166136261u };
+        snprintf(command, sizeof(command), "AT+CCERTDOWN=\"%s\",%lu", entry.name, (unsigned long)entry.length);
 
+        bool downloaded = executeStream(command, entry.length, storeSourceChunk, &source, "OK", 5000).status == AT_MATCH &&
+                          source.hash == entry.hash;
+        store.setProvisioned(i, downloaded);
+        success &= downloaded;
+
+        // The SSL context has to be set again to use the new file.
+        state.sslContext = STATE_UNKNOWN;
     }
-    if(!certs[CLIENTKEY])
-    {
+    return success;
+}
+
+/**
+ * @brief FNV-1a hash of the certificate names, to know if the SSL context has to be set again.
+ * 
+ */
+uint32_t SSL::configHash(const char *cacert, const char *clientcert, const char *clientkey)
+{
+    const char *names[3] = { cacert, clientcert, clientkey };
+    uint32_t hash = 2166136261u;
 
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        for (const char *c = names[i]; *c; c++)
+            hash = (hash ^ (uint8_t)*c) * 16777619u;
+        hash = (hash ^ 0xFF) * 16777619u;
     }
-    return true;
+    return hash;
 }
 
 /**
@@ -433,27 +1522,30 @@ bool SSL::downloadCertificates()
  */
 bool SSL::configureSSL(const char *cacert, const char *clientcert, const char *clientkey)
 {
-    port.printf("AT+CSSLCFG=\"sslversion\",0,4\r");
-    bool status = waitForResponse("OK");
+    char command[96];
+    uint32_t config = configHash(cacert, clientcert, clientkey);
+
+    if (state.sslContext == STATE_ON && state.sslConfig == config)
+    {
+        saved += 5;
+        return true;
+    }
 
-    port.printf("AT+CSSLCFG=\"authmode\",0,2\r");
-    status &= waitForResponse("OK");
+    bool status = execute("AT+CSSLCFG=\"sslversion\",0,4").status == AT_MATCH;
 
-    port.printf("AT+CSSLCFG=\"cacert\",0,\"");
-    port.printf("%s", cacert);
-    port.printf("\"\r");
-    status &= waitForResponse("OK");
+    status &= execute("AT+CSSLCFG=\"authmode\",0,2").status == AT_MATCH;
 
-    port.printf("AT+CSSLCFG=\"clientcert\",0,\"");
-    port.printf("%s", clientcert);
-    port.printf("\"\r");
-    status &= waitForResponse("OK");
+    snprintf(command, sizeof(command), "AT+CSSLCFG=\"cacert\",0,\"%s\"", cacert);
+    status &= execute(command).status == AT_MATCH;
 
-    port.printf("AT+CSSLCFG=\"clientkey\",0,\"");
-    port.printf("%s", clientkey);
-    port.printf("\"\r");
-    status &= waitForResponse("OK");
+    snprintf(command, sizeof(command), "AT+CSSLCFG=\"clientcert\",0,\"%s\"", clientcert);
+    status &= execute(command).status == AT_MATCH;
 
+    snprintf(command, sizeof(command), "AT+CSSLCFG=\"clientkey\",0,\"%s\"", clientkey);
+    status &= execute(command).status == AT_MATCH;
+
+    state.sslContext = status ? STATE_ON : STATE_UNKNOWN;
+    state.sslConfig = config;
     return status;
 }
 
@@ -467,9 +1559,15 @@ bool SSL::configureSSL(const char *cacert, const char *clientcert, const char *c
  */
 bool MQTT::begin()
 {
-    port.printf("AT+CMQTTSTART\r");
+    if (state.mqttService == STATE_ON)
+    {
+        saved++;
+        return true;
+    }
 
-    return waitForResponse("OK");
+    bool success = execute("AT+CMQTTSTART").status == AT_MATCH;
+    state.mqttService = success ? STATE_ON : STATE_UNKNOWN;
+    return success;
 }
 
 /**
@@ -480,9 +1578,18 @@ bool MQTT::begin()
  */
 bool MQTT::end()
 {
-    port.printf("AT+CMQTTSTOP\r");
+    if (state.mqttService == STATE_OFF)
+    {
+        saved++;
+        return true;
+    }
 
-    return waitForResponse("OK");
+    bool success = execute("AT+CMQTTSTOP").status == AT_MATCH;
+    state.mqttService = success ? STATE_OFF : STATE_UNKNOWN;
+    state.mqttClient = state.mqttService;
+    state.mqttSSL = state.mqttService;
+    state.mqttConnection = state.mqttService;
+    return success;
 }
 
 /**
@@ -496,8 +1603,15 @@ bool MQTT::acquireClient()
     uint8_t mac[6];
     esp_read_mac(mac, ESP_MAC_WIFI_STA);
     // port.printf("AT+MQTTACCQ=0,\"ESP%d%d%d%d%d%d\",1\r", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-    port.printf("AT+CMQTTACCQ=0,\"SIM7600_Test\",1\r");
-    return waitForResponse("OK");
+    if (state.mqttClient == STATE_ON)
+    {
+        saved++;
+        return true;
+    }
+
+    bool success = execute("AT+CMQTTACCQ=0,\"SIM7600_Test\",1").status == AT_MATCH;
+    state.mqttClient = success ? STATE_ON : STATE_UNKNOWN;
+    return success;
 }
 
 /**
@@ -508,8 +1622,17 @@ bool MQTT::acquireClient()
  */
 bool MQTT::releaseClient()
 {
-    port.printf("AT+CMQTTREL=0\r");
-    return waitForResponse("OK", 1);
+    if (state.mqttClient == STATE_OFF)
+    {
+        saved++;
+        return true;
+    }
+
+    bool success = execute("AT+CMQTTREL=0", "OK", 1000).status == AT_MATCH;
+    state.mqttClient = success ? STATE_OFF : STATE_UNKNOWN;
+    state.mqttSSL = state.mqttClient;
+    state.mqttConnection = state.mqttClient;
+    return success;
 }
 
 /**
@@ -520,8 +1643,15 @@ bool MQTT::releaseClient()
  */
 bool MQTT::setSSLContext()
 {
-    port.printf("AT+CMQTTSSLCFG=0,0\r");
-    return waitForResponse("OK");
+    if (state.mqttSSL == STATE_ON)
+    {
+        saved++;
+        return true;
+    }
+
+    bool success = execute("AT+CMQTTSSLCFG=0,0").status == AT_MATCH;
+    state.mqttSSL = success ? STATE_ON : STATE_UNKNOWN;
+    return success;
 }
 
 /**
@@ -534,11 +1664,19 @@ bool MQTT::setSSLContext()
  */
 bool MQTT::connect(const char *serverAddress, unsigned int serverPort)
 {
-    port.printf("AT+CMQTTCONNECT=0,\"");
-    port.printf("%s:%u", serverAddress, serverPort);
-    port.printf("\",60,1\r");
+    if (state.mqttConnection == STATE_ON)
+    {
+        saved++;
+        return true;
+    }
 
-    return waitForResponse("+CMQTTCONNECT: 0,0", 5);
+    char command[160];
+    snprintf(command, sizeof(command), "AT+CMQTTCONNECT=0,\"%s:%u\",60,1", serverAddress, serverPort);
+
+    response_t response = execute(command, "+CMQTTCONNECT: 0,", 5000, true);
+    bool success = response.status == AT_MATCH && strcmp(response.line, "+CMQTTCONNECT: 0,0") == 0;
+    state.mqttConnection = success ? STATE_ON : STATE_UNKNOWN;
+    return success;
 }
 
 /**
@@ -549,8 +1687,15 @@ bool MQTT::connect(const char *serverAddress, unsigned int serverPort)
  */
 bool MQTT::disconnect()
 {
-    port.printf("AT+CMQTTDISC=0,60\r");
-    return waitForResponse("OK");
+    if (state.mqttConnection == STATE_OFF)
+    {
+        saved++;
+        return true;
+    }
+
+    bool success = execute("AT+CMQTTDISC=0,60").status == AT_MATCH;
+    state.mqttConnection = success ? STATE_OFF : STATE_UNKNOWN;
+    return success;
 }
 
 /**
@@ -561,22 +1706,35 @@ bool MQTT::disconnect()
  * @return true 
  * @return false 
  */
-bool MQTT::setPublishTopicPayload(char *topic, char *payload)
+bool MQTT::setPublishTopicPayload(const char *topic, const char *payload)
+{
+    return setPublishTopicPayload(topic, payload, strlen(payload));
+}
+
+/**
+ * @brief Used to set the Publish Topic and a Payload which may have binary data.
+ * 
+ * @param topic         Topic to which payload has to be published.
+ * @param payload       Payload of the message.
+ * @param payloadLength Length of the payload.
+ * @return true 
+ * @return false 
+ */
+bool MQTT::setPublishTopicPayload(const char *topic, const char *payload, size_t payloadLength)
 {
     unsigned int topicLength = strlen(topic);
-    unsigned int payloadLength = strlen(payload);
 
-    port.printf("AT+CMQTTTOPIC=0,%u\r", topicLength);
-    waitForResponse(">", 1);
+    if (payloadLength == 0 || payloadLength > MQTT_PAYLOAD_MAX)
+        return false;
 
-    port.printf("%s", topic);
-    waitForResponse("OK");
+    char command[32];
 
-    port.printf("AT+CMQTTPAYLOAD=0,%u\r", payloadLength);
-    waitForResponse(">", 1);
+    snprintf(command, sizeof(command), "AT+CMQTTTOPIC=0,%u", topicLength);
+    if (executeData(command, topic, topicLength).status != AT_MATCH)
+        return false;
 
-    port.printf("%s", payload);
-    return waitForResponse("OK");
+    snprintf(command, sizeof(command), "AT+CMQTTPAYLOAD=0,%u", (unsigned int)payloadLength);
+    return executeData(command, payload, payloadLength).status == AT_MATCH;
 }
 
 /**
@@ -587,6 +1745,79 @@ bool MQTT::setPublishTopicPayload(char *topic, char *payload)
  */
 bool MQTT::publish()
 {
-    port.printf("AT+CMQTTPUB=0,0,120\r");
-    return waitForResponse("OK", 5);
-}
\ No newline at end of file
+    response_t response = execute("AT+CMQTTPUB=0,0,120", "+CMQTTPUB: 0,", 5000, true);
+    bool success = response.status == AT_MATCH && strcmp(response.line, "+CMQTTPUB: 0,0") == 0;
+    if (!success)
+        state.mqttConnection = STATE_UNKNOWN;
+    return success;
+}
+
+/**
+ * @brief Publish the message without waiting for its completion. The modem answers "OK" once the
+ * message is queued and sends "+CMQTTPUB: 0,<err>" when it is delivered (PUBACK for QoS 1), which
+ * can be collected with publishResult(). The topic and payload of the next message can be set
+ * meanwhile. The completions come in the order of the publishes.
+ * 
+ * @param qos       0 or 1.
+ * @param timeout   Time (in s) after which the modem reports the publish as failed.
+ * @return true     If the modem accepted the message.
+ * @return false    If it did not. No completion follows.
+ */
+bool MQTT::publishAsync(uint8_t qos, uint16_t timeout)
+{
+    char command[32];
+    snprintf(command, sizeof(command), "AT+CMQTTPUB=0,%u,%u", qos, timeout);
+
+    // Counted before the command, as the completion may follow "OK" in the same read.
+    publishesPending++;
+    if (execute(command).status == AT_MATCH)
+        return true;
+
+    uint8_t pending = publishesPending.load();
+    while (pending > 0 && !publishesPending.compare_exchange_weak(pending, pending - 1))
+        ;
+    state.mqttConnection = STATE_UNKNOWN;
+    return false;
+}
+
+/**
+ * @brief Oldest completion of the asynchronous publishes not yet collected.
+ * 
+ * @param error     <err> of "+CMQTTPUB: 0,<err>", 0 if the message was delivered.
+ * @return true     If there was a completion.
+ */
+bool MQTT::publishResult(uint8_t &error)
+{
+    return publishResults.pop(error);
+}
+
+/**
+ * @brief Stops waiting for the pending asynchronous publishes, e.g. when the connection is lost.
+ * Their completions, if any, are ignored.
+ * 
+ */
+void MQTT::cancelPublishes()
+{
+    uint8_t error;
+    publishesPending = 0;
+    while (publishResults.pop(error))
+        ;
+}
+
+/**
+ * @brief Estimates the bytes sent over the cellular link for one publish: MQTT PUBLISH packet
+ * (with the packet identifier for QoS 1) in one TLS 1.2 record with AES-GCM (29 bytes of
+ * header, nonce and tag).
+ * 
+ * @param topicLength   Length of the topic.
+ * @param payloadLength Length of the payload.
+ * @param qos           QoS of the publish.
+ * @return size_t       Bytes sent.
+ */
+size_t MQTT::airtime(size_t topicLength, size_t payloadLength, uint8_t qos)
+{
+    size_t remaining = 2 + topicLength + payloadLength + (qos > 0 ? 2 : 0);
+    size_t lengthBytes = (remaining < 128) ? 1 : (remaining < 16384) ? 2 : 3;
+
+    return 1 + lengthBytes + remaining + 29;
+}
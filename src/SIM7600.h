@@ -2,61 +2,253 @@
 #define SIM7600_H
 
 #include "Arduino.h"
+#include "CommandStats.h"
+#include "ModemTransport.h"
+#include "SPSCQueue.h"
+#include <atomic>
 #include <time.h>
 
+#define RESPONSE_LINE_MAX 128
+#define URC_HANDLERS_MAX 8
+#define REQUEST_QUEUE_LENGTH 8
+#define MODEM_IO_STACK_SIZE 4096    // Bytes, statically allocated with the task control block.
+#define MQTT_PAYLOAD_MAX 10240      // Maximum length for AT+CMQTTPAYLOAD.
+#define MODEM_WAKE_DELAY 50         // Time (in ms) from DTR low until the modem accepts commands.
+#define DATA_CHUNK_SIZE 256         // Bytes of a data source written to the modem at once.
+#define PUBLISH_RESULTS_LENGTH 16   // Completions of asynchronous publishes not yet collected.
+
+#ifdef CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+class CertStore;
+
 class SIM7600
 {
     public:
         SIM7600(Stream &serial);
+        SIM7600(ModemTransport &transport);
+
+        typedef enum
+        {
+            AT_OK = 0,          // Final "OK" received, expected token not seen.
+            AT_MATCH,           // Expected token received.
+            AT_ERROR,           // Final "ERROR" received.
+            AT_CME_ERROR,       // Final "+CME ERROR: <n>" received.
+            AT_TIMEOUT          // No final result code before the timeout.
+        }status_t;
+
+        typedef struct
+        {
+            status_t status;
+            char line[RESPONSE_LINE_MAX];   // Matched (or error) line, without the line terminator.
+            uint32_t elapsed;               // Time (in ms) taken for the response.
+        }response_t;
+
+        // Called with every line of a response which is not the final result code, or with an URC.
+        typedef void (*lineHandler_t)(const char *line, void *context);
+
+        // Called when the modem enters or leaves the sleep mode.
+        typedef void (*sleepHandler_t)(bool asleep, void *context);
+
+        // Fills the buffer with the next bytes of the data sent after the "> " prompt. Returns
+        // the number of bytes (at most size), or 0 on error.
+        typedef size_t (*dataSource_t)(uint8_t *buffer, size_t size, void *context);
+
+        typedef enum
+        {
+            STATE_UNKNOWN = 0,  // The command is always sent.
+            STATE_OFF,
+            STATE_ON
+        }state_t;
+
+        // Last known state of the modem, from the command results and URCs. Commands which would
+        // not change it are not sent.
+        typedef struct
+        {
+            state_t sim;                // SIM ready, from "+CPIN: READY".
+            state_t network;            // Registered to the packet domain, from "+CGREG: ".
+            state_t gnss;
+            state_t mqttService;
+            state_t mqttClient;
+            state_t mqttSSL;            // SSL context set for the MQTT client.
+            state_t mqttConnection;
+            state_t sslContext;
+            uint32_t sslConfig;         // Hash of the certificate names of the SSL context.
+        }modemState_t;
+
+        static uint32_t exchangeCount() { return exchanges; }
+        static TaskHandle_t ioTaskHandle() { return ioTask; }
+        static const modemState_t &modemState() { return state; }
+        static uint32_t commandsSaved() { return saved; }
+        static const CommandStats &commandStats() { return commands; }
+        static void invalidateState();
+
         bool isModuleON();
         bool waitForResponse(const char *s,uint8_t timeout=3);
+        response_t execute(const char *command, const char *expected = "OK", uint32_t timeout = 3000, bool afterOK = false,
+                           lineHandler_t onLine = NULL, void *context = NULL);
+        response_t executeData(const char *command, const char *data, size_t length, const char *expected = "OK", uint32_t timeout = 3000);
+        response_t executeStream(const char *command, size_t length, dataSource_t source, void *context,
+                                 const char *expected = "OK", uint32_t timeout = 3000);
+        bool startIOTask(UBaseType_t priority = 2, BaseType_t core = 0);
+        static bool onURC(const char *prefix, lineHandler_t handler, void *context = NULL);
+        bool enableSleep(gpio_num_t dtr, gpio_num_t ri);
+        bool disableSleep();
+        bool sleep();
+        static bool isAsleep() { return asleep; }
+        static void onSleep(sleepHandler_t handler, void *context = NULL);
         bool echoOFF();
+        bool syncBaudRate(uint32_t baud);
+        bool waitReady(uint32_t timeout);
+        bool waitRegistered(uint32_t timeout);
+        bool networkTime(time_t &now);
+        bool isAttached();
         bool start();
         bool shutdown();
         bool reset();
         void powerON();
         void powerOFF();
-        bool waitingForResponse = false;
 
     protected:
+        typedef enum
+        {
+            POWER_NONE = 0,
+            POWER_SLEEP,            // Set DTR high after the queued requests.
+            POWER_WAKE              // Set DTR low, e.g. on the ring indicator.
+        }power_t;
+
+        typedef struct
+        {
+            const char *command;    // AT command without "\r", or NULL to only read.
+            const char *data;       // Data sent after the "> " prompt, or NULL.
+            size_t length;
+            const char *expected;
+            uint32_t timeout;
+            bool afterOK;
+            lineHandler_t onLine;
+            void *context;
+            response_t *response;   // Filled by the I/O task.
+            SemaphoreHandle_t done; // Given by the I/O task when the response is complete.
+            power_t power;          // Sleep mode change instead of a command.
+            dataSource_t source;    // Gives the data in chunks if data is NULL, or NULL.
+            void *sourceContext;
+            uint32_t baud;          // Baud rate of the transport after the "OK", or 0. Without a command: syncBaudRate().
+        }request_t;
+
+        typedef struct
+        {
+            const char *prefix;
+            lineHandler_t handler;
+            void *context;
+        }urc_t;
+
+        response_t submit(request_t &request);
+        response_t process(const request_t &request);
+        bool writeSource(const request_t &request);
+        response_t readResponse(const char *expected, uint32_t timeout, bool afterOK, lineHandler_t onLine, void *context);
+        int readLine(uint32_t start, uint32_t timeout, bool prompt = false);
+        static bool dispatchURC(const char *line);
+        static void updateState(const char *line);
+        static void ioTaskLoop(void *parameter);
+        static void IRAM_ATTR ringInterrupt(void *parameter);
+        void enterSleep();
+        void leaveSleep();
+        bool probe();
+        void switchTransport(uint32_t baud);
+        bool negotiateBaudRate(uint32_t baud);
+        bool findBaudRate(uint32_t baud);
+
         Stream &port;
+        ModemTransport *transport = NULL;   // Same as port, if it can wait for data and change its baud rate.
         gpio_num_t SIM_POWER_EN = GPIO_NUM_4;
         long defaultTimeout = 3000;
 
-
+        // Shared by all the objects, as they all use the same modem.
+        static QueueHandle_t requestQueue;
+        static std::atomic<TaskHandle_t> ioTask;     // Set by startIOTask() and by the task itself, which may run first.
+        static uint8_t requestStorage[REQUEST_QUEUE_LENGTH * sizeof(request_t)];
+        static StaticQueue_t requestQueueBuffer;
+        static StackType_t ioStack[MODEM_IO_STACK_SIZE];
+        static StaticTask_t ioTaskBuffer;
+        static char rxLine[RESPONSE_LINE_MAX];
+        static size_t rxLength;
+        static urc_t urcHandlers[URC_HANDLERS_MAX];
+        static uint8_t urcCount;
+        static uint32_t exchanges;      // Commands and data bodies sent to the modem.
+        static modemState_t state;
+        static uint32_t saved;          // Commands not sent because of the known state.
+        static CommandStats commands;   // Latency and errors of every command, written by the I/O task.
+        static std::atomic<uint8_t> publishesPending;   // Asynchronous publishes waiting for "+CMQTTPUB: 0,<err>".
+        static SPSCQueue<uint8_t, PUBLISH_RESULTS_LENGTH> publishResults;  // <err> of the completions, I/O task to publisher.
+        static gpio_num_t dtrPin;
+        static gpio_num_t riPin;
+        static bool sleepEnabled;
+        static volatile bool asleep;
+        static sleepHandler_t sleepHandler;
+        static void *sleepContext;
+#ifdef CONFIG_PM_ENABLE
+        static esp_pm_lock_handle_t pmLock;     // Held while the modem is awake, so the UART keeps its clock.
+#endif
 };
 
 class GPS: public SIM7600
 {
     public:
         GPS(Stream &serial1):SIM7600(serial1){}
+        GPS(ModemTransport &transport):SIM7600(transport){}
         
+        /**
+         * Fix in fixed point, parsed from the digits of the response without floating point
+         * (the ESP32 has no double precision FPU). The double accessors give the values in the
+         * units used before: degrees, m, km/h.
+         */
         typedef struct
         {
             int8_t fixmode;
             int8_t GPS_sv;
             int8_t GLONASS_sv;
             int8_t BEIDOU_sv;
-            double latitude;
-            double longitude;
-            tm timeGPS;
-            double altitude;
-            double speed;
-            double course;
-            double dop[3];
+            int32_t latitudeE7;     // Degrees x 1e7.
+            int32_t longitudeE7;    // Degrees x 1e7.
+            int32_t altitudeCm;     // cm
+            uint16_t speedCms;      // cm/s
+            uint16_t courseCd;      // Degrees x 100.
+            uint16_t dopE2[3];      // PDOP, HDOP, VDOP x 100.
+            uint16_t valid;         // Bit mask of valid_t for the fields set by the last parse.
             time_t timestamp;
+
+            double latitude() const { return latitudeE7 / 1e7; }
+            double longitude() const { return longitudeE7 / 1e7; }
+            double altitude() const { return altitudeCm / 100.0; }
+            double speed() const { return speedCms * 0.036; }           // km/h
+            double course() const { return courseCd / 100.0; }
+            double dop(uint8_t i) const { return dopE2[i] / 100.0; }
+            tm dateTime() const { tm t; gmtime_r(&timestamp, &t); return t; }
         }data_t;
         data_t data;
 
-        
+        typedef enum
+        {
+            VALID_FIXMODE       = 1 << 0,
+            VALID_SATELLITES    = 1 << 1,
+            VALID_POSITION      = 1 << 2,
+            VALID_DATETIME      = 1 << 3,
+            VALID_ALTITUDE      = 1 << 4,
+            VALID_SPEED         = 1 << 5,
+            VALID_COURSE        = 1 << 6,
+            VALID_DOP           = 1 << 7
+        }valid_t;
 
         bool isOn();
         bool begin();
         bool stop();
         bool coldStart();
+        bool warmStart();
         bool hotStart();
-        void calcLatLong(double lat, char NS, double lon, char EW);
-        void formatDateTime(long date, double time);
+        void calcLatLong(int64_t lat, char NS, int64_t lon, char EW);
+        bool formatDateTime(long date, long time);
+        bool parse(const char *buffer, size_t length, bool GNSS=true);
         bool getData(bool GNSS=true);
         
         
@@ -76,17 +268,18 @@ class SSL: public SIM7600
 {
     public:
         SSL(Stream &serial1):SIM7600(serial1){}
+        SSL(ModemTransport &transport):SIM7600(transport){}
         
         bool checkCertificates(const char *cacert, const char *clientcert, const char *clientkey);
-        
-        // TODO
-        bool downloadCertificates();
+        bool downloadCertificates(CertStore &store);
         bool configureSSL(const char *cacert, const char *clientcert, const char *clientkey);
         
         // Not implemented as not used in this project.
         bool deleteCertificate(char *certificate);
 
     private:
+        static uint32_t configHash(const char *cacert, const char *clientcert, const char *clientkey);
+
         bool certs[3];
 
         enum
@@ -102,6 +295,7 @@ class MQTT: public SIM7600
 {
     public:
         MQTT(Stream &serial1):SIM7600(serial1){}
+        MQTT(ModemTransport &transport):SIM7600(transport){}
 
         bool begin();
         bool end();
@@ -110,8 +304,13 @@ class MQTT: public SIM7600
         bool setSSLContext();
         bool connect(const char *serverAddress, unsigned int serverPort);
         bool disconnect();
-        bool setPublishTopicPayload(char *topic, char *payload);
+        bool setPublishTopicPayload(const char *topic, const char *payload);
+        bool setPublishTopicPayload(const char *topic, const char *payload, size_t payloadLength);
         bool publish();
+        bool publishAsync(uint8_t qos, uint16_t timeout);
+        static bool publishResult(uint8_t &error);
+        static void cancelPublishes();
+        static size_t airtime(size_t topicLength, size_t payloadLength, uint8_t qos = 0);
 
 
 };
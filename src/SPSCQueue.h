@@ -0,0 +1,96 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Bounded lock-free queue for one producer task and one consumer task.
+ *
+ * The producer only writes head and the consumer only writes tail, so no lock is needed. The
+ * length must be a power of two. When the queue is full, push() fails and the item is counted
+ * as dropped: the producer never waits for the consumer and never overwrites an item which the
+ * consumer may be reading.
+ */
+template <typename T, size_t LENGTH>
+class SPSCQueue
+{
+    static_assert(LENGTH >= 2 && (LENGTH & (LENGTH - 1)) == 0, "SPSCQueue length must be a power of two");
+
+    public:
+        /**
+         * @brief Add an item. Only called by the producer.
+         *
+         * @return true     If the item was added.
+         * @return false    If the queue is full. The item is dropped.
+         */
+        bool push(const T &item)
+        {
+            size_t head = this->head.load(std::memory_order_relaxed);
+            size_t used = head - tail.load(std::memory_order_acquire);
+
+            if (used >= LENGTH)
+            {
+                droppedCount++;
+                return false;
+            }
+
+            items[head & (LENGTH - 1)] = item;
+            this->head.store(head + 1, std::memory_order_release);
+
+            if (used + 1 > highWater)
+                highWater = used + 1;
+            return true;
+        }
+
+        /**
+         * @brief Remove the oldest item. Only called by the consumer.
+         *
+         * @return true     If an item was removed.
+         * @return false    If the queue is empty.
+         */
+        bool pop(T &item)
+        {
+            size_t tail = this->tail.load(std::memory_order_relaxed);
+
+            if (tail == head.load(std::memory_order_acquire))
+                return false;
+
+            item = items[tail & (LENGTH - 1)];
+            this->tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief Read the oldest item without removing it, so that it stays queued until it has
+         * been handled (e.g. published). Only called by the consumer.
+         *
+         * @return true     If there is an item.
+         * @return false    If the queue is empty.
+         */
+        bool peek(T &item) const
+        {
+            size_t tail = this->tail.load(std::memory_order_relaxed);
+
+            if (tail == head.load(std::memory_order_acquire))
+                return false;
+
+            item = items[tail & (LENGTH - 1)];
+            return true;
+        }
+
+        size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+        size_t capacity() const { return LENGTH; }
+        uint32_t dropped() const { return droppedCount; }
+        size_t highWaterMark() const { return highWater; }
+
+    private:
+        T items[LENGTH];
+        std::atomic<size_t> head{0};
+        std::atomic<size_t> tail{0};
+        uint32_t droppedCount = 0;      // Written by the producer only.
+        size_t highWater = 0;           // Written by the producer only.
+};
+
+#endif
@@ -0,0 +1,250 @@
+#include "TrackBuffer.h"
+
+#define SLOTS_PER_SECTOR (TRACK_SECTOR_SIZE / sizeof(record_t))
+#define ERASED 0xFFFFFFFF
+
+/**
+ * @brief Finds the partition and recovers the ring pointers and the sequence number from flash.
+ * 
+ * @param label     Label of the partition in partitions.csv.
+ * @return true     If the partition was found.
+ * @return false    If the partition is missing.
+ */
+bool TrackBuffer::begin(const char *label)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)TRACK_PARTITION_SUBTYPE, label);
+    if (partition == NULL)
+        return false;
+
+    slots = (partition->size / TRACK_SECTOR_SIZE) * SLOTS_PER_SECTOR;
+    uint32_t sectors = slots / SLOTS_PER_SECTOR;
+
+    // The sector with the highest sequence number in its first slot has the newest records.
+    record_t record;
+    int32_t newest = -1;
+    uint32_t newestSequence = 0;
+
+    for (uint32_t sector = 0; sector < sectors; sector++)
+    {
+        if (readSlot(sector * SLOTS_PER_SECTOR, record) && record.sequence != ERASED &&
+            (newest < 0 || record.sequence > newestSequence))
+        {
+            newest = sector;
+            newestSequence = record.sequence;
+        }
+    }
+
+    head = tail = count = 0;
+    nextSequence = 0;
+
+    if (newest < 0)
+        return true;
+
+    head = newest * SLOTS_PER_SECTOR;
+    nextSequence = newestSequence;
+    for (uint32_t slot = head; slot < head + SLOTS_PER_SECTOR; slot++)
+    {
+        readSlot(slot, record);
+        if (record.sequence == ERASED)
+            break;
+        nextSequence = record.sequence + 1;
+        head = (slot + 1) % slots;
+    }
+
+    // Oldest records are in the sectors following the newest one. Drained sectors are skipped
+    // by checking their last written record, as records are drained in order.
+    tail = head;
+    for (uint32_t i = 1; i <= sectors; i++)
+    {
+        uint32_t sector = (newest + i) % sectors;
+        uint32_t first = sector * SLOTS_PER_SECTOR;
+        uint32_t last = first + SLOTS_PER_SECTOR - 1;
+
+        if (sector == (uint32_t)newest)
+            last = (head == 0 ? slots : head) - 1;
+        else if (!readSlot(first, record) || record.sequence == ERASED)
+            continue;
+
+        if (last < first || (readSlot(last, record) && record.sent != ERASED))
+            continue;
+
+        for (uint32_t slot = first; slot <= last; slot++)
+        {
+            if (readSlot(slot, record) && record.sequence != ERASED && record.sent == ERASED)
+            {
+                tail = slot;
+                break;
+            }
+        }
+        break;
+    }
+
+    count = (head + slots - tail) % slots;
+    if (count == 0 && readSlot(tail, record) && record.sequence != ERASED && record.sent == ERASED)
+        count = slots;
+
+    return true;
+}
+
+/**
+ * @brief Converts a fix to a record. The sequence number is set by append().
+ * 
+ * @param data      Fix from the GPS Modem.
+ * @param battery   Battery voltage.
+ * @return record_t 
+ */
+TrackBuffer::record_t TrackBuffer::makeRecord(const GPS::data_t &data, double battery)
+{
+    record_t record;
+    uint32_t speed = ((uint32_t)data.speedCms * 36 + 5) / 10;      // cm/s to km/h x 100.
+
+    memset(&record, 0xFF, sizeof(record));
+    record.timestamp = data.timestamp;
+    record.latitude = data.latitudeE7;
+    record.longitude = data.longitudeE7;
+    record.speed = (speed < UINT16_MAX) ? speed : UINT16_MAX;
+    record.course = data.courseCd;
+    record.battery = lround(battery * 1000);
+    return record;
+}
+
+/**
+ * @brief Sets the sequence number of the record and appends it to the buffer.
+ * 
+ * @param record    Record from makeRecord().
+ * @return true     If the record was written.
+ * @return false    If there is no partition or the flash write failed. The sequence number is still set.
+ */
+bool TrackBuffer::append(record_t &record)
+{
+    record.sequence = nextSequence++;
+    record.crc = crc16((const uint8_t *)&record, offsetof(record_t, crc));
+
+    if (partition == NULL || !prepareSector(head))
+        return false;
+
+    if (esp_partition_write(partition, head * sizeof(record_t), &record, sizeof(record)) != ESP_OK)
+        return false;
+
+    head = (head + 1) % slots;
+    count++;
+    counters.appended++;
+    return true;
+}
+
+/**
+ * @brief Reads a record not drained. Corrupted records (e.g. power loss while writing) at the
+ * tail are skipped.
+ * 
+ * @param record    Record read.
+ * @param offset    Position from the oldest record (0 for the oldest record).
+ * @return true     If the record is available.
+ * @return false    If there are not enough records, or the record is corrupted.
+ */
+bool TrackBuffer::peek(record_t &record, uint32_t offset)
+{
+    if (offset > 0)
+        return offset < count && readSlot((tail + offset) % slots, record) && isValid(record);
+
+    while (count > 0)
+    {
+        if (readSlot(tail, record) && isValid(record))
+            return true;
+
+        tail = (tail + 1) % slots;
+        count--;
+        counters.dropped++;
+    }
+    return false;
+}
+
+/**
+ * @brief Marks the oldest records as drained.
+ * 
+ * @param records   Number of records.
+ * @return true     If the records were drained.
+ * @return false    If there are not enough records.
+ */
+bool TrackBuffer::pop(uint32_t records)
+{
+    if (records > count)
+        return false;
+
+    uint32_t sent = 0;
+    for (uint32_t i = 0; i < records; i++)
+    {
+        esp_partition_write(partition, tail * sizeof(record_t) + offsetof(record_t, sent), &sent, sizeof(sent));
+        tail = (tail + 1) % slots;
+    }
+
+    count -= records;
+    counters.drained += records;
+    return true;
+}
+
+/**
+ * @brief Reads the newest record, drained or not. Kept across reboots, it is the last reported fix.
+ * 
+ * @return true     If the record is available.
+ * @return false    If the buffer was never written, or the record is corrupted.
+ */
+bool TrackBuffer::latest(record_t &record)
+{
+    return partition != NULL && readSlot((head + slots - 1) % slots, record) && isValid(record);
+}
+
+bool TrackBuffer::readSlot(uint32_t slot, record_t &record)
+{
+    return esp_partition_read(partition, slot * sizeof(record_t), &record, sizeof(record)) == ESP_OK;
+}
+
+bool TrackBuffer::isValid(const record_t &record)
+{
+    return record.sequence != ERASED && record.crc == crc16((const uint8_t *)&record, offsetof(record_t, crc));
+}
+
+/**
+ * @brief Erases the sector before its first slot is written. If the ring is full, the
+ * records not drained in that sector are dropped.
+ * 
+ */
+bool TrackBuffer::prepareSector(uint32_t slot)
+{
+    if (slot % SLOTS_PER_SECTOR != 0)
+        return true;
+
+    uint32_t sector = slot / SLOTS_PER_SECTOR;
+
+    if (count > 0 && tail / SLOTS_PER_SECTOR == sector && tail >= slot)
+    {
+        uint32_t next = (slot + SLOTS_PER_SECTOR) % slots;
+        uint32_t lost = (next + slots - tail) % slots;
+        counters.dropped += lost;
+        count -= lost;
+        tail = next;
+    }
+
+    record_t record;
+    if (readSlot(slot, record) && record.sequence == ERASED)
+        return true;
+
+    counters.erases++;
+    return esp_partition_erase_range(partition, sector * TRACK_SECTOR_SIZE, TRACK_SECTOR_SIZE) == ESP_OK;
+}
+
+/**
+ * @brief CRC-16/CCITT-FALSE.
+ * 
+ */
+uint16_t TrackBuffer::crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
@@ -0,0 +1,69 @@
+#ifndef TRACKBUFFER_H
+#define TRACKBUFFER_H
+
+#include "Arduino.h"
+#include "esp_partition.h"
+#include "SIM7600.h"
+
+#define TRACK_PARTITION_SUBTYPE 0x40
+#define TRACK_SECTOR_SIZE 4096
+
+/**
+ * Store-and-forward buffer of fixes in a raw flash partition.
+ * 
+ * Records are appended one after the other and the partition is used as a ring, so every sector
+ * is erased once per wrap (wear is spread evenly). Records are drained oldest-first; a drained
+ * record is only marked by clearing bits, which needs no erase. When the ring is full, the oldest
+ * sector is erased and its records are lost. Only the ring pointers are kept in RAM.
+ */
+class TrackBuffer
+{
+    public:
+        typedef struct
+        {
+            uint32_t sequence;      // Increases by one for every record, across reboots. 0xFFFFFFFF when erased.
+            int32_t timestamp;
+            int32_t latitude;       // Degrees x 1e7.
+            int32_t longitude;      // Degrees x 1e7.
+            uint16_t speed;         // km/h x 100.
+            uint16_t course;        // Degrees x 100.
+            uint16_t battery;       // mV.
+            uint16_t crc;           // CRC-16 of the fields above.
+            uint32_t sent;          // 0xFFFFFFFF until the record is drained, then 0.
+            uint32_t reserved;
+        }record_t;
+
+        typedef struct
+        {
+            uint32_t appended;
+            uint32_t drained;
+            uint32_t dropped;       // Records lost because the ring was full, or corrupted.
+            uint32_t erases;
+        }stats_t;
+
+        bool begin(const char *label = "track");
+        static record_t makeRecord(const GPS::data_t &data, double battery);
+        bool append(record_t &record);
+        bool peek(record_t &record, uint32_t offset = 0);
+        bool pop(uint32_t records = 1);
+        bool latest(record_t &record);
+        uint32_t pending() const { return count; }
+        uint32_t capacity() const { return slots; }
+        const stats_t &stats() const { return counters; }
+
+    private:
+        bool readSlot(uint32_t slot, record_t &record);
+        bool isValid(const record_t &record);
+        uint16_t crc16(const uint8_t *data, size_t length);
+        bool prepareSector(uint32_t slot);
+
+        const esp_partition_t *partition = NULL;
+        uint32_t slots = 0;         // Number of records in the partition.
+        uint32_t head = 0;          // Next slot to be written.
+        uint32_t tail = 0;          // Oldest record not drained.
+        uint32_t count = 0;         // Records not drained.
+        uint32_t nextSequence = 0;
+        stats_t counters = {};
+};
+
+#endif
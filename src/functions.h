@@ -3,66 +3,289 @@
 
 #include "Arduino.h"
 #include "SIM7600.h"
+#include "ModemUART.h"
+#include "TrackBuffer.h"
+#include "Payload.h"
+#include "ReportScheduler.h"
+#include "DeadBandFilter.h"
+#include "SPSCQueue.h"
+#include "MQTTConnection.h"
+#include "PublishWindow.h"
+#include "EnergyModel.h"
+#include "Battery.h"
+#include "CertStore.h"
+#include "BootProfile.h"
+#include "GNSSPolicy.h"
+#include "Geofence.h"
+#include "MemoryMonitor.h"
 #include "driver/adc.h"
 #include "esp_adc_cal.h"
 #include "secrets.h"
 
 #define MQTT_CONNECT
+#define LOW_POWER
+#define GNSS_DUTY_CYCLE
+// #define GEOFENCE_EVENTS_ONLY
+// #define TELEMETRY_PUBLISH
 #define DEVICE_TAG "GPS Tracker Prototype"
 #define SIM7600_TAG "SIM7600"
 #define SSL_TAG "SSL"
 #define MQTT_TAG "MQTT"
 
-SIM7600 sim7600(Serial2);
-GPS gps(Serial2);
-MQTT mqtt(Serial2);
-SSL ssl(Serial2);
+// Link to the modem on the ESP-IDF UART driver (see ModemUART). The modem starts at
+// MODEM_DEFAULT_BAUD and is switched to modem_baud with AT+IPR once it answers.
+const ModemUART::config_t modem_uart_config =
+{
+	UART_NUM_2,
+	GPIO_NUM_17,			// TX
+	GPIO_NUM_16,			// RX
+	UART_PIN_NO_CHANGE,		// RTS, to the CTS input of the modem.
+	UART_PIN_NO_CHANGE,		// CTS, from the RTS output of the modem.
+	false					// flowControl: set it with RTS and CTS wired.
+};
+ModemUART modem_uart(modem_uart_config);
+const uint32_t modem_baud = 921600;
+
+SIM7600 sim7600(modem_uart);
+GPS gps(modem_uart);
+MQTT mqtt(modem_uart);
+SSL ssl(modem_uart);
+
+TrackBuffer track;
+CertStore certstore;
+
+// Stack sizes (bytes) of the tasks. The stacks and task control blocks are statically allocated,
+// see the memory budget below; the free bytes of every stack are in the telemetry snapshot.
+#define STACK_FETCH_GPS 4096
+#define STACK_PUB_MQTT 4096
+#define STACK_LED_CONTROL 2048
+#define STACK_BATTERY_MONITOR 2048
+#define STACK_RECONNECT 4096
+#define STACK_CLOCK 2048
+
+TaskHandle_t Task_fetchGPS;
+StackType_t Stack_fetchGPS[STACK_FETCH_GPS];
+StaticTask_t TCB_fetchGPS;
 
-TaskHandle_t Task_fetchGPS_pubMQTT;
+TaskHandle_t Task_pubMQTT;
+StackType_t Stack_pubMQTT[STACK_PUB_MQTT];
+StaticTask_t TCB_pubMQTT;
 
 TaskHandle_t Task_LED_Control;
+StackType_t Stack_LED_Control[STACK_LED_CONTROL];
+StaticTask_t TCB_LED_Control;
 
 TaskHandle_t Task_Battery_Monitor;
+StackType_t Stack_Battery_Monitor[STACK_BATTERY_MONITOR];
+StaticTask_t TCB_Battery_Monitor;
 
 TaskHandle_t Task_Serial;
+StackType_t Stack_Serial[STACK_RECONNECT];
+StaticTask_t TCB_Serial;
 
 TaskHandle_t Task_Clock;
+StackType_t Stack_Clock[STACK_CLOCK];
+StaticTask_t TCB_Clock;
+
+TaskHandle_t Task_Loop;		// Arduino loop task, which runs setup().
+
+StaticSemaphore_t Semaphore_LED_blink_count_buffer;
+SemaphoreHandle_t Semaphore_LED_blink_count = xSemaphoreCreateBinaryStatic(&Semaphore_LED_blink_count_buffer);
+
+StaticSemaphore_t Semaphore_MQTT_lost_buffer;
+SemaphoreHandle_t Semaphore_MQTT_lost = xSemaphoreCreateBinaryStatic(&Semaphore_MQTT_lost_buffer);
+
+StaticSemaphore_t Semaphore_energy_buffer;
+SemaphoreHandle_t Semaphore_energy = xSemaphoreCreateMutexStatic(&Semaphore_energy_buffer);
+
+// Wakes the publish task when there is something to publish. Not its task notification, which
+// would also end the wait for a modem response in the middle of a publish.
+StaticSemaphore_t Semaphore_publish_buffer;
+SemaphoreHandle_t Semaphore_publish = xSemaphoreCreateBinaryStatic(&Semaphore_publish_buffer);
 
-SemaphoreHandle_t Semaphore_LED_blink_count = xSemaphoreCreateBinary();
+StaticSemaphore_t Semaphore_memory_buffer;
+SemaphoreHandle_t Semaphore_memory = xSemaphoreCreateMutexStatic(&Semaphore_memory_buffer);
 
 gpio_num_t LED = GPIO_NUM_27;
 gpio_num_t BATTERY_MONITOR_EN = GPIO_NUM_13;
+gpio_num_t SIM_DTR = GPIO_NUM_25;
+gpio_num_t SIM_RI = GPIO_NUM_26;
 
-const double slope = 5.70;
 const double BATT_min = 6.00;
 
-const unsigned int AWS_update_interval_ms = 5000;
+// Battery voltage through the divider, sampled by the battery monitor task (see Battery).
+const Battery::config_t battery_config =
+{
+	ADC1_CHANNEL_6,
+	BATTERY_MONITOR_EN,
+	5.70,			// slope
+	0.075,			// offset (V)
+	50,				// settle (ms)
+	15,				// oversampling: ADC readings per sample.
+	0.3,			// alpha of the moving average.
+	BATT_min + 0.3,	// cutoff (V): the modem is switched OFF below it.
+	0.1				// hysteresis (V)
+};
+Battery battery(battery_config);
+
+const unsigned int AWS_update_interval_ms = 5000;	// Retry interval when there is no fix.
+
+// Motion-adaptive reporting (see ReportScheduler).
+const ReportScheduler::config_t report_config =
+{
+	2000,		// minInterval (ms): poll interval while moving.
+	300000,		// maxInterval (ms): report interval while parked.
+	30000,		// parkedPoll (ms): poll interval while parked.
+	100.0,		// reportDistance (m) between reports at constant speed and course.
+	20.0,		// headingThreshold (degrees) for a report on a turn.
+	3.0			// stationarySpeed (km/h).
+};
+ReportScheduler scheduler(report_config);
+
+// Suppression of fixes which the backend can rebuild within tolerance (see DeadBandFilter).
+const DeadBandFilter::config_t deadband_config =
+{
+	25.0,		// tolerance (m) of the rebuilt track.
+	300000		// maxSilence (ms) between two published fixes.
+};
+DeadBandFilter deadband(deadband_config);
+// Reported fixes waiting for the publish task. When it is full the newest fix is dropped.
+#define FIX_QUEUE_LENGTH 16
+SPSCQueue<TrackBuffer::record_t, FIX_QUEUE_LENGTH> fix_queue;
+
+const uint8_t track_drain_max = 10;	// Publishes per update when recovering from an outage.
+
+// Batching of fixes in one publish. batch_size = 1 publishes every fix on its own.
+const uint8_t batch_size = 1;
+const unsigned int batch_max_latency_ms = 30000;	// Maximum age of the oldest fix of a batch.
+
+// Payload::JSON or Payload::BINARY (TrackCodec, published to sim7600/bin).
+const Payload::format_t payload_format = Payload::JSON;
+
+#define BATCH_PAYLOAD_MAX 2048
+static_assert(BATCH_PAYLOAD_MAX <= MQTT_PAYLOAD_MAX, "Batch payload larger than the SIM7600 limit");
+char payload_buffer[BATCH_PAYLOAD_MAX];
+
+struct
+{
+	uint32_t fixes;
+	uint32_t publishes;
+	uint32_t exchanges;		// AT commands and data bodies sent for the publishes.
+	uint32_t airtime;		// Estimated bytes sent over the cellular link.
+}publish_stats;
+
+// GNSS duty cycling (GNSS_DUTY_CYCLE, see GNSSPolicy): the GNSS engine is switched off when the
+// next poll is at least offGap away and restarted hot, warm or cold from the age of the last fix.
+// A larger offGap keeps the fix latency low, a smaller one saves the GNSS current.
+const GNSSPolicy::config_t gnss_policy_config =
+{
+	30000,		// offGap (ms): the parked polls switch the engine off.
+	7200,		// hotMaxAge (s): ephemeris valid for about 2 h.
+	604800,		// warmMaxAge (s): almanac and last position used for a week.
+	1000		// acquirePoll (ms): TTFF resolution.
+};
+GNSSPolicy gnss_policy(gnss_policy_config);
+
+// Geofences of the fences partition (see Geofence), tested on every fix. Only the enter and exit
+// events are published, to geofence_topic. With GEOFENCE_EVENTS_ONLY the fixes are not published.
+const Geofence::config_t geofence_config =
+{
+	20.0,		// margin (m) outside a fence for an exit, larger than the jitter of the fixes.
+	2			// confirm: consecutive fixes for an enter or an exit.
+};
+Geofence geofence(geofence_config);
+const char *geofence_topic = "sim7600/geofence";
+#define GEOFENCE_EVENTS_PER_FIX 4
+#define GEOFENCE_QUEUE_LENGTH 8
+#define GEOFENCE_PAYLOAD_MAX 192
+SPSCQueue<Geofence::event_t, GEOFENCE_QUEUE_LENGTH> geofence_queue;
+
+// Low-power mode: the modem sleeps (AT+CSCLK, DTR) and the ESP32 enters automatic light sleep
+// when the next poll of the GPS Modem is at least sleep_min_interval_ms away.
+const unsigned int sleep_min_interval_ms = 10000;
+
+// Currents (mA) of the board for the runtime estimate (see EnergyModel). Measured values should be used.
+const EnergyModel::config_t energy_config =
+{
+	{
+		75.0,	// ESP32 running, modem awake.
+		4.0,	// ESP32 light sleep, modem sleep.
+		20.0	// Modem switched off.
+	},
+	35.0,		// GNSS engine on.
+	2600.0		// Battery capacity (mAh).
+};
+EnergyModel energy(energy_config);
+const unsigned int energy_report_interval_ms = 300000;
+
+// Telemetry snapshot: printed on the serial console with the "telemetry" command and, with
+// TELEMETRY_PUBLISH, published to telemetry_topic every telemetry_interval_ms.
+#define TELEMETRY_PAYLOAD_MAX 4096
+static_assert(TELEMETRY_PAYLOAD_MAX <= MQTT_PAYLOAD_MAX, "Telemetry payload larger than the SIM7600 limit");
+char telemetry_buffer[TELEMETRY_PAYLOAD_MAX];
+const char *telemetry_topic = "sim7600/telemetry";
+const unsigned int telemetry_interval_ms = 900000;
+
+// Boot sequence: the modem is awaited through its URCs, GNSS starts before the network is up.
+const unsigned int boot_ready_timeout_ms = 30000;		// From power on to "+CPIN: READY".
+const unsigned int boot_register_timeout_ms = 60000;	// Then the reconnect task keeps trying.
+BootProfile boot_profile;
 
 bool active_hours = true;
 const unsigned int aws_port = 8883;
-uint8_t LED_blink_count = 1;
 
-/**
- * @brief Function to calculate the battery voltage using the voltage divider with MOSFET. 12-bit resolution.
- * 
- * 
- * @return double - Voltage of battery.
- */
-double battery_voltage()
+// Connection to the AWS MQTT broker (see MQTTConnection).
+const MQTTConnection::config_t mqtt_link_config =
 {
-	gpio_set_level(BATTERY_MONITOR_EN, 1);
-	vTaskDelay(50 / portTICK_PERIOD_MS);
+	aws_server, aws_port, cacert, clientcert, clientkey,
+	1000,		// backoffMin (ms)
+	60000,		// backoffMax (ms)
+	2			// layerRetries
+};
+MQTTConnection mqtt_link(ssl, mqtt, mqtt_link_config);
 
-	esp_adc_cal_characteristics_t adc_chars;
+// Publishes with QoS 1 through a window of messages in flight (see PublishWindow): the next
+// message is sent to the modem while the previous ones wait for the PUBACK of the broker.
+const PublishWindow::config_t publish_window_config =
+{
+	4,			// window: messages in flight, 1 for a publish at a time.
+	1,			// qos
+	60			// ackTimeout (s)
+};
+PublishWindow publish_window(mqtt, publish_window_config);
 
-	esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_6, ADC_WIDTH_BIT_12, 1100, &adc_chars);
+// Stack high-water marks and heap headroom (see MemoryMonitor), sampled by the loop task every
+// memory_sample_interval_ms and logged when below the thresholds. The telemetry snapshot reads it
+// from the publish task too, so it is used with Semaphore_memory held.
+const MemoryMonitor::config_t memory_config =
+{
+	512,		// minFreeStack (bytes) of every task.
+	16384		// minFreeHeap (bytes): free heap and largest free block.
+};
+MemoryMonitor memory_monitor(memory_config);
+const unsigned int memory_sample_interval_ms = 60000;
 
-	uint32_t voltage;
-	esp_adc_cal_get_voltage(ADC_CHANNEL_6, &adc_chars, &voltage);
+// Memory budget. Everything the tracker needs after the boot is allocated statically and checked
+// here at compile time: the stacks and control blocks of the tasks, the fix and geofence queues,
+// the payload buffers, the geofence grid and the AT command statistics. The request queue of the
+// modem I/O task (REQUEST_QUEUE_LENGTH requests) and the semaphores add a few hundred bytes. The
+// heap is only used during the boot, by the UART driver (its RX and TX ring buffers and event
+// queue), the Arduino loop task (CONFIG_ARDUINO_LOOP_STACK_SIZE), the light sleep lock and the
+// GPIO ISR service; from then on the free heap should stay flat.
+// The Arduino log and printf functions format the lines of 64 bytes or more in a temporary heap
+// buffer, so the hot paths write the payloads directly; with CORE_DEBUG_LEVEL=3 the longer info
+// logs (e.g. of each publish) still allocate, CORE_DEBUG_LEVEL=2 removes them.
+#define TASK_STACK_BUDGET 24576
+#define STATIC_RAM_BUDGET 65536
+#define TASK_STACK_TOTAL (MODEM_IO_STACK_SIZE + STACK_FETCH_GPS + STACK_PUB_MQTT + STACK_LED_CONTROL + \
+						  STACK_BATTERY_MONITOR + STACK_RECONNECT + STACK_CLOCK)
+static_assert(TASK_STACK_TOTAL <= TASK_STACK_BUDGET, "Task stacks over the memory budget");
+static_assert(TASK_STACK_TOTAL + 7 * sizeof(StaticTask_t) + sizeof(CommandStats) + sizeof(fix_queue) + sizeof(geofence_queue) +
+			  sizeof(payload_buffer) + sizeof(telemetry_buffer) + sizeof(Geofence) + sizeof(TrackBuffer) + sizeof(CertStore) +
+			  sizeof(ModemUART) + sizeof(PublishWindow) + sizeof(GNSSPolicy) + sizeof(MemoryMonitor) <= STATIC_RAM_BUDGET,
+			  "Static RAM over the memory budget");
 
-	gpio_set_level(BATTERY_MONITOR_EN, 0);
-	return (slope * (voltage / 1000.0) ) + 0.075;
-}
+uint8_t LED_blink_count = 1;
 
 /**
  * @brief Function to end the MQTT session.
@@ -77,6 +300,166 @@ void endMQTT()
 	#endif
 }
 
+/**
+ * @brief Counts the time in the previous power state and sets the new one.
+ * 
+ * @param state 	Power state from now on.
+ */
+void energy_update(EnergyModel::state_t state)
+{
+	xSemaphoreTake(Semaphore_energy, portMAX_DELAY);
+	energy.update(state, SIM7600::modemState().gnss == SIM7600::STATE_ON, millis());
+	xSemaphoreGive(Semaphore_energy);
+}
+
+/**
+ * @brief Handler for the changes of the modem sleep mode. Runs in the modem I/O task.
+ * 
+ * @param asleep 	Set to 'true' when the modem enters the sleep mode.
+ * @param context 
+ */
+void modem_sleep_changed(bool asleep, void *context)
+{
+	energy_update(asleep ? EnergyModel::STATE_SLEEP : EnergyModel::STATE_ACTIVE);
+}
+
+/**
+ * @brief Log the time in each power state, the charge drawn and the predicted runtime per charge.
+ * 
+ */
+void report_energy()
+{
+	energy_update(SIM7600::isAsleep() ? EnergyModel::STATE_SLEEP : EnergyModel::STATE_ACTIVE);
+
+	xSemaphoreTake(Semaphore_energy, portMAX_DELAY);
+	ESP_LOGI(DEVICE_TAG, "Energy: %.1f mAh, %.1f mA average, %.0f h per charge (active %lu s, sleep %lu s, GNSS %lu s)",
+			 energy.charge(), energy.averageCurrent(), energy.runtime(),
+			 (unsigned long)(energy.timeIn(EnergyModel::STATE_ACTIVE) / 1000), (unsigned long)(energy.timeIn(EnergyModel::STATE_SLEEP) / 1000),
+			 (unsigned long)(energy.gnssTime() / 1000));
+	xSemaphoreGive(Semaphore_energy);
+}
+
+/**
+ * @brief Log the time of each boot phase (see BootProfile).
+ * 
+ */
+void report_boot()
+{
+	for (uint8_t i = 0; i < BootProfile::PHASE_COUNT; i++)
+	{
+		BootProfile::phase_t phase = (BootProfile::phase_t)i;
+		if (boot_profile.done(phase))
+			ESP_LOGI(DEVICE_TAG, "Boot %s at %lu ms", BootProfile::name(phase), (unsigned long)boot_profile.at(phase));
+		else
+			ESP_LOGI(DEVICE_TAG, "Boot %s not reached", BootProfile::name(phase));
+	}
+}
+
+/**
+ * @brief Sample the stack high-water marks and the heap (see MemoryMonitor) and log the values
+ * below the thresholds.
+ * 
+ */
+void report_memory()
+{
+	xSemaphoreTake(Semaphore_memory, portMAX_DELAY);
+	if (memory_monitor.sample() == 0)
+	{
+		xSemaphoreGive(Semaphore_memory);
+		return;
+	}
+
+	for (uint8_t i = 0; i < memory_monitor.taskCount(); i++)
+	{
+		const MemoryMonitor::task_t &task = memory_monitor.task(i);
+		if (task.minFree < memory_config.minFreeStack)
+			ESP_LOGW(DEVICE_TAG, "Stack %s: %lu of %lu bytes free", task.name, (unsigned long)task.minFree, (unsigned long)task.stackSize);
+	}
+	ESP_LOGW(DEVICE_TAG, "Heap: %lu bytes free (min %lu), largest block %lu", (unsigned long)memory_monitor.freeHeap(),
+			 (unsigned long)memory_monitor.minFreeHeap(), (unsigned long)memory_monitor.largestBlock());
+	xSemaphoreGive(Semaphore_memory);
+}
+
+/**
+ * @brief Write the telemetry snapshot as JSON: publish, energy, dead-band and reconnect statistics,
+ * the GNSS duty cycle and TTFF, the boot profile, the geofence and publish window statistics, the
+ * stack and heap headroom and the latency histogram of every AT command (see CommandStats).
+ * 
+ * @param buffer 	Output buffer.
+ * @param size 		Size of the buffer.
+ * @return size_t 	Length of the snapshot. 0 if it does not fit.
+ */
+size_t telemetry_snapshot(char *buffer, size_t size)
+{
+	xSemaphoreTake(Semaphore_energy, portMAX_DELAY);
+	double charge = energy.charge(), average = energy.averageCurrent(), runtime = energy.runtime();
+	xSemaphoreGive(Semaphore_energy);
+
+	const MQTTConnection::stats_t &link = mqtt_link.stats();
+	int length = snprintf(buffer, size,
+						  "{\"uptime\":%lu,\"battery\":%.2f,\"fixes\":%lu,\"publishes\":%lu,\"exchanges\":%lu,\"airtime\":%lu,"
+						  "\"saved\":%lu,\"charge\":%.1f,\"current\":%.1f,\"runtime\":%.0f,\"suppressed\":%.3f,"
+						  "\"connects\":%lu,\"reconnect_max\":%lu,\"uart\":{\"baud\":%lu,\"overflows\":%lu,\"errors\":%lu},\"gnss\":",
+						  (unsigned long)(millis() / 1000), battery.voltage(), (unsigned long)publish_stats.fixes,
+						  (unsigned long)publish_stats.publishes, (unsigned long)publish_stats.exchanges, (unsigned long)publish_stats.airtime,
+						  (unsigned long)SIM7600::commandsSaved(), charge, average, runtime, deadband.suppressionRatio(),
+						  (unsigned long)link.connects, (unsigned long)link.maxDuration, (unsigned long)modem_uart.baudRate(),
+						  (unsigned long)modem_uart.stats().overflows, (unsigned long)modem_uart.stats().errors);
+	if (length < 0 || (size_t)length >= size)
+		return 0;
+
+	size_t gnss = gnss_policy.toJSON(buffer + length, size - length, millis());
+	if (gnss == 0 || length + gnss + 8 >= size)
+		return 0;
+	length += gnss;
+	length += snprintf(buffer + length, size - length, ",\"boot\":");
+
+	size_t boot = boot_profile.toJSON(buffer + length, size - length);
+	if (boot == 0)
+		return 0;
+	length += boot;
+	length += snprintf(buffer + length, size - length, ",\"geofence\":");
+	if ((size_t)length >= size)
+		return 0;
+
+	size_t fences = geofence.toJSON(buffer + length, size - length);
+	if (fences == 0)
+		return 0;
+	length += fences;
+	length += snprintf(buffer + length, size - length, ",\"publish_window\":");
+	if ((size_t)length >= size)
+		return 0;
+
+	size_t window = publish_window.toJSON(buffer + length, size - length);
+	if (window == 0)
+		return 0;
+	length += window;
+	length += snprintf(buffer + length, size - length, ",\"memory\":");
+	if ((size_t)length >= size)
+		return 0;
+
+	xSemaphoreTake(Semaphore_memory, portMAX_DELAY);
+	size_t memory = memory_monitor.toJSON(buffer + length, size - length);
+	xSemaphoreGive(Semaphore_memory);
+	if (memory == 0)
+		return 0;
+	length += memory;
+
+	int written = snprintf(buffer + length, size - length, ",\"commands\":");
+	if (written < 0 || length + written >= size)
+		return 0;
+	length += written;
+
+	size_t commands = SIM7600::commandStats().toJSON(buffer + length, size - length);
+	if (commands == 0 || length + commands + 1 >= size)
+		return 0;
+
+	length += commands;
+	buffer[length++] = '}';
+	buffer[length] = '\0';
+	return length;
+}
+
 /**
  * @brief Update the active_hours boolean based on the current time and active time.
  * 
@@ -92,6 +475,28 @@ void update_active_hours(void * parameter)
 	}
 }
 
+/**
+ * @brief Suspend the tasks which use the modem (setup() and loop() included), except the modem I/O
+ * task, which has to send the shutdown commands. The semaphores are taken first, so no suspended
+ * task holds one of them.
+ * 
+ */
+void stop_tasks()
+{
+	xSemaphoreTake(Semaphore_energy, portMAX_DELAY);
+	xSemaphoreTake(Semaphore_LED_blink_count, portMAX_DELAY);
+
+	// A task which is not created yet is NULL, and vTaskSuspend(NULL) would suspend this task.
+	TaskHandle_t tasks[] = { Task_Loop, Task_fetchGPS, Task_pubMQTT, Task_Serial, Task_Clock };
+	for (TaskHandle_t task : tasks)
+		if (task != NULL)
+			vTaskSuspend(task);
+
+	LED_blink_count = 3;
+	xSemaphoreGive(Semaphore_LED_blink_count);
+	xSemaphoreGive(Semaphore_energy);
+}
+
 /**
  * @brief Task to monitor the battery voltage and switch ON/OFF the SIM module.
  * 
@@ -99,25 +504,23 @@ void update_active_hours(void * parameter)
  */
 void battery_monitor(void * parameter)
 {
-	gpio_reset_pin(BATTERY_MONITOR_EN);
-	gpio_set_direction(BATTERY_MONITOR_EN, GPIO_MODE_OUTPUT);
+	battery.begin();
 
-	adc_set_clk_div(1);
-	adc1_config_width(ADC_WIDTH_BIT_12);
-	adc1_config_channel_atten(ADC1_CHANNEL_6, ADC_ATTEN_DB_6);
+	uint32_t last_energy_report = millis();
 
 	while(true)
 	{
-		if ( battery_voltage() < BATT_min + 0.3 || !active_hours)
+		battery.sample();
+
+		if ( battery.isLow() || !active_hours)
 		{
-			vTaskSuspendAll();
+			energy_update(EnergyModel::STATE_OFF);
+			// The commands go through the modem I/O task, so the scheduler keeps running.
+			stop_tasks();
 			endMQTT();
 			sim7600.shutdown();
 			vTaskDelay(200 / portTICK_PERIOD_MS);
 			sim7600.powerOFF();
-			xSemaphoreTake(Semaphore_LED_blink_count, portMAX_DELAY);
-			LED_blink_count = 3;
-			xSemaphoreGive(Semaphore_LED_blink_count);
 
 			while(true)
 			{
@@ -130,6 +533,12 @@ void battery_monitor(void * parameter)
 		{
 			sim7600.powerON();
 		}
+
+		if (millis() - last_energy_report >= energy_report_interval_ms)
+		{
+			report_energy();
+			last_energy_report = millis();
+		}
 		vTaskDelay(5000 / portTICK_PERIOD_MS);
 	}
 }
@@ -166,20 +575,41 @@ void blink_LED(void *parameter)
 }
 
 /**
- * @brief Function to configure the SSL context and connect to the AWS MQTT broker.
+ * @brief Download the certificates of the certs partition into the SIM7600 modem. The ones which
+ * did not change since the last download are skipped. Without the partition, the certificates
+ * have to be loaded into the modem by hand.
+ * 
+ */
+void provisionCertificates()
+{
+	if (!certstore.begin())
+	{
+		ESP_LOGW(SSL_TAG, "Certificate partition not found");
+		return;
+	}
+
+	ssl.downloadCertificates(certstore) ? ESP_LOGI(SSL_TAG, "%u certificates in the modem", certstore.count()) : ESP_LOGE(SSL_TAG, "Certificate download failed");
+}
+
+/**
+ * @brief Function to configure the SSL context and connect to the AWS MQTT broker. If it fails,
+ * the reconnect task retries with backoff.
  * 
  */
 void configureSSL_MQTT()
 {
 	#ifdef MQTT_CONNECT
-	ssl.checkCertificates(cacert, clientcert, clientkey) ? ESP_LOGI(SSL_TAG, "Certificates present") : ESP_LOGE(SSL_TAG, "Certificates not found");
-	ssl.configureSSL(cacert, clientcert, clientkey) ? ESP_LOGI(SSL_TAG, "SSL configured successfully") : ESP_LOGE(SSL_TAG, "SSL configuration failed");
-
-	mqtt.begin() ? ESP_LOGI(MQTT_TAG, "MQTT session started successfully") : ESP_LOGE(MQTT_TAG, "MQTT session did not start");
-	mqtt.acquireClient() ? ESP_LOGI(MQTT_TAG, "MQTT client acquired successfully") : ESP_LOGE(MQTT_TAG, "MQTT client was not acquired");
-	mqtt.setSSLContext() ? ESP_LOGI(MQTT_TAG, "MQTT SSL context set successfully") : ESP_LOGE(MQTT_TAG, "MQTT SSL context was not set");
-	mqtt.disconnect();
-	bool success = mqtt.connect(aws_server, aws_port) ? ESP_LOGI(MQTT_TAG, "MQTT broker connected successfully") : ESP_LOGE(MQTT_TAG, "Could not connect to MQTT broker");
+	bool success = mqtt_link.attempt();
+	if (success)
+	{
+		boot_profile.mark(BootProfile::PHASE_CONNECTED, millis());
+		ESP_LOGI(MQTT_TAG, "MQTT broker connected successfully");
+	}
+	else
+	{
+		ESP_LOGE(MQTT_TAG, "Could not connect to MQTT broker");
+		xSemaphoreGive(Semaphore_MQTT_lost);
+	}
 
 	xSemaphoreTake(Semaphore_LED_blink_count, portMAX_DELAY);
 	LED_blink_count = success ? 1 : 3;
@@ -192,100 +622,495 @@ void configureSSL_MQTT()
 }
 
 /**
- * @brief Task to Fetch GPS data and Publish MQTT message
+ * @brief Start the GNSS engine with the start chosen by the GNSS policy. Without a fix in this run,
+ * the age of the persisted fix is taken from the modem clock.
  * 
- * @param parameter 
+ * @return true 	If the engine started.
  */
-void fetchGPS_pubMQTT(void *parameter)
+bool startGNSS()
 {
-	Serial.println("Latitude\tLongitude\tAltitude\tSpeed\t\tCourse\t\tEpoch Time");
+	time_t clock = 0;
+	if (gnss_policy.needsClock() && !sim7600.networkTime(clock))
+		clock = 0;
 
-	while (true)
+	GNSSPolicy::start_t start = gnss_policy.choose(millis(), clock);
+	bool success = (start == GNSSPolicy::START_HOT) ? gps.hotStart() : (start == GNSSPolicy::START_WARM) ? gps.warmStart() : gps.coldStart();
+
+	if (success)
+		gnss_policy.started(start, millis());
+	energy_update(EnergyModel::STATE_ACTIVE);
+
+	success ? ESP_LOGI(DEVICE_TAG, "GNSS %s start", GNSSPolicy::name(start)) : ESP_LOGE(DEVICE_TAG, "GNSS %s start failed", GNSSPolicy::name(start));
+	return success;
+}
+
+/**
+ * @brief Switch the GNSS engine off until the next poll. If the stop is not confirmed, the engine
+ * is still counted as off: the restart before the next poll asks the modem and stops it first.
+ * 
+ */
+void stopGNSS()
+{
+	if (!gps.stop())
+		ESP_LOGW(DEVICE_TAG, "GNSS stop not confirmed");
+	gnss_policy.stopped(millis());
+	energy_update(EnergyModel::STATE_ACTIVE);
+}
+
+/**
+ * @brief Send a message to the AWS MQTT broker through the publish window, without waiting for its
+ * completion, and update the AT exchanges and airtime of the publish statistics.
+ * 
+ * @param topic 	Topic of the message.
+ * @param data 		Payload of the message.
+ * @param length 	Length of the payload.
+ * @param fixes 	Fixes of the message, returned by the window when it is acknowledged.
+ * @return true 	If the message was sent to the modem.
+ * @return false 	If the modem refused it. The window is cleared.
+ */
+bool sendMessage(const char *topic, const char *data, size_t length, uint16_t fixes)
+{
+	uint32_t exchanges = SIM7600::exchangeCount();
+	bool success = publish_window.send(topic, data, length, fixes, millis());
+
+	publish_stats.exchanges += SIM7600::exchangeCount() - exchanges;
+	if (success)
+		publish_stats.airtime += MQTT::airtime(strlen(topic), length, publish_window_config.qos);
+	return success;
+}
+
+/**
+ * @brief Publish a message to the AWS MQTT broker and wait for its acknowledgement.
+ * 
+ * @param topic 	Topic of the message.
+ * @param data 		Payload of the message.
+ * @param length 	Length of the payload.
+ * @return true 	If the message was acknowledged.
+ * @return false 
+ */
+bool publishMessage(const char *topic, const char *data, size_t length)
+{
+	bool success = sendMessage(topic, data, length, 0);
+	if (success)
+		publish_window.flush(success);
+	return success;
+}
+
+/**
+ * @brief Send the payload to the AWS MQTT broker through the publish window.
+ * 
+ * @param payload 	One fix or a batch of fixes.
+ * @return true 	If the payload was sent to the modem.
+ * @return false 
+ */
+bool sendPayload(Payload &payload)
+{
+	const char *publishTopic = payload.topic();
+	const char *data = payload.data();
+
+	Serial.printf("%u-%s\n", strlen(publishTopic), publishTopic);
+	if (payload_format == Payload::JSON)
 	{
-		if ( gps.getData() )
+		// Not with printf(), which would allocate a buffer for the payload.
+		Serial.print(payload.length());
+		Serial.print('-');
+		Serial.write((const uint8_t *)data, payload.length());
+		Serial.println();
+	}
+	else
+		Serial.printf("%u bytes, %u fixes\n", payload.length(), payload.fixes());
+
+	return sendMessage(publishTopic, data, payload.length(), payload.fixes());
+}
+
+/**
+ * @brief Update the publish statistics with the fixes acknowledged by the broker.
+ * 
+ * @param fixes 	Fixes acknowledged.
+ * @param messages 	Messages acknowledged.
+ */
+void acknowledged(uint32_t fixes, uint32_t messages)
+{
+	if (fixes == 0)
+		return;
+
+	publish_stats.fixes += fixes;
+	publish_stats.publishes += messages;
+	if (boot_profile.mark(BootProfile::PHASE_FIRST_PUBLISH, millis()))
+		report_boot();
+
+	ESP_LOGI(MQTT_TAG, "%lu fixes published, %.1f AT exchanges and %.1f bytes airtime per fix", (unsigned long)fixes,
+			 (double)publish_stats.exchanges / publish_stats.fixes, (double)publish_stats.airtime / publish_stats.fixes);
+	ESP_LOGI(SIM7600_TAG, "%lu AT commands not sent (%.0f per hour)", (unsigned long)SIM7600::commandsSaved(),
+			 SIM7600::commandsSaved() * 3600000.0 / millis());
+}
+
+/**
+ * @brief Publish the payload to the AWS MQTT broker and wait for its acknowledgement.
+ * 
+ * @param payload 	One fix or a batch of fixes.
+ * @return true 	If the payload was acknowledged.
+ * @return false 
+ */
+bool publishPayload(Payload &payload)
+{
+	uint32_t acked = publish_window.stats().acked;
+	bool success = sendPayload(payload);
+	uint32_t fixes = success ? publish_window.flush(success) : 0;
+
+	acknowledged(fixes, publish_window.stats().acked - acked);
+	return success;
+}
+
+/**
+ * @brief Publish the queued geofence events to geofence_topic, oldest first. An event is removed
+ * from the queue only when it has been acknowledged, so the events are kept while the broker is
+ * not reachable.
+ * 
+ * @return true 	If all the events were published.
+ * @return false 	If a publish failed.
+ */
+bool publishGeofenceEvents()
+{
+	Geofence::event_t event;
+	char payload[GEOFENCE_PAYLOAD_MAX];
+
+	while (geofence_queue.peek(event))
+	{
+		size_t length = geofence.eventJSON(event, payload, sizeof(payload));
+		if (length > 0)
 		{
-			Serial.printf("Latitude:\t%lf\nLongitude:\t%lf\n", gps.data.latitude, gps.data.longitude);
-			Serial.printf("Altitude:\t%lf\nSpeed:\t\t%lf\n", gps.data.altitude, gps.data.speed);
-			Serial.printf("Course:\t\t%lf\nEpoch Time:\t%ld\n", gps.data.course, gps.data.timestamp);
+			if (!publishMessage(geofence_topic, payload, length))
+				return false;
+			Serial.print(length);
+			Serial.print('-');
+			Serial.write((const uint8_t *)payload, length);
+			Serial.println();
+		}
+		geofence_queue.pop(event);
+	}
+	return true;
+}
 
-			uint8_t mac[6];
-			esp_read_mac(mac, ESP_MAC_WIFI_STA);
+/**
+ * @brief Publish the buffered fixes, oldest first and in batches of up to batch_size fixes,
+ * until the buffer is empty or a publish fails. Up to publish_window_config.window batches are
+ * in flight: the fixes stay in the buffer until acknowledged, so the next batch starts after the
+ * fixes in flight, and after a failure the fixes not acknowledged are sent again on the next drain.
+ * 
+ * @return true 	If all the fixes were published.
+ * @return false 	If the broker is not reachable. The fixes stay in the buffer.
+ */
+bool drainTrack()
+{
+	TrackBuffer::record_t record;
+	Payload payload(payload_buffer, sizeof(payload_buffer), payload_format);
+	uint32_t acked = publish_window.stats().acked;
+	uint32_t fixes = 0;
+	bool success = true;
 
-			char publishTopic[20];
+	for (uint8_t i = 0; success; )
+	{
+		while (i < track_drain_max && publish_window.canSend())
+		{
+			payload.clear();
+			const uint32_t start = publish_window.countInFlight();
+			for (uint32_t offset = start; offset < start + batch_size && track.peek(record, offset); offset++)
+				if (!payload.add(record))
+					break;
+
+			if (payload.fixes() == 0 || !(success = sendPayload(payload)))
+				break;
+			i++;
+		}
 
-			sprintf(publishTopic, "sim7600/pub");
+		if (!success || publish_window.inFlight() == 0)
+			break;
 
-			char payload[150];
-			snprintf(payload, sizeof(payload), "{\"latitude\":%.8lf,\"longitude\":%.8lf,\"speed\":%.2lf,\"course\":%.2lf,\"timestamp\":%li,\"battery\":%.2lf}",
-					 gps.data.latitude, gps.data.longitude, gps.data.speed, gps.data.course, gps.data.timestamp, battery_voltage());
+		// Returns on the oldest completion, a failure or the acknowledgement timeout of the window.
+		uint32_t done = publish_window.wait(publish_window_config.ackTimeout * 1000UL, success);
+		track.pop(done);
+		fixes += done;
+	}
 
-			Serial.printf("%u-%s\n", strlen(publishTopic), publishTopic);
-			Serial.printf("%u-%s\n", strlen(payload), payload);
-			#ifdef MQTT_CONNECT
-			mqtt.setPublishTopicPayload(publishTopic, payload);
-			bool success = mqtt.publish();
+	acknowledged(fixes, publish_window.stats().acked - acked);
+	return success;
+}
 
-			xSemaphoreTake(Semaphore_LED_blink_count, portMAX_DELAY);
-			LED_blink_count = success ? 1 : 3;
-			const unsigned int delay_interval = success ? 300 : 1000;
-			xSemaphoreGive(Semaphore_LED_blink_count);
+/**
+ * @brief Age of the oldest buffered fix: the time between the oldest and the latest fix, plus the
+ * time since the latest fix was queued. In seconds, so a long gap between fixes does not overflow.
+ * 
+ * @param latest 	Latest fix.
+ * @param queued 	millis() when the latest fix was queued.
+ * @return uint32_t Age in s. 0 without a buffered fix.
+ */
+uint32_t batchAge(const TrackBuffer::record_t &latest, uint32_t queued)
+{
+	TrackBuffer::record_t oldest;
 
-			vTaskResume(Task_LED_Control);
-			vTaskDelay(delay_interval / portTICK_PERIOD_MS);
+	if (!track.peek(oldest))
+		return 0;
+
+	int32_t span = latest.timestamp - oldest.timestamp;
+	return ((span > 0) ? span : 0) + (millis() - queued) / 1000;
+}
+
+/**
+ * @brief Check if the buffered fixes have to be published: a full batch is ready or the oldest
+ * fix is older than batch_max_latency_ms.
+ * 
+ * @param latest 	Latest fix.
+ * @param queued 	millis() when the latest fix was queued.
+ * @return true 	If the buffered fixes have to be published.
+ */
+bool batchDue(const TrackBuffer::record_t &latest, uint32_t queued)
+{
+	if (track.pending() >= batch_size)
+		return true;
+
+	return batchAge(latest, queued) >= batch_max_latency_ms / 1000;
+}
+
+/**
+ * @brief Time until the buffered fixes are due by batch_max_latency_ms, the longest wait of the
+ * publish task for a new fix. Without buffered fixes or a broker connection there is nothing due.
+ * 
+ * @param latest 	Latest fix.
+ * @param queued 	millis() when the latest fix was queued.
+ * @return TickType_t 
+ */
+TickType_t batchWait(const TrackBuffer::record_t &latest, uint32_t queued)
+{
+	if (track.pending() == 0 || !mqtt_link.connected())
+		return portMAX_DELAY;
+
+	uint32_t age = batchAge(latest, queued);
+	if (age >= batch_max_latency_ms / 1000)
+		return 0;
+	return (batch_max_latency_ms - age * 1000) / portTICK_PERIOD_MS;
+}
+
+/**
+ * @brief Producer task. Polls the GPS Modem on the cadence of the report scheduler and queues the
+ * reported fixes for the publish task, so that a slow publish does not delay the next fix.
+ * 
+ * @param parameter 
+ */
+void fetchGPS(void *parameter)
+{
+	Serial.println("Latitude\tLongitude\tAltitude\tSpeed\t\tCourse\t\tEpoch Time");
+
+	TickType_t last_wake = xTaskGetTickCount();
+
+	while (true)
+	{
+		#ifdef GNSS_DUTY_CYCLE
+		// Switched off during the last gap, the engine is restarted for this poll.
+		if (!gnss_policy.isOn())
+			startGNSS();
+		#endif
+
+		// Fixes not needed for the track (e.g. parked, or straight at constant speed) are not reported.
+		bool fix = gps.getData();
+		const uint32_t now = millis();
+		if (fix)
+			boot_profile.mark(BootProfile::PHASE_FIRST_FIX, now);
+		if (fix && gnss_policy.fix(gps.data.timestamp, now))
+			ESP_LOGI(DEVICE_TAG, "GNSS fix %lu ms after the start, %.0f%% duty cycle", (unsigned long)(now - gnss_policy.startTime()),
+					 gnss_policy.dutyCycle(now) * 100);
+		bool report = fix && scheduler.update(gps.data, now) && deadband.update(gps.data, now);
+		if (report)
+			scheduler.commit(gps.data, now);
+
+		// Every fix is tested against the geofences, also the ones which are not reported.
+		Geofence::event_t events[GEOFENCE_EVENTS_PER_FIX];
+		size_t event_count = fix ? geofence.update(gps.data, events, GEOFENCE_EVENTS_PER_FIX) : 0;
+		for (size_t i = 0; i < event_count; i++)
+		{
+			ESP_LOGI(DEVICE_TAG, "Geofence %u: %s", events[i].id, Geofence::name((Geofence::event_type_t)events[i].type));
+			if (!geofence_queue.push(events[i]))
+				ESP_LOGW(DEVICE_TAG, "Geofence queue full, %lu events dropped", (unsigned long)geofence_queue.dropped());
+		}
+		#ifdef MQTT_CONNECT
+		if (event_count > 0)
+			xSemaphoreGive(Semaphore_publish);
+		#endif
+		// While acquiring after a start, the poll interval is the TTFF resolution.
+		const unsigned int poll_interval_ms = fix ? scheduler.nextPoll() : gnss_policy.isAcquiring() ? gnss_policy.acquirePoll() : AWS_update_interval_ms;
+
+		if ( report )
+		{
+			Serial.printf("Latitude:\t%lf\nLongitude:\t%lf\n", gps.data.latitude(), gps.data.longitude());
+			Serial.printf("Altitude:\t%lf\nSpeed:\t\t%lf\n", gps.data.altitude(), gps.data.speed());
+			Serial.printf("Course:\t\t%lf\nEpoch Time:\t%ld\n", gps.data.course(), gps.data.timestamp);
+			ESP_LOGI(DEVICE_TAG, "%lu of %lu fixes suppressed (%.0f%%)", (unsigned long)deadband.stats().suppressed,
+					 (unsigned long)deadband.stats().fixes, deadband.suppressionRatio() * 100);
+
+			#if defined(MQTT_CONNECT) && !defined(GEOFENCE_EVENTS_ONLY)
+			if (fix_queue.push(TrackBuffer::makeRecord(gps.data, battery.voltage())))
+				xSemaphoreGive(Semaphore_publish);
+			else
+				ESP_LOGW(DEVICE_TAG, "Fix queue full, %lu fixes dropped", (unsigned long)fix_queue.dropped());
 			#endif
 		}
-		else
+		else if ( !fix )
 		{
 			xSemaphoreTake(Semaphore_LED_blink_count, portMAX_DELAY);
 			LED_blink_count = 2;
-			const unsigned int delay_interval = 650;
 			xSemaphoreGive(Semaphore_LED_blink_count);
 
 			vTaskResume(Task_LED_Control);
-			vTaskDelay(delay_interval / portTICK_PERIOD_MS);
 			Serial.println("Invalid Data or Module is not Switched ON or MQTT disabled\n");
 		}
 
-		vTaskDelay(AWS_update_interval_ms / portTICK_PERIOD_MS);
+		#ifdef GNSS_DUTY_CYCLE
+		if (gnss_policy.shouldStop(poll_interval_ms))
+			stopGNSS();
+		#endif
+
+		#ifdef LOW_POWER
+		// The next command (e.g. the next poll or a publish) wakes the modem up.
+		if (poll_interval_ms >= sleep_min_interval_ms)
+			sim7600.sleep();
+		#endif
+
+		// Fixed cadence: the time spent in this loop is not added to the poll interval.
+		vTaskDelayUntil(&last_wake, poll_interval_ms / portTICK_PERIOD_MS);
 	}
 }
 
 /**
- * @brief Task to monitor the output of SIM7600.
- * 
- * @todo Implementation
+ * @brief Consumer task. Stores the queued fixes in the track buffer, publishes the queued geofence
+ * events, then encodes and publishes the buffered fixes to the AWS MQTT broker. With
+ * TELEMETRY_PUBLISH, also publishes the telemetry snapshot every telemetry_interval_ms.
  * 
  * @param parameter 
  */
-void serial_monitor(void * parameter)
+void pubMQTT(void *parameter)
 {
-	char buffer[100];
-	bool message = false;
-	while(true)
+	TrackBuffer::record_t record = {};
+	uint32_t queued = millis();
+	#ifdef TELEMETRY_PUBLISH
+	uint32_t telemetry_published = millis();
+	#endif
+
+	while (true)
 	{
-		while( !sim7600.waitingForResponse && Serial2.available() )
-		{
-			memset(buffer, 0, sizeof(buffer));
-			Serial2.read(buffer, 100);
-			message = true;
-		}
+		// Also woken when the buffered fixes are due, so batch_max_latency_ms holds while no fix
+		// is reported (e.g. parked).
+		xSemaphoreTake(Semaphore_publish, batchWait(record, queued));
 
-		
-		if ( message )
+		// Every reported fix is stored first, so fixes are not lost while the broker is not reachable.
+		// The queue is emptied before publishing, so it only fills up during a single slow publish.
+		bool success = true;
+		while (fix_queue.pop(record))
 		{
-			if ( strstr(buffer, "+CMQTTCONNLOST") || strstr(buffer, "+CMQTTNONET") )
+			queued = millis();
+			if (!track.append(record))
 			{
-				vTaskDelete(Task_fetchGPS_pubMQTT);
+				Payload payload(payload_buffer, sizeof(payload_buffer), payload_format);
+				payload.add(record);
+				success = publishPayload(payload) && success;
+			}
+		}
 
-				configureSSL_MQTT();
+		// While the reconnect task is working, the fixes stay in the track buffer and the events in
+		// their queue. The events are published first, as they are alerts.
+		if (!mqtt_link.connected())
+			success = false;
+		else if (!publishGeofenceEvents() || (track.pending() > 0 && batchDue(record, queued) && !drainTrack()))
+		{
+			success = false;
+			xSemaphoreGive(Semaphore_MQTT_lost);
+		}
 
-				xTaskCreatePinnedToCore(fetchGPS_pubMQTT, "Fetch GPS and Publish MQTT", 4096, NULL, 1, &Task_fetchGPS_pubMQTT, 1);
-			}
-			message = false;
+		#ifdef TELEMETRY_PUBLISH
+		// Published from this task only, so the topic and payload of a fix are never replaced in between.
+		if (success && millis() - telemetry_published >= telemetry_interval_ms)
+		{
+			size_t length = telemetry_snapshot(telemetry_buffer, sizeof(telemetry_buffer));
+			if (length > 0 && publishMessage(telemetry_topic, telemetry_buffer, length))
+				telemetry_published = millis();
 		}
+		#endif
+
+		xSemaphoreTake(Semaphore_LED_blink_count, portMAX_DELAY);
+		LED_blink_count = success ? 1 : 3;
+		const unsigned int delay_interval = success ? 300 : 1000;
+		xSemaphoreGive(Semaphore_LED_blink_count);
+
+		vTaskResume(Task_LED_Control);
+		vTaskDelay(delay_interval / portTICK_PERIOD_MS);
+	}
+}
+
+/**
+ * @brief Handler for the URCs sent when the connection to the MQTT broker is lost. Runs in the modem I/O task.
+ * 
+ * @param line      URC line.
+ * @param context 
+ */
+void mqtt_connection_lost(const char *line, void *context)
+{
+	ESP_LOGW(MQTT_TAG, "%s", line);
+	xSemaphoreGive(Semaphore_MQTT_lost);
+}
+
+/**
+ * @brief Handler for the other URCs of SIM7600. Runs in the modem I/O task.
+ * 
+ * @param line      URC line.
+ * @param context 
+ */
+void log_urc(const char *line, void *context)
+{
+	ESP_LOGI(SIM7600_TAG, "%s", line);
+}
+
+/**
+ * @brief Handle a line of the serial console. "telemetry" prints the telemetry snapshot.
+ * 
+ * @param line 		Console line without the line ending.
+ */
+void console_command(const char *line)
+{
+	if (strcmp(line, "telemetry") == 0)
+	{
+		if (telemetry_snapshot(telemetry_buffer, sizeof(telemetry_buffer)) > 0)
+			Serial.println(telemetry_buffer);
+		else
+			ESP_LOGE(DEVICE_TAG, "Telemetry snapshot larger than %u bytes", (unsigned int)sizeof(telemetry_buffer));
+	}
+	else if (line[0] != '\0')
+		ESP_LOGW(DEVICE_TAG, "Unknown command: %s", line);
+}
 
+/**
+ * @brief Task to reconnect to the MQTT broker when the connection lost URC is received or a
+ * publish fails. Only the layers which are down are brought up again (see MQTTConnection).
+ * The publish task keeps running and buffers the fixes meanwhile.
+ * 
+ * @param parameter 
+ */
+void serial_monitor(void * parameter)
+{
+	while(true)
+	{
+		xSemaphoreTake(Semaphore_MQTT_lost, portMAX_DELAY);
 
+		// A modem which restarted on its own is back at MODEM_DEFAULT_BAUD, so the rate is checked after a failure.
+		while (!mqtt_link.attempt())
+		{
+			sim7600.syncBaudRate(modem_baud);
+			vTaskDelay(mqtt_link.backoff() / portTICK_PERIOD_MS);
+		}
 
+		boot_profile.mark(BootProfile::PHASE_CONNECTED, millis());
+		// The publish task waits for a new fix while the broker is not reachable.
+		xSemaphoreGive(Semaphore_publish);
+		ESP_LOGI(MQTT_TAG, "Reconnected in %lu ms (max %lu ms)", (unsigned long)mqtt_link.stats().lastDuration,
+				 (unsigned long)mqtt_link.stats().maxDuration);
 	}
 }
 
@@ -2,35 +2,129 @@
 #include "SIM7600.h"
 #include "secrets.h"
 #include "functions.h"
+#ifdef CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
 
 
 void setup()
 {
+	Task_Loop = xTaskGetCurrentTaskHandle();
 	Serial.begin(115200);
-	Serial2.begin(115200);
+	modem_uart.begin() ? ESP_LOGI(SIM7600_TAG, "UART driver installed") : ESP_LOGE(SIM7600_TAG, "UART driver not installed");
 
 	xSemaphoreGive(Semaphore_LED_blink_count);
 
-	xTaskCreatePinnedToCore(blink_LED, "LED Blink", 2048, NULL, 1, &Task_LED_Control, 1);
-	xTaskCreatePinnedToCore(battery_monitor, "Battery Monitoring Function", 2048, NULL, 1, &Task_Battery_Monitor, 1);
+	energy_update(EnergyModel::STATE_ACTIVE);
+	track.begin() ? ESP_LOGI(DEVICE_TAG, "Track buffer: %lu fixes pending", (unsigned long)track.pending()) : ESP_LOGE(DEVICE_TAG, "Track buffer partition not found");
+	geofence.begin() ? ESP_LOGI(DEVICE_TAG, "%u geofences in %u grid cells", geofence.count(), geofence.gridCells()) : ESP_LOGW(DEVICE_TAG, "Geofence partition not found");
+
+	// Core 0: modem I/O and the tasks waiting for the modem (publish, reconnect).
+	// Core 1: GNSS sampling on a fixed cadence and the housekeeping tasks.
+	Task_LED_Control = xTaskCreateStaticPinnedToCore(blink_LED, "LED Blink", STACK_LED_CONTROL, NULL, 1, Stack_LED_Control, &TCB_LED_Control, 1);
+	Task_Battery_Monitor = xTaskCreateStaticPinnedToCore(battery_monitor, "Battery Monitoring Function", STACK_BATTERY_MONITOR, NULL, 1, Stack_Battery_Monitor, &TCB_Battery_Monitor, 1);
 	
 	
 	
-	delay(10000);
-	sim7600.waitForResponse("PB DONE", 25);
+	SIM7600::onURC("+CMQTTCONNLOST", mqtt_connection_lost);
+	SIM7600::onURC("+CMQTTNONET", mqtt_connection_lost);
+	SIM7600::onURC("+CMQTTRXSTART", log_urc);
+	SIM7600::onURC("+CGNSSINFO", log_urc);
+	sim7600.startIOTask(2, 0) ? ESP_LOGI(SIM7600_TAG, "Modem I/O task started") : ESP_LOGE(SIM7600_TAG, "Modem I/O task did not start");
+
+	// After a restart of the ESP32 alone, the modem is still running at modem_baud.
+	sim7600.syncBaudRate(modem_baud);
+
+	// The modem sends "RDY" and "+CPIN: READY" when it has started; the phonebook ("PB DONE") is not waited for.
+	if (sim7600.waitReady(boot_ready_timeout_ms))
+	{
+		boot_profile.mark(BootProfile::PHASE_SIM_READY, millis());
+		ESP_LOGI(SIM7600_TAG, "SIM ready");
+	}
+	else
+		ESP_LOGE(SIM7600_TAG, "SIM not ready");
 
 	sim7600.echoOFF() ? ESP_LOGI(SIM7600_TAG, "Echo switched OFF") : ESP_LOGE(SIM7600_TAG, "Echo did not switch OFF");
+	sim7600.syncBaudRate(modem_baud) ? ESP_LOGI(SIM7600_TAG, "UART at %lu baud", (unsigned long)modem_baud) : ESP_LOGW(SIM7600_TAG, "UART stays at %lu baud", (unsigned long)modem_uart.baudRate());
 
-	configureSSL_MQTT();
+	#ifdef LOW_POWER
+	SIM7600::onSleep(modem_sleep_changed);
+	sim7600.enableSleep(SIM_DTR, SIM_RI) ? ESP_LOGI(SIM7600_TAG, "Sleep mode enabled") : ESP_LOGE(SIM7600_TAG, "Sleep mode not enabled");
+
+	#if defined(CONFIG_PM_ENABLE) && defined(CONFIG_FREERTOS_USE_TICKLESS_IDLE)
+	esp_pm_config_esp32_t pm_config = { .max_freq_mhz = 240, .min_freq_mhz = 80, .light_sleep_enable = true };
+	esp_pm_configure(&pm_config) == ESP_OK ? ESP_LOGI(DEVICE_TAG, "Automatic light sleep enabled") : ESP_LOGE(DEVICE_TAG, "Automatic light sleep not enabled");
+	#else
+	ESP_LOGW(DEVICE_TAG, "Automatic light sleep needs CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE");
+	#endif
+	#endif
+
+	// GNSS acquires while the modem registers and connects to the broker. The fixes reported
+	// before the connection are kept in the track buffer. The start (hot, warm or cold) depends on
+	// the last fix kept in the track buffer.
+	TrackBuffer::record_t last_fix;
+	if (track.latest(last_fix))
+		gnss_policy.restore(last_fix.timestamp, last_fix.latitude != 0 || last_fix.longitude != 0);
+	startGNSS();
+	boot_profile.mark(BootProfile::PHASE_GNSS_ON, millis());
 
-	gps.begin();
+	Task_Clock = xTaskCreateStaticPinnedToCore(update_active_hours, "Real Time Management", STACK_CLOCK, NULL, 1, Stack_Clock, &TCB_Clock, 1);
+	Task_pubMQTT = xTaskCreateStaticPinnedToCore(pubMQTT, "Publish MQTT", STACK_PUB_MQTT, NULL, 1, Stack_pubMQTT, &TCB_pubMQTT, 0);
+	Task_fetchGPS = xTaskCreateStaticPinnedToCore(fetchGPS, "Fetch GPS", STACK_FETCH_GPS, NULL, 2, Stack_fetchGPS, &TCB_fetchGPS, 1);
 
-	xTaskCreatePinnedToCore(update_active_hours, "Real Time Management", 2048, NULL, 1, &Task_Clock, 1);
-	xTaskCreatePinnedToCore(fetchGPS_pubMQTT, "Fetch GPS and Publish MQTT", 4096, NULL, 1, &Task_fetchGPS_pubMQTT, 1);
-	//xTaskCreatePinnedToCore(serial_monitor, "Monitor Output from SIM7600", 4096, NULL, 1, &Task_Serial, 1);
+	provisionCertificates();
+	boot_profile.mark(BootProfile::PHASE_CERTIFICATES, millis());
+
+	if (sim7600.waitRegistered(boot_register_timeout_ms))
+	{
+		boot_profile.mark(BootProfile::PHASE_REGISTERED, millis());
+		ESP_LOGI(SIM7600_TAG, "Registered to the network");
+	}
+	else
+		ESP_LOGE(SIM7600_TAG, "Not registered to the network");
+
+	// The reconnect task starts after the first attempt, so a connection-lost URC during the boot
+	// cannot run mqtt_link.attempt() from two tasks. Semaphore_MQTT_lost keeps it until then.
+	configureSSL_MQTT();
+	Task_Serial = xTaskCreateStaticPinnedToCore(serial_monitor, "Monitor Output from SIM7600", STACK_RECONNECT, NULL, 1, Stack_Serial, &TCB_Serial, 0);
+
+	// setup() runs in the Arduino loop task, which samples the memory from now on.
+	xSemaphoreTake(Semaphore_memory, portMAX_DELAY);
+	memory_monitor.addTask("modem_io", SIM7600::ioTaskHandle(), MODEM_IO_STACK_SIZE);
+	memory_monitor.addTask("publish", Task_pubMQTT, STACK_PUB_MQTT);
+	memory_monitor.addTask("gps", Task_fetchGPS, STACK_FETCH_GPS);
+	memory_monitor.addTask("reconnect", Task_Serial, STACK_RECONNECT);
+	memory_monitor.addTask("led", Task_LED_Control, STACK_LED_CONTROL);
+	memory_monitor.addTask("battery", Task_Battery_Monitor, STACK_BATTERY_MONITOR);
+	memory_monitor.addTask("clock", Task_Clock, STACK_CLOCK);
+	memory_monitor.addTask("loop", Task_Loop, CONFIG_ARDUINO_LOOP_STACK_SIZE);
+	xSemaphoreGive(Semaphore_memory);
+	report_memory();
 }
 
 void loop()
 {
+	static char line[32];
+	static size_t length = 0;
+	static uint32_t memory_sampled = millis();
+
+	while (Serial.available())
+	{
+		char c = Serial.read();
+		if (c == '\r' || c == '\n')
+		{
+			line[length] = '\0';
+			console_command(line);
+			length = 0;
+		}
+		else if (length < sizeof(line) - 1)
+			line[length++] = c;
+	}
 
+	if (millis() - memory_sampled >= memory_sample_interval_ms)
+	{
+		report_memory();
+		memory_sampled = millis();
+	}
+	delay(100);
 }
@@ -0,0 +1,182 @@
+#include <unity.h>
+
+#include "SIM7600.h"
+
+#include <fstream>
+#include <string>
+
+/**
+ * GPS::parse on the responses of the bench corpus (host/bench/corpus/cgnssinfo.txt): the return
+ * value, the valid mask and the values of the valid fields expected for every line, in the order
+ * of the corpus. A line added to the corpus needs its expectation here.
+ */
+
+#define CORPUS "host/bench/corpus/cgnssinfo.txt"
+
+typedef struct
+{
+    const char *response;
+    bool fix;                   // Return value: position and time valid.
+    uint16_t valid;             // GPS::valid_t mask.
+    // Checked when their bit is in valid.
+    int8_t fixmode;
+    int32_t latitudeE7;
+    int32_t longitudeE7;
+    time_t timestamp;
+    int32_t altitudeCm;
+    uint16_t speedCms;
+    uint16_t courseCd;
+}expected_t;
+
+static const expected_t expected[] =
+{
+    { "+CGNSSINFO: 2,09,05,00,3113.343286,N,12121.234064,E,250311,072809.3,44.1,0.0,0,1.1,0.8,0.7",
+      true, 0xff, 2, 312223881, 1213539011, 1301038089LL, 4410, 0, 0 },
+    { "+CGNSSINFO: 3,11,07,04,1724.563210,N,07829.118734,E,140823,101530.0,532.7,21.3,187.4,1.4,0.9,1.0",
+      true, 0xff, 3, 174093868, 784853122, 1692008130LL, 53270, 1096, 18740 },
+    { "+CGNSSINFO: 3,06,02,01,3352.123456,S,15112.654321,E,010124,000000.0,12.0,54.0,359.9,2.1,1.2,1.7",
+      true, 0xff, 3, -338687243, 1512109054, 1704067200LL, 1200, 2778, 35990 },
+    { "+CGNSSINFO: 2,04,00,00,4042.875600,N,07400.123000,W,311299,235959.9,-3.5,0.4,90.0,4.5,3.2,3.1",
+      true, 0xff, 2, 407145933, -740020500, 4102444799LL, -350, 21, 9000 },
+    { "+CGPSINFO: 3113.343286,N,12121.234064,E,250311,072809.0,44.1,0.0,0",
+      true, 0x7c, 0, 312223881, 1213539011, 1301038089LL, 4410, 0, 0 },
+    { "+CGPSINFO: 1724.563210,N,07829.118734,E,140823,101530.0,532.7,21.3,187.4",
+      true, 0x7c, 0, 174093868, 784853122, 1692008130LL, 53270, 1096, 18740 },
+    { "+CGNSSINFO: ,,,,,,,,,,,,,,,",
+      false, 0x00, 0, 0, 0, 0LL, 0, 0, 0 },
+    { "+CGPSINFO: ,,,,,,,,",
+      false, 0x00, 0, 0, 0, 0LL, 0, 0, 0 },
+    { "+CGNSSINFO: 2,09,,00,3113.343286,N,12121.234064,E,250311,072809.3,44.1,0.0,0,1.1,0.8,0.7",
+      true, 0xfd, 2, 312223881, 1213539011, 1301038089LL, 4410, 0, 0 },
+    { "+CGNSSINFO: 2,09,05,00,3113.343286,N,12121.234064,E,250311,072809.3,,,,,,",
+      true, 0x0f, 2, 312223881, 1213539011, 1301038089LL, 0, 0, 0 },
+    { "+CGNSSINFO: 2,09,05,00,3113.343286,N,12121.234064,E,,,44.1,0.0,0,1.1,0.8,0.7",
+      false, 0xf7, 2, 312223881, 1213539011, 0LL, 4410, 0, 0 },
+    { "+CGNSSINFO: 2,09,05,00,3113.343286,N,12121.234064,E,250311,072809.3,44.1,0.0,0,1.1",
+      true, 0x7f, 2, 312223881, 1213539011, 1301038089LL, 4410, 0, 0 },
+    { "+CGNSSINFO: 2,09,05,00,3113.343286,N,12121.23",
+      false, 0x03, 2, 0, 0, 0LL, 0, 0, 0 },
+    { "+CGNSSINFO: 2,09,05,00,3113.3",
+      false, 0x03, 2, 0, 0, 0LL, 0, 0, 0 },
+    { "+CGNSSINFO: 2,09",
+      false, 0x01, 2, 0, 0, 0LL, 0, 0, 0 },
+    { "+CGNSSINFO: 2",
+      false, 0x01, 2, 0, 0, 0LL, 0, 0, 0 },
+    { "+CGNSSINFO:",
+      false, 0x00, 0, 0, 0, 0LL, 0, 0, 0 },
+    { "+CGNSSINFO",
+      false, 0x00, 0, 0, 0, 0LL, 0, 0, 0 },
+    { "+CGPSINFO: 3113.343286,N,12121.234064,E,2503",
+      false, 0x04, 0, 312223881, 1213539011, 0LL, 0, 0, 0 },
+    { "+CGPSINFO: 3113.343286,N",
+      false, 0x00, 0, 0, 0, 0LL, 0, 0, 0 },
+    { "+CGNSSINFO: 2,09,05,00,3113.343286,X,12121.234064,E,250311,072809.3,44.1,0.0,0,1.1,0.8,0.7",
+      false, 0xfb, 2, 0, 0, 1301038089LL, 4410, 0, 0 },
+    { "+CGNSSINFO: 2,09,05,00,3113.34.3286,N,12121.234064,E,250311,072809.3,44.1,0.0,0,1.1,0.8,0.7",
+      false, 0xfb, 2, 0, 0, 1301038089LL, 4410, 0, 0 },
+    { "+CGNSSINFO: 2,09,05,00,.,N,.,E,250311,072809.3,44.1,0.0,0,1.1,0.8,0.7",
+      false, 0xfb, 2, 0, 0, 1301038089LL, 4410, 0, 0 },
+    { "+CGNSSINFO: 2,9999999999999,05,00,3113.343286,N,12121.234064,E,250311,072809.3,44.1,0.0,0,1.1,0.8,0.7",
+      true, 0xfd, 2, 312223881, 1213539011, 1301038089LL, 4410, 0, 0 },
+    { "+CGNSSINFO: -,+,--,++,3113.343286,NN,12121.234064,EW,2503111,07,44.1,0.0,0,1.1,0.8,0.7",
+      false, 0xf0, 0, 0, 0, 0LL, 4410, 0, 0 },
+    { "+CGNSSINFO: 2,09,05,00,31133432863113343286311334328631133432863113343286,N,1.0,E,250311,072809.3,1,1,1,1,1,1",
+      false, 0xfb, 2, 0, 0, 1301038089LL, 100, 51, 100 },
+    { "+CGNSSINFO: ,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,,",
+      false, 0x00, 0, 0, 0, 0LL, 0, 0, 0 },
+    { "+CGNSSINFO: 2,09,05,00,3113.343286,N,12121.234064,E,250311,072809.3,44.1,0.0,0,1.1,0.8,0.7,extra,fields,1,2,3",
+      true, 0xff, 2, 312223881, 1213539011, 1301038089LL, 4410, 0, 0 },
+    { ":::::::::",
+      false, 0x00, 0, 0, 0, 0LL, 0, 0, 0 },
+    { ",",
+      false, 0x00, 0, 0, 0, 0LL, 0, 0, 0 },
+    { "ERROR",
+      false, 0x00, 0, 0, 0, 0LL, 0, 0, 0 },
+    { "+CME ERROR: 3",
+      false, 0x01, 3, 0, 0, 0LL, 0, 0, 0 },
+    { "+CGNSSINFO: 2 , 09 , 05 , 00 , 3113.343286 , N , 12121.234064 , E , 250311 , 072809.3",
+      false, 0x00, 0, 0, 0, 0LL, 0, 0, 0 }
+};
+
+static const size_t expectedCount = sizeof(expected) / sizeof(expected[0]);
+
+class NullStream: public Stream
+{
+    public:
+        int available() override { return 0; }
+        int read() override { return -1; }
+        int peek() override { return -1; }
+        size_t write(const uint8_t *buffer, size_t size) override { return size; }
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static bool isGNSS(const char *response)
+{
+    return strncmp(response, "+CGPSINFO:", 10) != 0;
+}
+
+void test_corpus_lines_have_expectations(void)
+{
+    // Found from the path of this file, or else from the project folder (pio test runs there).
+    std::string path(__FILE__);
+    path = path.substr(0, path.find_last_of("/\\") + 1) + "../../" CORPUS;
+    std::ifstream file(path);
+    if (!file.is_open())
+        file.open(CORPUS);
+    TEST_ASSERT_TRUE_MESSAGE(file.is_open(), "corpus " CORPUS " not found");
+
+    std::string line;
+    size_t count = 0;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        TEST_ASSERT_TRUE_MESSAGE(count < expectedCount, "more corpus lines than expectations");
+        TEST_ASSERT_EQUAL_STRING(expected[count].response, line.c_str());
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(expectedCount, count);
+}
+
+void test_parse_corpus(void)
+{
+    NullStream stream;
+    GPS gps(stream);
+    char message[160];
+
+    for (size_t i = 0; i < expectedCount; i++)
+    {
+        const expected_t &e = expected[i];
+        const GPS::data_t &data = gps.data;
+        snprintf(message, sizeof(message), "corpus line %u: %s", (unsigned)i + 1, e.response);
+
+        TEST_ASSERT_TRUE_MESSAGE(gps.parse(e.response, strlen(e.response), isGNSS(e.response)) == e.fix, message);
+        TEST_ASSERT_EQUAL_HEX16_MESSAGE(e.valid, data.valid, message);
+
+        if (e.valid & GPS::VALID_FIXMODE)
+            TEST_ASSERT_EQUAL_INT8_MESSAGE(e.fixmode, data.fixmode, message);
+        if (e.valid & GPS::VALID_POSITION)
+        {
+            TEST_ASSERT_EQUAL_INT32_MESSAGE(e.latitudeE7, data.latitudeE7, message);
+            TEST_ASSERT_EQUAL_INT32_MESSAGE(e.longitudeE7, data.longitudeE7, message);
+        }
+        if (e.valid & GPS::VALID_DATETIME)
+            TEST_ASSERT_TRUE_MESSAGE(e.timestamp == data.timestamp, message);
+        if (e.valid & GPS::VALID_ALTITUDE)
+            TEST_ASSERT_EQUAL_INT32_MESSAGE(e.altitudeCm, data.altitudeCm, message);
+        if (e.valid & GPS::VALID_SPEED)
+            TEST_ASSERT_EQUAL_UINT16_MESSAGE(e.speedCms, data.speedCms, message);
+        if (e.valid & GPS::VALID_COURSE)
+            TEST_ASSERT_EQUAL_UINT16_MESSAGE(e.courseCd, data.courseCd, message);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_corpus_lines_have_expectations);
+    RUN_TEST(test_parse_corpus);
+    return UNITY_END();
+}
@@ -0,0 +1,109 @@
+#include <unity.h>
+
+#include "ModemSimulator.h"
+#include "SIM7600.h"
+
+#include <atomic>
+
+/**
+ * Modem I/O task on the host threads (see host/Arduino.h): two tasks submit commands at the same
+ * time and each gets the responses to its own commands, then the I/O task, idle by then, passes
+ * a URC to its handler. On the real clock. The simulator is only used by the I/O task once it runs,
+ * so the URC is scripted before.
+ */
+
+#define TEST_COMMANDS 25            // Commands per submitting task.
+#define TEST_TASK_STACK 16384
+
+typedef struct
+{
+    const char *command;
+    const char *expected;           // Line of the response of the command.
+    std::atomic<int> matched;
+    SemaphoreHandle_t finished;
+    StaticSemaphore_t finishedBuffer;
+    StaticTask_t taskBuffer;
+    StackType_t stack[TEST_TASK_STACK];
+}submitter_t;
+
+// Allocated once and never freed: the I/O task keeps running on a detached thread until the exit.
+static ModemSimulator *modem;
+static SIM7600 *sim7600;
+static std::atomic<int> urcs{0};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void submitTask(void *parameter)
+{
+    submitter_t *submitter = (submitter_t *)parameter;
+
+    for (int i = 0; i < TEST_COMMANDS; i++)
+    {
+        SIM7600::response_t response = sim7600->execute(submitter->command, submitter->expected, 1000);
+        if (response.status == SIM7600::AT_MATCH && strcmp(response.line, submitter->expected) == 0)
+            submitter->matched++;
+    }
+    xSemaphoreGive(submitter->finished);
+}
+
+static void countURC(const char *line, void *context)
+{
+    urcs++;
+}
+
+static void startSubmitter(submitter_t &submitter, const char *command, const char *expected)
+{
+    submitter.command = command;
+    submitter.expected = expected;
+    submitter.matched = 0;
+    submitter.finished = xSemaphoreCreateBinaryStatic(&submitter.finishedBuffer);
+    TEST_ASSERT_NOT_NULL(xTaskCreateStaticPinnedToCore(submitTask, command, TEST_TASK_STACK, &submitter, 1, submitter.stack,
+                                                       &submitter.taskBuffer, 1));
+}
+
+void test_io_task_starts(void)
+{
+    TEST_ASSERT_TRUE(sim7600->startIOTask());
+    TEST_ASSERT_NOT_NULL(SIM7600::ioTaskHandle());
+}
+
+void test_concurrent_submitters_get_their_responses(void)
+{
+    static submitter_t first, second;
+    uint32_t exchanges = SIM7600::exchangeCount();
+
+    startSubmitter(first, "AT+TESTA", "+TESTA: 1");
+    startSubmitter(second, "AT+TESTB", "+TESTB: 2");
+
+    TEST_ASSERT_TRUE(xSemaphoreTake(first.finished, 20000) == pdTRUE);
+    TEST_ASSERT_TRUE(xSemaphoreTake(second.finished, 20000) == pdTRUE);
+    TEST_ASSERT_EQUAL_INT(TEST_COMMANDS, first.matched.load());
+    TEST_ASSERT_EQUAL_INT(TEST_COMMANDS, second.matched.load());
+    TEST_ASSERT_EQUAL_UINT32(2 * TEST_COMMANDS, SIM7600::exchangeCount() - exchanges);
+}
+
+void test_urc_while_idle_reaches_its_handler(void)
+{
+    for (uint32_t start = millis(); urcs.load() == 0 && millis() - start < 5000;)
+        delay(10);
+    TEST_ASSERT_EQUAL_INT(1, urcs.load());
+}
+
+int main(int argc, char **argv)
+{
+    ModemSimulator::profile_t profile;
+    profile.latency = 1;
+    modem = new ModemSimulator(profile);
+    modem->respond("AT+TESTA", { { 0, "+TESTA: 1" }, { 0, "OK" } });
+    modem->respond("AT+TESTB", { { 0, "+TESTB: 2" }, { 0, "OK" } });
+    modem->urc(millis() + 1000, "+TESTURC: 1");
+    sim7600 = new SIM7600(*modem);
+    SIM7600::onURC("+TESTURC", countURC);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_io_task_starts);
+    RUN_TEST(test_concurrent_submitters_get_their_responses);
+    RUN_TEST(test_urc_while_idle_reaches_its_handler);
+    return UNITY_END();
+}
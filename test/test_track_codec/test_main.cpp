@@ -0,0 +1,167 @@
+#include <unity.h>
+
+#include "TrackCodec.h"
+
+#include <string.h>
+
+/**
+ * TrackCodec: exact round trips, also with deltas which wrap around int32 and with varints of the
+ * maximum length, and the rejection of truncated data and of an unknown version.
+ */
+
+typedef TrackCodec::fix_t fix_t;
+
+static const fix_t track[] =
+{
+    { 1000, 1700000000, 483721234, 115432109, 0, 0, 4100 },
+    { 1001, 1700000005, 483721301, 115431987, 1250, 9000, 4098 },
+    { 1002, 1700000010, 483721455, 115431802, 1310, 8950, 4101 },
+    { 1005, 1700000030, 483720980, 115432500, 0, 35999, 4090 },
+};
+
+// Every delta of the second and third fixes is as far as it can be: the varints of sequence,
+// timestamp, latitude and longitude take 5 bytes, the ones of speed, course and battery 3 bytes.
+static const fix_t extremes[] =
+{
+    { 0, 0, 0, 0, 0, 0, 0 },
+    { 0x80000000, INT32_MIN, INT32_MIN, INT32_MIN, UINT16_MAX, UINT16_MAX, UINT16_MAX },
+    { 0, 0, 0, 0, UINT16_MAX, 0, 0 },
+};
+
+// Deltas which overflow int32 and wrap around.
+static const fix_t wraparound[] =
+{
+    { UINT32_MAX, INT32_MAX, 900000000, -1800000000, 100, 35999, 3300 },
+    { 0, INT32_MIN, -900000000, 1800000000, 200, 0, 4200 },
+    { UINT32_MAX, INT32_MAX, 900000000, -1800000000, 0, 35999, 3300 },
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static size_t encode(const fix_t *fixes, size_t count, uint8_t *buffer, size_t size)
+{
+    TrackCodec::Encoder encoder(buffer, size);
+
+    for (size_t i = 0; i < count; i++)
+        TEST_ASSERT_TRUE(encoder.add(fixes[i]));
+    TEST_ASSERT_EQUAL_UINT8(count, encoder.fixes());
+    return encoder.length();
+}
+
+static void assertFix(const fix_t &expected, const fix_t &actual)
+{
+    TEST_ASSERT_EQUAL_UINT32(expected.sequence, actual.sequence);
+    TEST_ASSERT_EQUAL_INT32(expected.timestamp, actual.timestamp);
+    TEST_ASSERT_EQUAL_INT32(expected.latitude, actual.latitude);
+    TEST_ASSERT_EQUAL_INT32(expected.longitude, actual.longitude);
+    TEST_ASSERT_EQUAL_UINT16(expected.speed, actual.speed);
+    TEST_ASSERT_EQUAL_UINT16(expected.course, actual.course);
+    TEST_ASSERT_EQUAL_UINT16(expected.battery, actual.battery);
+}
+
+static void assertRoundTrip(const fix_t *fixes, size_t count)
+{
+    uint8_t buffer[2 + 8 * TrackCodec::FIX_MAX_LENGTH];
+    size_t length = encode(fixes, count, buffer, sizeof(buffer));
+
+    TrackCodec::Decoder decoder(buffer, length);
+    TEST_ASSERT_TRUE(decoder.valid());
+    TEST_ASSERT_EQUAL_UINT8(count, decoder.fixes());
+
+    fix_t fix;
+    for (size_t i = 0; i < count; i++)
+    {
+        TEST_ASSERT_TRUE(decoder.next(fix));
+        assertFix(fixes[i], fix);
+    }
+    TEST_ASSERT_FALSE(decoder.next(fix));
+    TEST_ASSERT_TRUE(decoder.valid());
+}
+
+void test_round_trip(void)
+{
+    assertRoundTrip(track, sizeof(track) / sizeof(track[0]));
+}
+
+void test_round_trip_wraparound_deltas(void)
+{
+    assertRoundTrip(wraparound, sizeof(wraparound) / sizeof(wraparound[0]));
+}
+
+void test_round_trip_maximum_length_varints(void)
+{
+    uint8_t buffer[2 + 3 * TrackCodec::FIX_MAX_LENGTH];
+
+    TEST_ASSERT_EQUAL_size_t(2 + 19 + 29 + 29, encode(extremes, 3, buffer, sizeof(buffer)));
+    assertRoundTrip(extremes, sizeof(extremes) / sizeof(extremes[0]));
+}
+
+void test_add_fails_when_full(void)
+{
+    uint8_t buffer[2 + 19 + 10];
+    TrackCodec::Encoder encoder(buffer, sizeof(buffer));
+
+    TEST_ASSERT_TRUE(encoder.add(extremes[0]));
+    TEST_ASSERT_FALSE(encoder.add(extremes[1]));
+    TEST_ASSERT_EQUAL_UINT8(1, encoder.fixes());
+    TEST_ASSERT_EQUAL_size_t(2 + 19, encoder.length());
+}
+
+void test_truncated_input_is_invalid(void)
+{
+    uint8_t buffer[2 + 4 * TrackCodec::FIX_MAX_LENGTH];
+    size_t length = encode(track, sizeof(track) / sizeof(track[0]), buffer, sizeof(buffer));
+
+    for (size_t truncated = 0; truncated < length; truncated++)
+    {
+        TrackCodec::Decoder decoder(buffer, truncated);
+        fix_t fix;
+
+        while (decoder.next(fix))
+            ;
+        TEST_ASSERT_FALSE_MESSAGE(decoder.valid(), "truncated input decoded as valid");
+    }
+}
+
+void test_overlong_varint_is_invalid(void)
+{
+    // Second fix with a 6-byte varint as the sequence delta.
+    uint8_t buffer[2 + 19 + 12];
+    size_t length = encode(extremes, 1, buffer, sizeof(buffer));
+    const uint8_t overlong[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 0, 0, 0, 0, 0, 0 };
+
+    memcpy(buffer + length, overlong, sizeof(overlong));
+    buffer[1] = 2;
+
+    TrackCodec::Decoder decoder(buffer, length + sizeof(overlong));
+    fix_t fix;
+    TEST_ASSERT_TRUE(decoder.next(fix));
+    TEST_ASSERT_FALSE(decoder.next(fix));
+    TEST_ASSERT_FALSE(decoder.valid());
+}
+
+void test_unknown_version_is_invalid(void)
+{
+    uint8_t buffer[2 + 4 * TrackCodec::FIX_MAX_LENGTH];
+    size_t length = encode(track, sizeof(track) / sizeof(track[0]), buffer, sizeof(buffer));
+    buffer[0] = TrackCodec::VERSION + 1;
+
+    TrackCodec::Decoder decoder(buffer, length);
+    fix_t fix;
+    TEST_ASSERT_FALSE(decoder.valid());
+    TEST_ASSERT_FALSE(decoder.next(fix));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_round_trip_wraparound_deltas);
+    RUN_TEST(test_round_trip_maximum_length_varints);
+    RUN_TEST(test_add_fails_when_full);
+    RUN_TEST(test_truncated_input_is_invalid);
+    RUN_TEST(test_overlong_varint_is_invalid);
+    RUN_TEST(test_unknown_version_is_invalid);
+    return UNITY_END();
+}